@@ -128,6 +128,48 @@ template <typename TA> void runBenchmarks(TA &valloc, uint32_t bufsize, uint8_t
     printBenchEnd(millis() - time, bufsize, repeats);
     printVAStats(valloc);
 
+    Serial.println("Repeating tests with spans...");
+    time = millis();
+
+    for (uint8_t i=0; i<repeats; ++i)
+    {
+        VSpan<char, TA> span(buf, bufsize);
+        uint8_t counter = 0;
+
+        while (span.next())
+        {
+            char *b = span.data();
+            for (uint16_t j=0; j<span.size(); ++j)
+                b[j] = (char)counter++;
+        }
+    }
+
+    valloc.clearPages();
+    printBenchEnd(millis() - time, bufsize, repeats);
+    printVAStats(valloc);
+
+    Serial.println("Reading data");
+
+    time = millis();
+    for (uint8_t i=0; i<repeats; ++i)
+    {
+        VSpan<char, TA> span(buf, bufsize, true);
+        uint8_t counter = 0;
+
+        for (typename VSpan<char, TA>::Iterator it=span.begin(); it!=span.end(); ++it, ++counter)
+        {
+            if (*it != (char)counter)
+            {
+                Serial.print("Mismatch! value/actual: "); Serial.print((int)counter);
+                Serial.print("/"); Serial.println((int)*it);
+            }
+        }
+    }
+
+    valloc.clearPages();
+    printBenchEnd(millis() - time, bufsize, repeats);
+    printVAStats(valloc);
+
     valloc.stop();
 }
 
@@ -0,0 +1,41 @@
+#ifndef VIRTMEM_ALLOC_INSTANCE_H
+#define VIRTMEM_ALLOC_INSTANCE_H
+
+// Heap allocated allocator instance used by the host programs, see README.md
+
+#include <new>
+
+namespace virtmem {
+
+/**
+ * @brief Constructs an allocator on the heap and destroys it when it goes out of scope.
+ *
+ * Allocators are usually global objects, and are never deleted through a pointer to a base
+ * class. Hence, BaseVAlloc has no virtual destructor, and using `delete` on an allocator triggers
+ * `-Wdelete-non-virtual-dtor`. This class destructs the (concrete) allocator type explicitly
+ * instead. It is used for allocators that are too large or that should not exist for the entire
+ * program (allocators are singletons of their type).
+ *
+ * @tparam Alloc Allocator type
+ */
+template <typename Alloc> class AllocInstance
+{
+    void *memory;
+    Alloc *alloc;
+
+    AllocInstance(const AllocInstance &); // not copyable
+    AllocInstance &operator=(const AllocInstance &);
+
+public:
+    //! Constructs the allocator, all arguments are passed to its constructor.
+    template <typename... Args> explicit AllocInstance(Args... args) :
+        memory(::operator new(sizeof(Alloc))), alloc(new (memory) Alloc(args...)) { }
+    ~AllocInstance(void) { alloc->~Alloc(); ::operator delete(memory); }
+
+    Alloc &operator*(void) { return *alloc; }
+    Alloc *operator->(void) { return alloc; }
+};
+
+}
+
+#endif // VIRTMEM_ALLOC_INSTANCE_H
@@ -0,0 +1,384 @@
+// Host benchmark suite for virtmem, see README.md
+
+#include "virtmem.h"
+#include "alloc/compressed_alloc.h"
+#include "alloc/static_alloc.h"
+#include "alloc/stdio_alloc.h"
+#include "alloc/tiered_alloc.h"
+#include "alloc_instance.h"
+#include "latency_alloc.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "alloc/mmap_alloc.h"
+#define HAVE_MMAP_ALLOC
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace virtmem;
+
+namespace {
+
+// --- settings ---
+
+#if VIRTMEM_VPTR_BITS == 16 // pools must stay below 64 kB
+const uint32_t POOL_SIZE = 1024 * 60;
+const uint32_t BUFFER_SIZE = 16 * 1024; // size of the data used by most benchmarks
+const uint32_t CHURN_MAX_LARGE = 256; // maximum extra size of occasional large blocks
+#else
+const uint32_t POOL_SIZE = 1024 * 1024;
+const uint32_t BUFFER_SIZE = 256 * 1024; // size of the data used by most benchmarks
+const uint32_t CHURN_MAX_LARGE = 2048;
+#endif
+const uint32_t STRIDE = 1031; // bytes, prime so accesses move through all page offsets
+const uint32_t RANDOM_ACCESSES = 200000;
+const uint32_t CHURN_OPERATIONS = 20000;
+const uint32_t CHURN_SLOTS = 256;
+
+// Page geometries (see DefaultAllocProperties)
+struct TinyGeometry // similar to small AVRs
+{
+    static const uint8_t smallPageCount = 2, smallPageSize = 16;
+    static const uint8_t mediumPageCount = 1, mediumPageSize = 32;
+    static const uint8_t bigPageCount = 1;
+    static const uint16_t bigPageSize = 128;
+};
+
+struct MCUGeometry // default for most MCUs
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 128;
+    static const uint8_t bigPageCount = 4;
+    static const uint16_t bigPageSize = 512;
+};
+
+struct PCGeometry // default for PC like platforms
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 64;
+    static const uint8_t mediumPageCount = 4;
+    static const uint16_t mediumPageSize = 256;
+    static const uint8_t bigPageCount = 4;
+    static const uint16_t bigPageSize = 1024 * 32;
+    static const uint16_t dirtyGranularity = 512;
+    static const uint8_t slabCount = 16;
+    static const uint16_t slabSize = 1024;
+};
+
+// Adds read ahead and write-back to a geometry, used with the latency allocator. Prefetched pages
+// are read and replaced modified pages are written asynchronously if the allocator supports it.
+template <typename Geometry> struct AsyncGeometry : public Geometry
+{
+    static const uint8_t readAhead = Geometry::bigPageCount / 2;
+    static const bool asyncWriteBack = true; // NOTE: requires that dirtyGranularity is not set
+};
+
+// --- utilities ---
+
+volatile uint32_t sink; // prevents that reads are optimized away
+const char *filter = 0;
+bool failed = false;
+
+class Timer
+{
+    std::chrono::steady_clock::time_point start;
+
+public:
+    Timer(void) : start(std::chrono::steady_clock::now()) { }
+    uint64_t elapsed(void) const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Simple deterministic PRNG, so that all runs perform the same accesses
+class Random
+{
+    uint32_t state;
+
+public:
+    Random(uint32_t seed=12345) : state(seed) { }
+    uint32_t next(void) { state = state * 1664525 + 1013904223; return state >> 8; }
+    uint32_t next(uint32_t max) { return next() % max; }
+};
+
+void printHeader(void)
+{
+    std::printf("allocator,geometry,benchmark,bytes,operations,usec,mb_per_s,page_reads,page_writes,bytes_read,bytes_written\n");
+}
+
+template <typename Alloc> void report(Alloc &valloc, const char *allocname, const char *geometry, const char *bench,
+                                      uint64_t bytes, uint64_t ops, uint64_t usec)
+{
+    const double mbps = (usec) ? (double)bytes / usec : 0.0; // bytes per us equals MB/s
+    std::printf("%s,%s,%s,%llu,%llu,%llu,%.2f,%lu,%lu,%lu,%lu\n", allocname, geometry, bench,
+                (unsigned long long)bytes, (unsigned long long)ops, (unsigned long long)usec, mbps,
+                (unsigned long)valloc.getBigPageReads(), (unsigned long)valloc.getBigPageWrites(),
+                (unsigned long)valloc.getBytesRead(), (unsigned long)valloc.getBytesWritten());
+    std::fflush(stdout);
+}
+
+void check(bool ok, const char *allocname, const char *geometry, const char *bench)
+{
+    if (!ok)
+    {
+        std::fprintf(stderr, "verification failed: %s/%s/%s\n", allocname, geometry, bench);
+        failed = true;
+    }
+}
+
+// Runs a benchmark: the allocator is reset before, and all modified pages are written after it
+#define BENCH(NAME, BYTES, OPS, ...) \
+    do { \
+        valloc.clearPages(); \
+        valloc.resetStats(); \
+        Timer timer; \
+        __VA_ARGS__ \
+        valloc.clearPages(); \
+        report(valloc, allocname, geometry, NAME, BYTES, OPS, timer.elapsed()); \
+    } while (false)
+
+// --- benchmarks ---
+
+template <typename Alloc> void runSuite(Alloc &valloc, const char *allocname, const char *geometry)
+{
+    if (filter && !std::strstr(allocname, filter) && !std::strstr(geometry, filter))
+        return;
+
+    typedef VPtr<char, Alloc> CharPtr;
+    typedef VPtr<uint32_t, Alloc> IntPtr;
+
+    valloc.start();
+
+    CharPtr buf = valloc.template alloc<char>(BUFFER_SIZE);
+    char *ram = new char[BUFFER_SIZE];
+
+    BENCH("seq_write", BUFFER_SIZE, BUFFER_SIZE,
+        for (uint32_t i=0; i<BUFFER_SIZE; ++i)
+            buf[i] = (char)i;
+    );
+
+    BENCH("seq_read", BUFFER_SIZE, BUFFER_SIZE,
+        uint32_t sum = 0;
+        bool ok = true;
+        for (uint32_t i=0; i<BUFFER_SIZE; ++i)
+        {
+            const char c = buf[i];
+            ok = ok && (c == (char)i);
+            sum += c;
+        }
+        sink = sum;
+        check(ok, allocname, geometry, "seq_read");
+    );
+
+    BENCH("prefetch_read", BUFFER_SIZE, BUFFER_SIZE,
+        // the next big page is prefetched while the current one is read
+        const uint32_t psize = valloc.getBigPageSize();
+        uint32_t sum = 0;
+        bool ok = true;
+        for (uint32_t i=0; i<BUFFER_SIZE; ++i)
+        {
+            if ((i % psize) == 0 && (i + psize) < BUFFER_SIZE)
+                valloc.prefetch(buf.getRawNum() + i + psize, psize);
+            const char c = buf[i];
+            ok = ok && (c == (char)i);
+            sum += c;
+        }
+        sink = sum;
+        check(ok, allocname, geometry, "prefetch_read");
+    );
+
+    BENCH("strided_read", BUFFER_SIZE, BUFFER_SIZE,
+        uint32_t sum = 0, offset = 0;
+        for (uint32_t i=0; i<BUFFER_SIZE; ++i)
+        {
+            sum += buf[offset];
+            offset = (offset + STRIDE) % BUFFER_SIZE;
+        }
+        sink = sum;
+    );
+
+    BENCH("random_rmw", (uint64_t)RANDOM_ACCESSES * sizeof(uint32_t), RANDOM_ACCESSES,
+        IntPtr ints = static_cast<IntPtr>(buf);
+        const uint32_t count = BUFFER_SIZE / sizeof(uint32_t);
+        Random rnd;
+        for (uint32_t i=0; i<RANDOM_ACCESSES; ++i)
+            ints[rnd.next(count)] += i;
+    );
+
+    BENCH("lock_write", BUFFER_SIZE, BUFFER_SIZE,
+        uint32_t sizeleft = BUFFER_SIZE;
+        CharPtr p = buf;
+        uint8_t counter = 0;
+        while (sizeleft)
+        {
+            VPtrLock<CharPtr> l = makeVirtPtrLock(p, std::min((uint32_t)valloc.getBigPageSize(), sizeleft));
+            const VirtPageSize lsize = l.getLockSize();
+            char *b = *l;
+            for (VirtPageSize j=0; j<lsize; ++j)
+                b[j] = (char)counter++;
+            p += lsize; sizeleft -= lsize;
+        }
+    );
+
+    BENCH("lock_read", BUFFER_SIZE, BUFFER_SIZE,
+        uint32_t sizeleft = BUFFER_SIZE;
+        CharPtr p = buf;
+        uint8_t counter = 0;
+        bool ok = true;
+        while (sizeleft)
+        {
+            VPtrLock<CharPtr> l = makeVirtPtrLock(p, std::min((uint32_t)valloc.getBigPageSize(), sizeleft), true);
+            const VirtPageSize lsize = l.getLockSize();
+            const char *b = *l;
+            for (VirtPageSize j=0; j<lsize; ++j)
+                ok = ok && (b[j] == (char)counter++);
+            p += lsize; sizeleft -= lsize;
+        }
+        check(ok, allocname, geometry, "lock_read");
+    );
+
+    for (uint32_t i=0; i<BUFFER_SIZE; ++i)
+        ram[i] = (char)(i * 7);
+
+    BENCH("memcpy_to_vptr", BUFFER_SIZE, 1,
+        memcpy(buf, ram, BUFFER_SIZE);
+    );
+
+    std::memset(ram, 0, BUFFER_SIZE);
+    BENCH("memcpy_from_vptr", BUFFER_SIZE, 1,
+        memcpy(ram, buf, BUFFER_SIZE);
+    );
+    bool ok = true;
+    for (uint32_t i=0; i<BUFFER_SIZE && ok; ++i)
+        ok = (ram[i] == (char)(i * 7));
+    check(ok, allocname, geometry, "memcpy_from_vptr");
+
+    CharPtr buf2 = valloc.template alloc<char>(BUFFER_SIZE);
+    BENCH("memcpy_vptr_vptr", BUFFER_SIZE, 1,
+        memcpy(buf2, buf, BUFFER_SIZE);
+    );
+
+    BENCH("memset", BUFFER_SIZE, 1,
+        memset(buf, 0x55, BUFFER_SIZE);
+    );
+
+    std::memset(ram, 'x', BUFFER_SIZE - 1);
+    ram[BUFFER_SIZE - 1] = 0;
+    BENCH("strcpy_to_vptr", BUFFER_SIZE, 1,
+        strcpy(buf, ram);
+    );
+
+    ram[0] = 0;
+    BENCH("strcpy_from_vptr", BUFFER_SIZE, 1,
+        strcpy(ram, buf);
+    );
+    check(std::strlen(ram) == (BUFFER_SIZE - 1), allocname, geometry, "strcpy_from_vptr");
+
+    valloc.free(buf2);
+    valloc.free(buf);
+    delete [] ram;
+
+    BENCH("alloc_churn", 0, CHURN_OPERATIONS,
+        VPtrNum slots[CHURN_SLOTS] = { 0 };
+        Random rnd;
+        for (uint32_t i=0; i<CHURN_OPERATIONS; ++i)
+        {
+            const uint32_t s = rnd.next(CHURN_SLOTS);
+            if (slots[s])
+            {
+                valloc.freeRaw(slots[s]);
+                slots[s] = 0;
+            }
+            else
+            {
+                // mostly small blocks, with an occasional large one
+                const VPtrSize size = (rnd.next(8) == 0) ? (256 + rnd.next(CHURN_MAX_LARGE)) : (1 + rnd.next(64));
+                slots[s] = valloc.allocRaw(size);
+                check(slots[s] != 0, allocname, geometry, "alloc_churn");
+            }
+        }
+        for (uint32_t s=0; s<CHURN_SLOTS; ++s)
+            valloc.freeRaw(slots[s]);
+    );
+
+    valloc.stop();
+}
+
+// Allocators are singletons of their type (backends of compressed and tiered allocators are
+// shared between geometries), hence, only one allocator is constructed at a time.
+template <typename Alloc> void runSuite(const char *allocname, const char *geometry)
+{
+    AllocInstance<Alloc> valloc;
+    runSuite(*valloc, allocname, geometry);
+}
+
+template <typename Geometry> void runPagedSuites(const char *geometry)
+{
+    {
+        AllocInstance<StdioVAllocP<Geometry> > stdioalloc(POOL_SIZE);
+        runSuite(*stdioalloc, "stdio", geometry);
+    }
+
+    runSuite<CompressedVAllocP<StaticVAllocP<POOL_SIZE, TierAllocProperties>, POOL_SIZE, POOL_SIZE / 512, 512, Geometry> >("compressed", geometry);
+
+    typedef TieredVAllocP<StaticVAllocP<POOL_SIZE / 8, TierAllocProperties>, StdioVAllocP<TierAllocProperties>, 512, POOL_SIZE / 8 / 512, Geometry> Tiered;
+    AllocInstance<Tiered> tiered(POOL_SIZE);
+    runSuite(*tiered, "tiered", geometry);
+}
+
+// Runs the latency allocator with synchronous and with asynchronous transfers
+template <typename Geometry> void runLatencySuites(const char *geometry)
+{
+    typedef LatencyVAllocP<AsyncGeometry<Geometry> > Latency;
+    {
+        AllocInstance<Latency> latency(POOL_SIZE);
+        runSuite(*latency, "latency", geometry);
+    }
+
+    AllocInstance<Latency> latency(POOL_SIZE);
+    latency->setAsync(true);
+    runSuite(*latency, "latency_async", geometry);
+    if (!filter || std::strstr("latency_async", filter) || std::strstr(geometry, filter))
+    {
+        check(latency->getAsyncReads() > 0, "latency_async", geometry, "async_reads");
+        check(latency->getAsyncWrites() > 0, "latency_async", geometry, "async_writes");
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        if (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")
+        {
+            std::printf("Usage: %s [filter]\n\nRuns all benchmarks, or only those of which the allocator or geometry name\n"
+                        "contains filter. The results are written to stdout as CSV.\n", argv[0]);
+            return 0;
+        }
+        filter = argv[1];
+    }
+
+    printHeader();
+
+    runPagedSuites<TinyGeometry>("tiny");
+    runPagedSuites<MCUGeometry>("mcu");
+    runPagedSuites<PCGeometry>("pc");
+    // page transfers are slow with this allocator, so only one geometry is used
+    runLatencySuites<MCUGeometry>("mcu");
+
+    // directly addressable allocators don't use memory pages, so the geometry is irrelevant
+    runSuite<StaticVAllocP<POOL_SIZE, MCUGeometry> >("static", "direct");
+#ifdef HAVE_MMAP_ALLOC
+    AllocInstance<MmapVAllocP<MCUGeometry> > mmapalloc(POOL_SIZE);
+    runSuite(*mmapalloc, "mmap", "direct");
+#endif
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,642 @@
+// Host check program for virtmem, see README.md
+
+#include "virtmem.h"
+#include "alloc/compressed_alloc.h"
+#include "alloc/static_alloc.h"
+#include "alloc/stdio_alloc.h"
+#include "alloc/tiered_alloc.h"
+#include "containers/vdeque.h"
+#include "containers/vhashmap.h"
+#include "containers/vvector.h"
+#include "alloc_instance.h"
+#include "latency_alloc.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "alloc/mmap_alloc.h"
+#define HAVE_MMAP_ALLOC
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <thread>
+#include <vector>
+
+// the allocators and LatencyVAllocP verify their internal state with assert
+#ifdef NDEBUG
+#error "This program must be built with assertions enabled"
+#endif
+
+using namespace virtmem;
+
+namespace {
+
+// --- settings ---
+
+#if VIRTMEM_VPTR_BITS == 16 // pools must stay below 64 kB
+const uint32_t POOL_SIZE = 1024 * 60;
+const uint32_t KEY_RANGE = 512; // keys of hash map checks
+#else
+const uint32_t POOL_SIZE = 1024 * 256;
+const uint32_t KEY_RANGE = 2048;
+#endif
+const uint32_t CONTAINER_OPERATIONS = 20000;
+const uint32_t ARRAY_ELEMENTS = 1000;
+const uint32_t LOCK_BUFFER_SIZE = 4096;
+const uint32_t SHADOW_SIZE = 1024 * 16; // data compared with a copy in RAM
+const char *POOL_FILE = "virtmem_check.pool"; // used by the persistence check of MmapVAllocP
+const uint32_t THREADS = 3; // each may hold a big page lock, one big page remains for other accesses
+const uint32_t THREAD_ITEMS = 256;
+const uint32_t THREAD_OPERATIONS = 5000;
+
+// Small pages, so that all checks swap pages
+struct CheckGeometry
+{
+    static const uint8_t smallPageCount = 4, smallPageSize = 32;
+    static const uint8_t mediumPageCount = 4, mediumPageSize = 128;
+    static const uint8_t bigPageCount = 4;
+    static const uint16_t bigPageSize = 512;
+};
+
+struct AsyncCheckGeometry : public CheckGeometry
+{
+    static const uint8_t readAhead = 2;
+    static const bool asyncWriteBack = true;
+};
+
+// Allocator shared by multiple threads
+struct ThreadCheckGeometry : public CheckGeometry
+{
+    typedef StdMutex Mutex;
+};
+
+// Aligned pages with read ahead, which mixes aligned and unaligned (locked or large) pages
+template <typename Policy> struct AlignedCheckGeometry : public AsyncCheckGeometry
+{
+    static const uint16_t bigPageSize = 256;
+    static const bool alignBigPages = true;
+    typedef Policy PagePolicy;
+};
+
+// --- utilities ---
+
+bool failed = false;
+
+class Random
+{
+    uint32_t state;
+
+public:
+    Random(uint32_t seed=12345) : state(seed) { }
+    uint32_t next(void) { state = state * 1664525 + 1013904223; return state >> 8; }
+    uint32_t next(uint32_t max) { return next() % max; }
+};
+
+void check(bool ok, const char *allocname, const char *what)
+{
+    if (!ok)
+    {
+        std::fprintf(stderr, "check failed: %s/%s\n", allocname, what);
+        failed = true;
+    }
+}
+
+// Element type with a non-trivial constructor and destructor
+struct Counted
+{
+    enum { MAGIC = 0x5a5a1234 };
+
+    static uint32_t constructed, destructed;
+    uint32_t value;
+
+    Counted(void) : value(MAGIC) { ++constructed; }
+    ~Counted(void) { if (value == MAGIC) ++destructed; value = 0; }
+};
+
+uint32_t Counted::constructed = 0, Counted::destructed = 0;
+
+struct ThreadItem
+{
+    uint32_t id, value;
+};
+
+// --- checks ---
+
+// Compares random operations on a VVector with std::vector
+template <typename Alloc> void checkVector(const char *allocname)
+{
+    VVector<uint32_t, Alloc> vec;
+    std::vector<uint32_t> ref;
+    Random rnd;
+
+    for (uint32_t i=0; i<CONTAINER_OPERATIONS; ++i)
+    {
+        const uint32_t op = rnd.next(10), value = rnd.next();
+        if (op < 5 || ref.empty())
+        {
+            vec.pushBack(value);
+            ref.push_back(value);
+        }
+        else if (op < 7)
+        {
+            vec.popBack();
+            ref.pop_back();
+        }
+        else if (op < 9)
+        {
+            const uint32_t pos = rnd.next(ref.size());
+            vec.set(pos, value);
+            ref[pos] = value;
+        }
+        else
+        {
+            const uint32_t pos = rnd.next(ref.size()), n = 1 + rnd.next(ref.size() - pos);
+            vec.erase(pos, n);
+            ref.erase(ref.begin() + pos, ref.begin() + pos + n);
+        }
+    }
+
+    check(vec.size() == ref.size(), allocname, "vvector_size");
+    bool ok = true;
+    for (uint32_t i=0; i<ref.size(); ++i)
+        ok = ok && (vec.get(i) == ref[i]);
+    check(ok, allocname, "vvector_data");
+
+    vec.resize(ref.size() + 1000, 7);
+    ok = vec.size() == (ref.size() + 1000);
+    for (uint32_t i=ref.size(); i<vec.size(); ++i)
+        ok = ok && (vec.get(i) == 7);
+    check(ok, allocname, "vvector_resize");
+
+    vec.clear();
+    check(vec.empty(), allocname, "vvector_clear");
+}
+
+// Compares random operations on a VDeque with std::deque
+template <typename Alloc> void checkDeque(const char *allocname)
+{
+    VDeque<uint32_t, Alloc> deque;
+    std::deque<uint32_t> ref;
+    Random rnd;
+    bool ok = true;
+
+    for (uint32_t i=0; i<CONTAINER_OPERATIONS; ++i)
+    {
+        const uint32_t op = rnd.next(6), value = rnd.next();
+        if (op == 0 || (op < 4 && ref.empty()))
+        {
+            deque.pushFront(value);
+            ref.push_front(value);
+        }
+        else if (op == 1)
+        {
+            deque.pushBack(value);
+            ref.push_back(value);
+        }
+        else if (op == 2)
+        {
+            deque.popFront();
+            ref.pop_front();
+        }
+        else if (op == 3)
+        {
+            deque.popBack();
+            ref.pop_back();
+        }
+        if (!ref.empty())
+            ok = ok && (deque.front() == ref.front()) && (deque.back() == ref.back());
+    }
+    check(ok, allocname, "vdeque_ends");
+
+    check(deque.size() == ref.size(), allocname, "vdeque_size");
+    ok = true;
+    for (uint32_t i=0; i<ref.size(); ++i)
+        ok = ok && (deque.get(i) == ref[i]);
+    check(ok, allocname, "vdeque_data");
+}
+
+// Compares random operations on a VHashMap with std::map
+template <typename Alloc> void checkHashMap(const char *allocname)
+{
+    VHashMap<uint32_t, uint32_t, Alloc> map;
+    std::map<uint32_t, uint32_t> ref;
+    Random rnd;
+
+    for (uint32_t i=0; i<CONTAINER_OPERATIONS; ++i)
+    {
+        const uint32_t key = rnd.next(KEY_RANGE), value = rnd.next();
+        if (rnd.next(3) == 0)
+            check(map.remove(key) == (ref.erase(key) != 0), allocname, "vhashmap_remove");
+        else
+        {
+            check(map.set(key, value) == (ref.find(key) == ref.end()), allocname, "vhashmap_set");
+            ref[key] = value;
+        }
+    }
+
+    check(map.size() == ref.size(), allocname, "vhashmap_size");
+    bool ok = true;
+    for (uint32_t key=0; key<KEY_RANGE; ++key)
+    {
+        std::map<uint32_t, uint32_t>::const_iterator it = ref.find(key);
+        uint32_t value;
+        if (it == ref.end())
+            ok = ok && !map.contains(key) && !map.get(key, value);
+        else
+            ok = ok && map.get(key, value) && (value == it->second);
+    }
+    check(ok, allocname, "vhashmap_data");
+
+    map.clear();
+    check(map.empty(), allocname, "vhashmap_clear");
+}
+
+template <typename Alloc> void checkArrays(Alloc &valloc, const char *allocname)
+{
+    Counted::constructed = Counted::destructed = 0;
+    VPtr<Counted, Alloc> objects = valloc.template newArray<Counted>(ARRAY_ELEMENTS);
+    check(Counted::constructed == ARRAY_ELEMENTS, allocname, "newarray_construct");
+    bool ok = true;
+    for (uint32_t i=0; i<ARRAY_ELEMENTS; ++i)
+    {
+        const VPtrNum p = objects.getRawNum() + i * sizeof(Counted);
+        ok = ok && (*static_cast<const uint32_t *>(valloc.read(p, sizeof(uint32_t))) == Counted::MAGIC);
+    }
+    check(ok, allocname, "newarray_data");
+    valloc.deleteArray(objects);
+    check(Counted::destructed == ARRAY_ELEMENTS, allocname, "deletearray_destruct");
+
+    // trivial types are zero-filled
+    VPtr<uint32_t, Alloc> ints = valloc.template newArray<uint32_t>(ARRAY_ELEMENTS);
+    ok = true;
+    for (uint32_t i=0; i<ARRAY_ELEMENTS; ++i)
+        ok = ok && (ints[i] == 0U);
+    check(ok, allocname, "newarray_zero");
+    valloc.deleteArray(ints);
+
+    // all but one big page locked: the objects are constructed one at a time
+    const VPtrSize locksize = valloc.getBigPageSize();
+    const VPtrNum locked = valloc.allocRaw(locksize * valloc.getBigPageCount());
+    uint8_t locks = 0;
+    for (; locks < valloc.getBigPageCount() && valloc.getUnlockedBigPages() > 1; ++locks)
+    {
+        VirtPageSize size = locksize;
+        valloc.makeFittingLock(locked + locks * locksize, size);
+    }
+    Counted::constructed = Counted::destructed = 0;
+    objects = valloc.template newArray<Counted>(ARRAY_ELEMENTS);
+    ok = (Counted::constructed == ARRAY_ELEMENTS);
+    for (uint32_t i=0; i<ARRAY_ELEMENTS; ++i)
+    {
+        const VPtrNum p = objects.getRawNum() + i * sizeof(Counted);
+        ok = ok && (*static_cast<const uint32_t *>(valloc.read(p, sizeof(uint32_t))) == Counted::MAGIC);
+    }
+    valloc.deleteArray(objects);
+    check(ok && Counted::destructed == ARRAY_ELEMENTS, allocname, "newarray_locked");
+    while (locks)
+        valloc.releaseLock(locked + --locks * locksize);
+    valloc.freeRaw(locked);
+}
+
+template <typename Alloc> void checkMultiLock(Alloc &valloc, const char *allocname)
+{
+    typedef VPtr<char, Alloc> CharPtr;
+
+    CharPtr buf = valloc.template alloc<char>(LOCK_BUFFER_SIZE);
+    for (uint32_t i=0; i<LOCK_BUFFER_SIZE; ++i)
+        buf[i] = (char)(i * 7);
+
+    const uint32_t start = 100, size = LOCK_BUFFER_SIZE - 200;
+    VPtrSize locked;
+    {
+        VPtrMultiLock<CharPtr> lock(buf + start, size);
+        locked = lock.getLockSize();
+        check(locked > 0 && locked <= size, allocname, "multilock_size");
+
+        VPtrSize total = 0;
+        bool ok = true;
+        for (uint8_t s=0; s<lock.getSegmentCount(); ++s)
+        {
+            char *data = lock.getSegment(s);
+            for (VPtrSize i=0; i<lock.getSegmentSize(s); ++i, ++total)
+            {
+                ok = ok && (data[i] == (char)((start + total) * 7));
+                ++data[i];
+            }
+        }
+        check(total == locked, allocname, "multilock_segments");
+        check(ok, allocname, "multilock_data");
+
+        // contiguous data is accessible from the first segment, getData() handles all locks
+        ok = true;
+        for (VPtrSize i=0; i<locked; ++i)
+        {
+            VPtrSize left;
+            const char *data = lock.getData(i, left);
+            ok = ok && left > 0 && (*data == (char)((start + i) * 7 + 1));
+            if (lock.isContiguous())
+                ok = ok && (lock.getSegment(0)[i] == *data);
+        }
+        check(ok, allocname, "multilock_getdata");
+    }
+
+    bool ok = true;
+    for (uint32_t i=0; i<LOCK_BUFFER_SIZE; ++i)
+    {
+        const bool modified = (i >= start && i < (start + locked));
+        ok = ok && (buf[i] == (char)(i * 7 + (modified ? 1 : 0)));
+    }
+    check(ok, allocname, "multilock_write");
+
+    // nothing can be locked if no locks share the pages or if all big pages are locked
+    if (valloc.getMaxMultiLockSize(4) < valloc.getPoolSize()) // not accessed directly
+    {
+        check(valloc.getMaxMultiLockSize(4, 0) == 0, allocname, "multilock_max_nolocks");
+        const VPtrSize pagesize = valloc.getBigPageSize();
+        uint8_t locks = 0;
+        for (; locks < valloc.getBigPageCount() && valloc.getUnlockedBigPages() > 0; ++locks)
+        {
+            VirtPageSize size = pagesize;
+            valloc.makeFittingLock(buf.getRawNum() + locks * pagesize, size);
+        }
+        check(valloc.getMaxMultiLockSize(4) == 0, allocname, "multilock_max_locked");
+
+        // memset() and memcpy() still work with the locked data
+        memset(buf, 1, pagesize);
+        memcpy(buf + pagesize, buf, pagesize);
+        while (locks)
+            valloc.releaseLock(buf.getRawNum() + --locks * pagesize);
+        ok = true;
+        for (uint32_t i=0; i<pagesize * 2; ++i)
+            ok = ok && (buf[i] == (char)1);
+        check(ok, allocname, "multilock_locked_copy");
+    }
+
+    valloc.free(buf);
+}
+
+// Compares random reads, writes, prefetches and clears with a copy of the data in RAM. Overlapping
+// pages are detected by the allocator (with assert) when they are loaded.
+template <typename Alloc> void checkShadow(Alloc &valloc, const char *allocname)
+{
+    std::vector<uint8_t> ref(SHADOW_SIZE), data(SHADOW_SIZE);
+    const VPtrNum block = valloc.allocRaw(SHADOW_SIZE);
+    for (uint32_t i=0; i<SHADOW_SIZE; ++i)
+        ref[i] = (uint8_t)(i * 13);
+    valloc.writeBulk(&ref[0], block, SHADOW_SIZE);
+
+    Random rnd;
+    bool ok = true;
+    for (uint32_t i=0; i<CONTAINER_OPERATIONS; ++i)
+    {
+        const uint32_t op = rnd.next(9);
+        // mostly small accesses, some are larger than a big page
+        const VPtrSize size = 1 + ((op & 1) ? rnd.next(valloc.getBigPageSize()) : rnd.next(48));
+        const VPtrNum offset = rnd.next(SHADOW_SIZE - size);
+        if (op < 2)
+            ok = ok && (std::memcmp(valloc.read(block + offset, size), &ref[offset], size) == 0);
+        else if (op < 4)
+        {
+            for (VPtrSize j=0; j<size; ++j)
+                ref[offset + j] = (uint8_t)rnd.next();
+            valloc.write(block + offset, &ref[offset], size);
+        }
+        else if (op == 4)
+            valloc.prefetch(block + offset, size * 4);
+        else if (op == 5)
+        {
+            // sequential access, which triggers read ahead
+            VPtr<uint8_t, Alloc> p;
+            p.setRawNum(block + offset);
+            for (VPtrSize j=0; j<size * 4 && (offset + j) < SHADOW_SIZE; ++j)
+                ok = ok && (p[j] == ref[offset + j]);
+        }
+        else if (op == 6)
+        {
+            valloc.readBulk(&data[0], block + offset, size);
+            ok = ok && (std::memcmp(&data[0], &ref[offset], size) == 0);
+        }
+        else if (op == 7)
+        {
+            // spans multiple (aligned) pages
+            const VPtrSize zsize = std::min((VPtrSize)(size * 4), (VPtrSize)(SHADOW_SIZE - offset));
+            std::fill(ref.begin() + offset, ref.begin() + offset + zsize, 0);
+            valloc.zeroRaw(block + offset, zsize);
+        }
+        else
+        {
+            VPtrLock<VPtr<uint8_t, Alloc> > lock;
+            VPtr<uint8_t, Alloc> p;
+            p.setRawNum(block + offset);
+            lock.lock(p, size, true);
+            ok = ok && (!*lock || std::memcmp(*lock, &ref[offset], lock.getLockSize()) == 0);
+        }
+    }
+    check(ok, allocname, "shadow_access");
+
+    valloc.readBulk(&data[0], block, SHADOW_SIZE);
+    check(data == ref, allocname, "shadow_data");
+    valloc.freeRaw(block);
+}
+
+// Checks that data which was never written reads as zero, also if data after it was written. The
+// storage medium of the allocator should be filled with non-zero data.
+template <typename Alloc> void checkUnwritten(Alloc &valloc, const char *allocname)
+{
+    valloc.start();
+    const VPtrSize size = valloc.getBigPageSize() * 8;
+    const VPtrNum first = valloc.allocRaw(size), second = valloc.allocRaw(size);
+    const uint8_t data[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    valloc.write(second + size - sizeof(data), data, sizeof(data));
+    valloc.clearPages(); // writes the data, and makes sure that everything below is read again
+
+    std::vector<uint8_t> buf(size);
+    valloc.readBulk(&buf[0], first, size);
+    bool ok = (std::count(buf.begin(), buf.end(), 0) == (long)size);
+    check(ok, allocname, "unwritten_bulk");
+    ok = true;
+    for (VPtrSize i=0; i<(size - sizeof(data)); ++i)
+        ok = ok && (*static_cast<const uint8_t *>(valloc.read(second + i, 1)) == 0);
+    ok = ok && (std::memcmp(valloc.read(second + size - sizeof(data), sizeof(data)), data, sizeof(data)) == 0);
+    check(ok, allocname, "unwritten_pages");
+
+    valloc.freeRaw(first);
+    valloc.freeRaw(second);
+    valloc.stop();
+}
+
+template <typename Alloc> void runChecks(Alloc &valloc, const char *allocname)
+{
+    valloc.start();
+    checkVector<Alloc>(allocname);
+    checkDeque<Alloc>(allocname);
+    checkHashMap<Alloc>(allocname);
+    checkArrays(valloc, allocname);
+    checkMultiLock(valloc, allocname);
+    checkShadow(valloc, allocname);
+    valloc.stop();
+}
+
+// Accesses data of a thread with the regular VPtr operations, and increments a counter that is shared
+// by all threads (see checkThreads())
+template <typename Alloc> void accessThreadData(uint32_t seed, VPtr<uint32_t, Alloc> counter, bool *result)
+{
+    typedef VPtr<ThreadItem, Alloc> ItemPtr;
+
+    ItemPtr items = Alloc::getInstance()->template alloc<ThreadItem>(THREAD_ITEMS * sizeof(ThreadItem));
+    std::vector<ThreadItem> ref(THREAD_ITEMS), buf(THREAD_ITEMS);
+    for (uint32_t i=0; i<THREAD_ITEMS; ++i)
+    {
+        ref[i].id = seed; ref[i].value = i;
+        items[i] = ref[i];
+    }
+
+    Random rnd(seed);
+    bool ok = true;
+    for (uint32_t i=0; i<THREAD_OPERATIONS; ++i)
+    {
+        const uint32_t op = rnd.next(4), index = rnd.next(THREAD_ITEMS);
+        if (op == 0)
+        {
+            ref[index].value = rnd.next();
+            (items + index)->value = ref[index].value;
+        }
+        else if (op == 1)
+            ok = ok && ((items + index)->id == seed) && ((items + index)->value == ref[index].value);
+        else if (op == 2)
+        {
+            VPtrLock<ItemPtr> lock(items + index, (THREAD_ITEMS - index) * sizeof(ThreadItem), true);
+            ok = ok && *lock && (std::memcmp(*lock, &ref[index], lock.getLockSize()) == 0);
+        }
+        else
+        {
+            memcpy(&buf[0], items, THREAD_ITEMS * sizeof(ThreadItem));
+            ok = ok && (std::memcmp(&buf[0], &ref[0], THREAD_ITEMS * sizeof(ThreadItem)) == 0);
+        }
+        (*counter)++;
+    }
+
+    Alloc::getInstance()->free(items);
+    *result = ok;
+}
+
+// Checks that the regular VPtr operations are safe if the allocator is used by multiple threads
+// (see BaseMutex)
+template <typename Alloc> void checkThreads(Alloc &valloc, const char *allocname)
+{
+    valloc.start();
+    VPtr<uint32_t, Alloc> counter = valloc.template alloc<uint32_t>();
+    *counter = 0;
+
+    std::vector<std::thread> threads;
+    bool results[THREADS];
+    for (uint32_t i=0; i<THREADS; ++i)
+        threads.push_back(std::thread(accessThreadData<Alloc>, i + 1, counter, &results[i]));
+    for (uint32_t i=0; i<THREADS; ++i)
+        threads[i].join();
+
+    check(std::count(results, results + THREADS, true) == (long)THREADS, allocname, "threads_data");
+    check(*counter == THREADS * THREAD_OPERATIONS, allocname, "threads_counter");
+    valloc.free(counter);
+    valloc.stop();
+}
+
+// Checks that data and the root pointer are restored after restarting a persistent allocator
+template <typename Alloc> void checkPersistence(Alloc &valloc, const char *allocname)
+{
+    valloc.setPersistent(true);
+    valloc.start();
+    VPtr<uint32_t, Alloc> data = valloc.template alloc<uint32_t>(ARRAY_ELEMENTS);
+    for (uint32_t i=0; i<ARRAY_ELEMENTS; ++i)
+        data[i] = i * 3;
+    valloc.setRoot(data);
+    valloc.stop();
+
+    valloc.start();
+    check(valloc.hasRestoredState(), allocname, "persistent_restore");
+    check(valloc.template getRoot<uint32_t>() == data, allocname, "persistent_root");
+    bool ok = true;
+    for (uint32_t i=0; i<ARRAY_ELEMENTS; ++i)
+        ok = ok && (data[i] == i * 3);
+    check(ok, allocname, "persistent_data");
+    // freed memory must be available to later allocations
+    check(valloc.template alloc<char>(64) != 0, allocname, "persistent_alloc");
+    valloc.free(data);
+    valloc.stop();
+}
+
+}
+
+int main()
+{
+    {
+        AllocInstance<StdioVAllocP<CheckGeometry> > stdioalloc(POOL_SIZE);
+        runChecks(*stdioalloc, "stdio");
+    }
+    {
+        AllocInstance<LatencyVAllocP<AsyncCheckGeometry> > latency(POOL_SIZE);
+        latency->setAsync(true);
+        runChecks(*latency, "latency_async");
+        check(latency->getAsyncReads() > 0 && latency->getAsyncWrites() > 0, "latency_async", "async_transfers");
+        checkPersistence(*latency, "latency_async");
+    }
+    {
+        AllocInstance<StdioVAllocP<ThreadCheckGeometry> > stdioalloc(POOL_SIZE);
+        checkThreads(*stdioalloc, "stdio_threads");
+    }
+    {
+        AllocInstance<LatencyVAllocP<CheckGeometry> > latency(POOL_SIZE);
+        latency->setInitialValue(0xa5);
+        checkUnwritten(*latency, "latency_filled");
+    }
+    {
+        AllocInstance<LatencyVAllocP<AsyncCheckGeometry> > latency(POOL_SIZE);
+        latency->setAsync(true);
+        latency->setInitialValue(0xa5);
+        checkUnwritten(*latency, "latency_async_filled");
+    }
+    {
+        AllocInstance<LatencyVAllocP<AlignedCheckGeometry<LRUPagePolicy> > > latency(POOL_SIZE);
+        latency->setAsync(true);
+        runChecks(*latency, "aligned_lru");
+    }
+    {
+        AllocInstance<LatencyVAllocP<AlignedCheckGeometry<TwoQueuePagePolicy> > > latency(POOL_SIZE);
+        runChecks(*latency, "aligned_2q");
+    }
+    {
+        AllocInstance<CompressedVAllocP<StaticVAllocP<POOL_SIZE, TierAllocProperties>, POOL_SIZE, POOL_SIZE / 512, 512, CheckGeometry> > compressed;
+        runChecks(*compressed, "compressed");
+    }
+    {
+        typedef TieredVAllocP<StaticVAllocP<POOL_SIZE / 8, TierAllocProperties>, StdioVAllocP<TierAllocProperties>, 512, POOL_SIZE / 8 / 512, CheckGeometry> Tiered;
+        AllocInstance<Tiered> tiered(POOL_SIZE);
+        runChecks(*tiered, "tiered");
+    }
+    {
+        // data is only partially written to the slow tier
+        typedef TieredVAllocP<StaticVAllocP<POOL_SIZE / 8, TierAllocProperties>, LatencyVAllocP<TierAllocProperties>, 512, POOL_SIZE / 8 / 512, CheckGeometry> Tiered;
+        AllocInstance<Tiered> tiered(POOL_SIZE);
+        tiered->getSlowTier().setInitialValue(0xa5);
+        checkUnwritten(*tiered, "tiered_filled");
+    }
+    {
+        AllocInstance<StaticVAllocP<POOL_SIZE, CheckGeometry> > staticalloc;
+        runChecks(*staticalloc, "static");
+    }
+#ifdef HAVE_MMAP_ALLOC
+    {
+        std::remove(POOL_FILE);
+        AllocInstance<MmapVAllocP<CheckGeometry> > mmapalloc(POOL_SIZE, POOL_FILE);
+        runChecks(*mmapalloc, "mmap");
+        checkPersistence(*mmapalloc, "mmap");
+    }
+    std::remove(POOL_FILE);
+#endif
+
+    if (!failed)
+        std::printf("all checks passed\n");
+    return failed ? 1 : 0;
+}
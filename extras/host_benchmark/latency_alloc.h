@@ -0,0 +1,187 @@
+#ifndef VIRTMEM_LATENCY_ALLOC_H
+#define VIRTMEM_LATENCY_ALLOC_H
+
+// Host allocator that simulates a slow storage medium with asynchronous transfers, see README.md
+
+#include "internal/alloc.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace virtmem {
+
+/**
+ * @brief Virtual memory allocator that simulates a slow storage medium, such as an SD card or
+ * SPI RAM accessed by DMA.
+ *
+ * The memory pool is kept in RAM, and like a non-volatile medium its contents are retained when
+ * the allocator is stopped (unless the pool size changes), so that persistent mode (see
+ * BaseVAlloc::setPersistent()) can be used. Every transfer takes a fixed latency plus a time that
+ * depends on the transfer size. Synchronous transfers (doRead() and doWrite()) busy wait during
+ * this time. If asynchronous transfers are enabled (see setAsync()), doReadAsync() and
+ * doWriteAsync() start a transfer that finishes after the same time, while the allocator
+ * continues. The data is only copied when doPollRead() or doPollWrite() reports that the
+ * transfer has finished, so any data that is accessed too early (or modified while it is written)
+ * is wrong. A read and a write may be in progress at the same time, like with separate DMA
+ * channels.
+ *
+ * The allocator also checks that BaseVAlloc keeps to the rules for asynchronous transfers (see
+ * BaseVAlloc::doReadAsync()), with `assert`.
+ *
+ * @tparam Properties Allocator properties, see DefaultAllocProperties
+ */
+template <typename Properties = DefaultAllocProperties>
+class LatencyVAllocP : public VAlloc<Properties, LatencyVAllocP<Properties> >
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Transfer
+    {
+        uint8_t *data;
+        VPtrNum offset;
+        VPtrSize size;
+        Clock::time_point done;
+        bool pending;
+
+        Transfer(void) : data(0), offset(0), size(0), pending(false) { }
+    };
+
+    std::vector<uint8_t> storage, writeCopy;
+    uint32_t latency, bytesPerUsec;
+    bool async;
+    uint8_t initialValue;
+    Transfer readTransfer, writeTransfer;
+    uint32_t asyncReads, asyncWrites;
+
+    Clock::time_point getDoneTime(VPtrSize size) const
+    { return Clock::now() + std::chrono::microseconds(latency + size / bytesPerUsec); }
+
+    static void waitUntil(Clock::time_point t)
+    {
+        while (Clock::now() < t)
+            ;
+    }
+
+    void checkIdle(void) const { assert(!readTransfer.pending); }
+    // data that is being written may not be accessed
+    void checkWriteOverlap(VPtrNum offset, VPtrSize size) const
+    {
+        assert(!writeTransfer.pending || offset >= (writeTransfer.offset + writeTransfer.size) ||
+               writeTransfer.offset >= (offset + size));
+        (void)offset; (void)size;
+    }
+
+    void doStart(void)
+    {
+        if (storage.size() != this->getPoolSize())
+            storage.assign(this->getPoolSize(), initialValue);
+        readTransfer = writeTransfer = Transfer();
+        asyncReads = asyncWrites = 0;
+    }
+
+    void doStop(void) { checkIdle(); assert(!writeTransfer.pending); }
+
+    void doRead(void *data, VPtrSize offset, VPtrSize size)
+    {
+        checkIdle();
+        checkWriteOverlap(offset, size);
+        waitUntil(getDoneTime(size));
+        std::memcpy(data, &storage[offset], size);
+    }
+
+    void doWrite(const void *data, VPtrSize offset, VPtrSize size)
+    {
+        checkIdle();
+        checkWriteOverlap(offset, size);
+        waitUntil(getDoneTime(size));
+        std::memcpy(&storage[offset], data, size);
+    }
+
+    bool doReadAsync(void *data, VPtrSize offset, VPtrSize size)
+    {
+        checkIdle();
+        checkWriteOverlap(offset, size);
+        if (!async)
+            return false;
+
+        readTransfer.data = static_cast<uint8_t *>(data);
+        readTransfer.offset = offset;
+        readTransfer.size = size;
+        readTransfer.done = getDoneTime(size);
+        readTransfer.pending = true;
+        ++asyncReads;
+        return true;
+    }
+
+    bool doPollRead(void)
+    {
+        assert(readTransfer.pending);
+        if (Clock::now() < readTransfer.done)
+            return false;
+        std::memcpy(readTransfer.data, &storage[readTransfer.offset], readTransfer.size);
+        readTransfer.pending = false;
+        return true;
+    }
+
+    bool doWriteAsync(const void *data, VPtrSize offset, VPtrSize size)
+    {
+        checkIdle();
+        assert(!writeTransfer.pending);
+        if (!async)
+            return false;
+
+        // NOTE: the data must remain unchanged until the write has finished: the copy is only used
+        // to verify this
+        writeCopy.assign(static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + size);
+        writeTransfer.data = const_cast<uint8_t *>(static_cast<const uint8_t *>(data));
+        writeTransfer.offset = offset;
+        writeTransfer.size = size;
+        writeTransfer.done = getDoneTime(size);
+        writeTransfer.pending = true;
+        ++asyncWrites;
+        return true;
+    }
+
+    bool doPollWrite(void)
+    {
+        checkIdle();
+        assert(writeTransfer.pending);
+        if (Clock::now() < writeTransfer.done)
+            return false;
+        assert(std::memcmp(writeTransfer.data, &writeCopy[0], writeTransfer.size) == 0);
+        std::memcpy(&storage[writeTransfer.offset], writeTransfer.data, writeTransfer.size);
+        writeTransfer.pending = false;
+        return true;
+    }
+
+public:
+    /**
+     * @brief Constructs (but not initializes) the allocator.
+     * @param ps Total amount of bytes of the memory pool.
+     * @param l Latency of every transfer, in microseconds.
+     * @param b Transfer speed, in bytes per microsecond (i.e. MB/s).
+     */
+    LatencyVAllocP(VPtrSize ps=VIRTMEM_DEFAULT_POOLSIZE, uint32_t l=5, uint32_t b=200) :
+        latency(l), bytesPerUsec(b), async(false), initialValue(0), asyncReads(0), asyncWrites(0) { this->setPoolSize(ps); }
+    ~LatencyVAllocP(void) { }
+
+    //! Enables or disables asynchronous transfers. Should only be called if the allocator is not initialized.
+    void setAsync(bool a) { async = a; }
+    /**
+     * @brief Sets the value of all bytes of the medium when it is created by start() (default: `0`).
+     *
+     * A non-zero value can be used to check that data which was never written reads as zero.
+     * Should only be called if the allocator is not initialized.
+     */
+    void setInitialValue(uint8_t v) { initialValue = v; }
+    //! Returns the amount of asynchronous reads since start().
+    uint32_t getAsyncReads(void) const { return asyncReads; }
+    //! Returns the amount of asynchronous writes since start().
+    uint32_t getAsyncWrites(void) const { return asyncWrites; }
+};
+
+}
+
+#endif // VIRTMEM_LATENCY_ALLOC_H
@@ -6,12 +6,16 @@ import threading
 import time
 
 class Commands:
-    init, initPool, read, write, inputAvailable, inputRequest, inputPeek, ping = range(0, 8)
+    init, initPool, read, write, inputAvailable, inputRequest, inputPeek, ping, readV, writeV, compression = range(0, 11)
+
+class Encodings:
+    raw, packBits = range(0, 2)
 
 class State:
     initialized = False
     processState = 'idle'
     initValue, memoryPool = None, None
+    compression = False
     inputData = bytearray()
     inputLock = threading.Lock()
     doQuit = False
@@ -34,6 +38,49 @@ def readInt():
 def writeInt(i):
     serInterface.write(struct.pack('i', i))
 
+# PackBits run-length encoding, see writePackBits() in serial_utils.hpp
+def packBits(data):
+    ret = bytearray()
+    i, size = 0, len(data)
+    while i < size:
+        run = 1
+        while i + run < size and run < 128 and data[i + run] == data[i]:
+            run += 1
+        if run >= 3:
+            ret.append(257 - run)
+            ret.append(data[i])
+            i += run
+        else:
+            start = i
+            while i < size and i - start < 128 and not (i + 2 < size and data[i] == data[i + 1] == data[i + 2]):
+                i += 1
+            ret.append(i - start - 1)
+            ret += data[start:i]
+    return ret
+
+def readPackBits(size):
+    ret = bytearray()
+    while len(ret) < size:
+        h = blockedRead(1)[0]
+        if h < 128:
+            ret += blockedRead(h + 1)
+        elif h > 128:
+            ret += blockedRead(1) * (257 - h)
+    return ret
+
+def readPayload(size):
+    if State.compression and blockedRead(1)[0] == Encodings.packBits:
+        return readPackBits(size)
+    return blockedRead(size)
+
+def encodePayload(data):
+    if State.compression:
+        packed = packBits(data)
+        if len(packed) < len(data):
+            return bytes([Encodings.packBits]) + packed
+        return bytes([Encodings.raw]) + data
+    return data
+
 def sendCommand(cmd):
     serInterface.write(bytes([State.initValue]))
     serInterface.write(bytes([cmd]))
@@ -62,12 +109,18 @@ def handleCommand(command):
     elif command == Commands.init:
         State.initialized = True
         State.memoryPool = None # remove pool
+        State.compression = False
         sendCommand(Commands.init) # reply
     elif not State.initialized:
         pass
     elif command == Commands.initPool:
         State.memoryPool = bytearray(readInt())
         print("set memory pool:", len(State.memoryPool), flush=True)
+    elif command == Commands.compression:
+        State.compression = blockedRead(1)[0] == Encodings.packBits
+        sendCommand(Commands.compression)
+        serInterface.write(bytes([Encodings.packBits if State.compression else Encodings.raw]))
+        print("compression:", "enabled" if State.compression else "disabled", flush=True)
     elif command == Commands.inputAvailable:
         with State.inputLock:
             writeInt(len(State.inputData))
@@ -90,14 +143,21 @@ def handleCommand(command):
         print("WARNING: tried to read/write unitialized memory pool")
     elif command == Commands.read:
         index, size = readInt(), readInt()
-        serInterface.write(State.memoryPool[index:size+index])
+        serInterface.write(encodePayload(State.memoryPool[index:size+index]))
 #        print("read memPool: ", State.memoryPool[index:size+index])
 #        print("read memPool: ", index, size)
     elif command == Commands.write:
         index, size = readInt(), readInt()
-        State.memoryPool[index:size+index] = blockedRead(size)
+        State.memoryPool[index:size+index] = readPayload(size)
 #        print("write memPool: ", State.memoryPool)
 #        print("write memPool: ", index, size)
+    elif command == Commands.readV:
+        blocks = [ (readInt(), readInt()) for i in range(readInt()) ]
+        serInterface.write(b''.join(encodePayload(State.memoryPool[index:size+index]) for index, size in blocks))
+    elif command == Commands.writeV:
+        for i in range(readInt()):
+            index, size = readInt(), readInt()
+            State.memoryPool[index:size+index] = readPayload(size)
 
 def ensureConnection():
     print("Waiting until port {} can be opened...\n".format(serInterface.port))
@@ -0,0 +1,504 @@
+#!/usr/bin/env python3
+
+# Records and analyzes virtual memory access traces (see BaseAccessTracer in access_trace.h), and
+# recommends page settings for allocator properties (see DefaultAllocProperties).
+
+import argparse
+import collections
+import struct
+import sys
+
+# --- trace format ---
+
+class Events:
+    start, read, write, modify, readBulk, writeBulk, lock, lockRO, unlock, flush, clear, stop = range(0, 12)
+
+RECORD_SIZE = 7
+Record = collections.namedtuple('Record', 'event address size')
+
+def readTrace(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) % RECORD_SIZE:
+        print('Warning: trace is truncated ({} trailing bytes)'.format(len(data) % RECORD_SIZE), file=sys.stderr)
+    return [ Record(*struct.unpack_from('<BIH', data, i)) for i in range(0, len(data) - RECORD_SIZE + 1, RECORD_SIZE) ]
+
+# --- page replacement policies, see page_policy.h ---
+
+class LRUPolicy:
+    def __init__(self, count): self.order = [] # most recently used first
+    def added(self, i): self.order.insert(0, i)
+    def removed(self, i): self.order.remove(i)
+    def accessed(self, i):
+        if i in self.order:
+            self.order.remove(i)
+            self.order.insert(0, i)
+    def victim(self): return self.order[-1]
+
+class ClockPolicy:
+    def __init__(self, count):
+        self.count, self.hand = count, 0
+        self.loaded, self.referenced = [ False ] * count, [ False ] * count
+    def added(self, i): self.loaded[i] = self.referenced[i] = True
+    def removed(self, i): self.loaded[i] = self.referenced[i] = False
+    def accessed(self, i): self.referenced[i] = self.loaded[i]
+    def victim(self):
+        for n in range(self.count * 2):
+            cur = self.hand
+            self.hand = (self.hand + 1) % self.count
+            if self.loaded[cur]:
+                if not self.referenced[cur]:
+                    return cur
+                self.referenced[cur] = False
+        return None
+
+class TwoQueuePolicy:
+    def __init__(self, count):
+        self.minIn = max(count // 4, 1)
+        self.inQueue, self.mainQueue = [], [] # newest/most recently used first
+        self.last = None
+    def added(self, i):
+        self.inQueue.insert(0, i)
+        self.last = i
+    def removed(self, i):
+        if i in self.inQueue: self.inQueue.remove(i)
+        elif i in self.mainQueue: self.mainQueue.remove(i)
+    def accessed(self, i):
+        if i == self.last or (i not in self.inQueue and i not in self.mainQueue):
+            return
+        self.last = i
+        self.removed(i)
+        self.mainQueue.insert(0, i)
+    def victim(self):
+        if len(self.inQueue) > self.minIn or not self.mainQueue:
+            return self.inQueue[-1]
+        return self.mainQueue[-1]
+
+Policies = { 'lru' : LRUPolicy, 'clock' : ClockPolicy, '2q' : TwoQueuePolicy }
+PolicyTypes = { 'default' : 'DefaultPagePolicy', 'lru' : 'LRUPagePolicy', 'clock' : 'ClockPagePolicy', '2q' : 'TwoQueuePagePolicy' }
+
+# --- simulation ---
+
+START_OFFSET = 16 # first usable address (sizeof(TAlign), smaller on 8 bit platforms), see BaseVAlloc
+MAX_CLEAN_SKIPS = 5 # see PAGE_MAX_CLEAN_SKIPS in BaseVAlloc
+
+class Page:
+    def __init__(self):
+        self.start, self.size, self.dirty, self.cleanSkips, self.locks = None, 0, False, 0, 0
+
+    def contains(self, address, size):
+        return self.start is not None and address >= self.start and (address + size) <= (self.start + self.size)
+
+    def overlaps(self, start, end):
+        return self.start is not None and start < (self.start + self.size) and end > self.start
+
+# A simplified model of the big pages of BaseVAlloc, which counts the bytes transferred to and from
+# the backend. Dirty block tracking, read ahead and small/medium lock pages (which copy their data
+# from big pages) are not modelled.
+class BigPageModel:
+    def __init__(self, count, size, policy, align):
+        self.count, self.size, self.align = count, size, align
+        self.policyName = policy
+        self.reset(0)
+
+    def reset(self, poolSize):
+        self.poolSize = poolSize
+        self.pages = [ Page() for i in range(self.count) ]
+        self.policy = Policies[self.policyName](self.count) if self.policyName != 'default' else None
+        self.nextToSwap = 0
+        self.writtenEnd = 0
+        self.locked = {} # start address -> page index of locked big pages
+        self.unlocked = list(range(self.count))
+        self.bytesRead = self.bytesWritten = self.pageLoads = 0
+
+    def readBackend(self, start, size):
+        # data that was never written is zero and not read, see BaseVAlloc::zeroUnwritten()
+        if start < self.writtenEnd:
+            self.bytesRead += min(size, self.writtenEnd - start)
+
+    def writeBackend(self, start, size):
+        self.bytesWritten += size
+        self.writtenEnd = max(self.writtenEnd, start + size)
+
+    def pageSize(self, page):
+        return min(page.size, max(self.poolSize - page.start, 0)) if self.poolSize else page.size
+
+    def sync(self, page):
+        if page.dirty:
+            self.writeBackend(page.start, self.pageSize(page))
+            page.dirty = False
+            page.cleanSkips = 0
+
+    def invalidate(self, index):
+        page = self.pages[index]
+        self.sync(page)
+        page.start = None
+        if self.policy:
+            self.policy.removed(index)
+
+    def usable(self):
+        return self.unlocked
+
+    def findPage(self, address, size):
+        for i in self.usable():
+            if self.pages[i].contains(address, size):
+                return i
+        return None
+
+    def pageRange(self, address, size, forceStart):
+        if self.align and not forceStart:
+            start, psize = address - (address % self.size), self.size
+            if start == 0:
+                start, psize = START_OFFSET, self.size - START_OFFSET
+            if (address + size) <= (start + psize):
+                return start, psize
+        return address, self.size
+
+    def selectPage(self):
+        state, ret = None, None
+        for i in self.usable():
+            page = self.pages[i]
+            if page.start is None:
+                return i
+            if self.policy or state == 'clean':
+                continue
+            page.cleanSkips += 1 if page.dirty else 0
+            if not page.dirty or page.cleanSkips >= MAX_CLEAN_SKIPS:
+                state, ret = 'clean', i
+            elif state is None and i == self.nextToSwap:
+                state, ret = 'dirty', i
+
+        if ret is None:
+            if self.policy:
+                return self.policy.victim()
+            ret = self.nextToSwap if self.nextToSwap in self.usable() else self.usable()[0]
+            state = 'dirty'
+        usable = self.usable()
+        self.nextToSwap = usable[(usable.index(ret) + 1) % len(usable)] if state == 'dirty' else usable[0]
+        return ret
+
+    # Returns the page index that contains the data
+    def access(self, address, size, write, forceStart=False):
+        if size > self.size:
+            # doesn't fit in a page: transferred directly (see readBulk() and writeBulk())
+            if write: self.writeBackend(address, size)
+            else: self.readBackend(address, size)
+            return None
+
+        index = self.findPage(address, size)
+        if index is not None:
+            if self.policy:
+                self.policy.accessed(index)
+        else:
+            start, psize = self.pageRange(address, size, forceStart)
+            for i in self.usable():
+                if self.pages[i].overlaps(start, start + psize):
+                    self.invalidate(i)
+            index = self.selectPage()
+            if self.pages[index].start is not None:
+                self.invalidate(index)
+            page = self.pages[index]
+            page.start, page.size = start, psize
+            self.pageLoads += 1
+            # pages that are completely overwritten are not read
+            if not (write and address <= start and (address + size) >= (start + self.pageSize(page))):
+                self.readBackend(start, self.pageSize(page))
+            if self.policy:
+                self.policy.added(index)
+
+        if write:
+            self.pages[index].dirty = True
+        return index
+
+    def lock(self, address, size, readOnly, lockClass):
+        if lockClass != 'big':
+            # small and medium locks copy their data from big pages
+            self.access(address, size, False)
+            return
+        index = self.locked.get(address)
+        if index is None:
+            if len(self.usable()) < 2:
+                return # no big page left: the real allocator would fail
+            index = self.access(address, size, False, True)
+            if index is None:
+                return
+            if self.policy:
+                self.policy.removed(index)
+            self.locked[address] = index
+        page = self.pages[index]
+        if page.locks == 0:
+            self.unlocked.remove(index)
+        page.locks += 1
+        page.dirty = page.dirty or not readOnly
+
+    def unlock(self, address, size, readOnly, lockClass):
+        if lockClass != 'big':
+            if not readOnly:
+                self.access(address, size, True)
+            return
+        index = self.locked.get(address)
+        if index is None:
+            return
+        page = self.pages[index]
+        page.locks -= 1
+        if page.locks == 0:
+            del self.locked[address]
+            self.unlocked.append(index)
+            self.unlocked.sort()
+            if self.policy:
+                self.policy.added(index)
+
+    def flush(self):
+        for page in self.pages:
+            if page.start is not None:
+                self.sync(page)
+
+    def clear(self):
+        for i in self.usable():
+            if self.pages[i].start is not None:
+                self.invalidate(i)
+
+# Assigns locks to page classes, like BaseVAlloc::makeDataLock(): the smallest class that fits
+# and has a free page is used.
+class LockModel:
+    def __init__(self, smallSize, mediumSize, smallCount, mediumCount):
+        self.sizes = { 'small' : smallSize, 'medium' : mediumSize }
+        self.free = { 'small' : smallCount, 'medium' : mediumCount }
+        self.active = {} # address -> [ class, size, readonly, count ]
+
+    def lock(self, address, size, readOnly):
+        if address in self.active:
+            entry = self.active[address]
+            entry[3] += 1
+            entry[2] = entry[2] and readOnly
+            return None
+        for cls in ('small', 'medium'):
+            if size <= self.sizes[cls] and self.free[cls] > 0:
+                self.free[cls] -= 1
+                break
+        else:
+            cls = 'big'
+        self.active[address] = [ cls, size, readOnly, 1 ]
+        return cls
+
+    def unlock(self, address):
+        entry = self.active.get(address)
+        if entry is None:
+            return None
+        entry[3] -= 1
+        if entry[3] > 0:
+            return None
+        del self.active[address]
+        if entry[0] != 'big':
+            self.free[entry[0]] += 1
+        return entry
+
+def simulate(trace, small, medium, big, policy, align):
+    model = BigPageModel(big[0], big[1], policy, align)
+    locks = LockModel(small[1], medium[1], small[0], medium[0])
+    for rec in trace:
+        e = rec.event
+        if e == Events.start:
+            model.reset(rec.address)
+            locks = LockModel(small[1], medium[1], small[0], medium[0])
+        elif e in (Events.read, Events.readBulk):
+            model.access(rec.address, rec.size, False)
+        elif e in (Events.write, Events.modify, Events.writeBulk):
+            model.access(rec.address, rec.size, True)
+        elif e in (Events.lock, Events.lockRO):
+            cls = locks.lock(rec.address, rec.size, e == Events.lockRO)
+            if cls:
+                model.lock(rec.address, rec.size, e == Events.lockRO, cls)
+        elif e == Events.unlock:
+            entry = locks.unlock(rec.address)
+            if entry:
+                model.unlock(rec.address, entry[1], entry[2], entry[0])
+        elif e in (Events.flush, Events.stop):
+            model.flush()
+        elif e == Events.clear:
+            model.clear()
+    return model
+
+# --- analysis ---
+
+def lockStats(trace):
+    # returns all lock sizes and, for every lock size, the peak amount of concurrent locks that size
+    active, sizes, peaks = {}, [], collections.Counter()
+    for rec in trace:
+        if rec.event == Events.start:
+            active = {}
+        elif rec.event in (Events.lock, Events.lockRO):
+            if rec.address in active:
+                active[rec.address][1] += 1
+            else:
+                active[rec.address] = [ rec.size, 1 ]
+                sizes.append(rec.size)
+                current = collections.Counter(s for s, c in active.values())
+                for s, c in current.items():
+                    peaks[s] = max(peaks[s], c)
+        elif rec.event == Events.unlock and rec.address in active:
+            active[rec.address][1] -= 1
+            if active[rec.address][1] == 0:
+                del active[rec.address]
+    return sizes, peaks
+
+def peakConcurrent(trace, low, high):
+    # peak amount of simultaneous locks with a size in (low, high]
+    active, cur, peak = {}, 0, 0
+    for rec in trace:
+        if rec.event == Events.start:
+            active, cur = {}, 0
+        elif rec.event in (Events.lock, Events.lockRO):
+            if rec.address in active:
+                active[rec.address][1] += 1
+            else:
+                active[rec.address] = [ rec.size, 1 ]
+                if low < rec.size <= high:
+                    cur += 1
+                    peak = max(peak, cur)
+        elif rec.event == Events.unlock and rec.address in active:
+            active[rec.address][1] -= 1
+            if active[rec.address][1] == 0:
+                if low < active[rec.address][0] <= high:
+                    cur -= 1
+                del active[rec.address]
+    return peak
+
+def powersOfTwo(low, high):
+    v = low
+    while v <= high:
+        yield v
+        v *= 2
+
+def chooseLockPages(trace, budget):
+    # The smallest (in RAM) small/medium configuration that can hold all simultaneous locks
+    best = None
+    for ssize in powersOfTwo(8, 128):
+        for msize in powersOfTwo(ssize * 2, 1024):
+            scount = max(1, peakConcurrent(trace, 0, ssize))
+            mcount = max(1, peakConcurrent(trace, ssize, msize))
+            if scount > 255 or mcount > 255:
+                continue
+            ram = ssize * scount + msize * mcount
+            if ram < budget and (best is None or ram < best[0]):
+                best = (ram, (scount, ssize), (mcount, msize))
+    return best
+
+def summarize(trace):
+    counts = collections.Counter(rec.event for rec in trace)
+    names = [ n for n in dir(Events) if not n.startswith('_') ]
+    byvalue = dict((getattr(Events, n), n) for n in names)
+    print('Trace contains {} events:'.format(len(trace)))
+    for e, c in sorted(counts.items()):
+        print('  {:<10} {}'.format(byvalue.get(e, str(e)), c))
+    sizes, peaks = lockStats(trace)
+    if sizes:
+        print('Locks: {} (sizes {}-{} bytes, at most {} simultaneously of one size)'.format(
+            len(sizes), min(sizes), max(sizes), max(peaks.values())))
+    print()
+
+def tune(args):
+    trace = readTrace(args.trace)
+    if args.limit:
+        trace = trace[:args.limit]
+    if not any(rec.event == Events.start for rec in trace):
+        trace.insert(0, Record(Events.start, 0, 0)) # trace started after start() was called
+    summarize(trace)
+
+    lockpages = chooseLockPages(trace, args.ram)
+    if lockpages is None:
+        print('RAM budget too small for the lock pages', file=sys.stderr)
+        return 1
+    lockram, small, medium = lockpages
+    bigpeak = peakConcurrent(trace, medium[1], 1 << 32)
+
+    policies = args.policies.split(',')
+    results = []
+    for bsize in powersOfTwo(args.min_page, min(args.max_page, 32768)):
+        maxcount = min((args.ram - lockram) // bsize, 64)
+        counts = sorted(set(c for c in (1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64) if bigpeak < c <= maxcount))
+        for bcount in counts:
+            for policy in policies:
+                for align in (False, True):
+                    model = simulate(trace, small, medium, (bcount, bsize), policy, align)
+                    total = model.bytesRead + model.bytesWritten
+                    ram = lockram + bcount * bsize
+                    results.append((total, ram, bcount, bsize, policy, align, model))
+                    if args.verbose:
+                        print('big {:>2} x {:>5} {:<7} align={:<5} -> {} bytes'.format(bcount, bsize, policy, str(align), total))
+
+    if not results:
+        print('No big page configuration fits in the RAM budget', file=sys.stderr)
+        return 1
+
+    results.sort(key=lambda r: (r[0], r[1]))
+    print('Best configurations (RAM budget {} bytes, lock pages use {} bytes):'.format(args.ram, lockram))
+    print('  {:>12} {:>12} {:>7} {:>6} {:>7} {:<8} {}'.format('backend B', 'read B', 'RAM', 'pages', 'size', 'policy', 'aligned'))
+    for total, ram, bcount, bsize, policy, align, model in results[:args.top]:
+        print('  {:>12} {:>12} {:>7} {:>6} {:>7} {:<8} {}'.format(total, model.bytesRead, ram, bcount, bsize, policy, align))
+
+    total, ram, bcount, bsize, policy, align, model = results[0]
+    print()
+    print('Recommended allocator properties:')
+    print()
+    print('struct TunedAllocProperties')
+    print('{')
+    print('    static const uint8_t smallPageCount = {}, smallPageSize = {};'.format(small[0], small[1]))
+    print('    static const uint8_t mediumPageCount = {};'.format(medium[0]))
+    print('    static const uint16_t mediumPageSize = {};'.format(medium[1]))
+    print('    static const uint8_t bigPageCount = {};'.format(bcount))
+    print('    static const uint16_t bigPageSize = {};'.format(bsize))
+    if align:
+        print('    static const bool alignBigPages = true;')
+    if policy != 'default':
+        print('    typedef virtmem::{} PagePolicy;'.format(PolicyTypes[policy]))
+    print('};')
+    print()
+    print('Note: this is based on a simplified model of the allocator, verify the result with the statistics')
+    print('functions (VIRTMEM_TRACE_STATS) or performance counters (VIRTMEM_TRACE_COUNTERS).')
+    return 0
+
+def record(args):
+    import serial
+    port = serial.Serial(args.port, args.baud, timeout=0.1)
+    size = 0
+    print('Recording to {}, press ctrl+C to stop'.format(args.output))
+    with open(args.output, 'wb') as f:
+        try:
+            while True:
+                data = port.read(4096)
+                if data:
+                    f.write(data)
+                    size += len(data)
+        except KeyboardInterrupt:
+            pass
+    print('Recorded {} events'.format(size // RECORD_SIZE))
+    return 0
+
+def main():
+    parser = argparse.ArgumentParser(description='Records and analyzes virtmem access traces.')
+    sub = parser.add_subparsers(dest='command')
+    sub.required = True
+
+    rec = sub.add_parser('record', help='record a trace sent by StreamAccessTracer over a serial port')
+    rec.add_argument('port', help='serial port')
+    rec.add_argument('output', help='trace file to write')
+    rec.add_argument('-b', '--baud', type=int, default=115200, help='baud rate (default: %(default)s)')
+    rec.set_defaults(func=record)
+
+    t = sub.add_parser('tune', help='find page settings that minimize the transferred data')
+    t.add_argument('trace', help='trace file')
+    t.add_argument('-r', '--ram', type=int, default=2048, help='RAM available for pages, in bytes (default: %(default)s)')
+    t.add_argument('-p', '--policies', default='default,lru,clock,2q', help='comma separated list of replacement policies (default: %(default)s)')
+    t.add_argument('--min-page', type=int, default=64, help='minimum size of a big page (default: %(default)s)')
+    t.add_argument('--max-page', type=int, default=32768, help='maximum size of a big page (default: %(default)s)')
+    t.add_argument('-n', '--top', type=int, default=10, help='amount of configurations shown (default: %(default)s)')
+    t.add_argument('-l', '--limit', type=int, default=0, help='only use the first LIMIT events')
+    t.add_argument('-v', '--verbose', action='store_true', help='show all simulated configurations')
+    t.set_defaults(func=tune)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+if __name__ == '__main__':
+    sys.exit(main())
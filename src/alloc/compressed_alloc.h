@@ -0,0 +1,253 @@
+#ifndef VIRTMEM_COMPRESSED_ALLOC_H
+#define VIRTMEM_COMPRESSED_ALLOC_H
+
+/**
+  * @file
+  * @brief This file contains the compressing virtual memory allocator
+  */
+
+#include "internal/alloc.h"
+#include "internal/lzf.h"
+
+#include <string.h>
+
+namespace virtmem {
+
+/**
+ * @brief Virtual memory allocator that transparently compresses data before it is stored by
+ * another allocator.
+ *
+ * The memory pool is divided in blocks of `blockSize` bytes, which are compressed with a fast LZ
+ * class codec (LZF) and stored by a _backend_ allocator (e.g. SPIRAMVAllocP, SDVAllocP or
+ * SerialVAllocP). Compressed blocks occupy a variable amount of _chunks_ (an eighth of a block)
+ * of the backend. The location of each block is kept in an index in RAM. This has two
+ * advantages:
+ * - the memory pool may be larger than the storage of the backend (e.g. a 256 kB pool on a 128 kB
+ * SPI RAM chip), as long as the data compresses well enough.
+ * - less data is transferred to and from the backend.
+ *
+ * Blocks that do not compress are stored unmodified, and blocks that only contain zeros are not
+ * stored at all.
+ *
+ * The backend allocator is constructed by this allocator and can be configured through
+ * getBackend(). Its memory pages are not used, and should be kept small with TierAllocProperties:
+ * @code{.cpp}
+ * // 256 kB memory pool stored in 128 kB SPI RAM
+ * virtmem::CompressedVAllocP<virtmem::SPIRAMVAllocP<virtmem::TierAllocProperties>, 1024l * 128, 512> valloc;
+ * @endcode
+ *
+ * @tparam BackendAlloc Allocator type of the backend.
+ * @tparam storeSize Amount of bytes available in the backend. The amount of chunks (`storeSize`
+ * divided by `blockSize / 8`) must be less than 65536.
+ * @tparam blockCount Amount of blocks, the size of the memory pool is `blockSize * blockCount`.
+ * Every block needs three bytes of RAM for the index.
+ * @tparam blockSize Size of a block, a multiple of eight. Larger blocks compress better, but
+ * increase the amount of data that is processed for each page transfer. Two buffers of this size
+ * are kept in RAM.
+ * @tparam Properties Allocator properties, see DefaultAllocProperties
+ *
+ * @note The allocator halts (on Arduino after printing an error message to `Serial`) when the
+ * backend runs out of storage, hence, the pool size should be chosen conservatively.
+ * @note Since the index is only kept in RAM, persistent mode (see BaseVAlloc::setPersistent()) is
+ * not supported.
+ * @note Since the pool size is determined by the template parameters, the @ref setPoolSize
+ * function is not available for this allocator.
+ * @sa TieredVAllocP, @ref bUsing
+ */
+template <typename BackendAlloc, uint32_t storeSize, uint16_t blockCount, uint16_t blockSize=512,
+          typename Properties=DefaultAllocProperties>
+class CompressedVAllocP : public VAlloc<Properties, CompressedVAllocP<BackendAlloc, storeSize, blockCount, blockSize, Properties> >
+{
+    enum
+    {
+        CHUNKS_PER_BLOCK = 8,
+        CHUNK_SIZE = blockSize / CHUNKS_PER_BLOCK,
+        STORE_CHUNKS = storeSize / CHUNK_SIZE,
+        HASH_BITS = 9
+    };
+
+    BackendAlloc backend;
+    uint16_t extentStart[blockCount]; // first chunk
+    uint8_t extentChunks[blockCount]; // 0 if not stored, CHUNKS_PER_BLOCK if uncompressed
+    uint8_t chunkMap[(STORE_CHUNKS + 7) / 8]; // used chunks
+    uint16_t usedChunks;
+    uint16_t hashTable[1 << HASH_BITS];
+    uint8_t blockData[blockSize], packedData[blockSize];
+    uint16_t cachedBlock; // block contained in blockData, or blockCount if none
+
+    // backends are accessed as BaseVAlloc, which grants access to their backend functions
+    BaseVAlloc &store(void) { return backend; }
+
+    bool isChunkUsed(uint16_t c) const { return chunkMap[c / 8] & (1 << (c & 7)); }
+    void setChunks(uint16_t start, uint8_t count, bool used)
+    {
+        for (uint16_t c=start; c<(start + count); ++c)
+        {
+            if (used)
+                chunkMap[c / 8] |= (1 << (c & 7));
+            else
+                chunkMap[c / 8] &= ~(1 << (c & 7));
+        }
+        if (used)
+            usedChunks += count;
+        else
+            usedChunks -= count;
+    }
+
+    // Returns the first run of free chunks
+    uint16_t findChunks(uint8_t count) const
+    {
+        uint8_t run = 0;
+        for (uint16_t c=0; c<STORE_CHUNKS; ++c)
+        {
+            run = isChunkUsed(c) ? 0 : (run + 1);
+            if (run == count)
+                return c + 1 - count;
+        }
+
+        private_utils::fatalError("compressed store is full");
+        return 0;
+    }
+
+    bool isZeroBlock(void) const
+    {
+        for (uint16_t i=0; i<blockSize; ++i)
+        {
+            if (blockData[i])
+                return false;
+        }
+        return true;
+    }
+
+    void loadBlock(uint16_t block)
+    {
+        if (cachedBlock == block)
+            return;
+
+        const uint8_t chunks = extentChunks[block];
+        const VPtrNum offset = (VPtrNum)extentStart[block] * CHUNK_SIZE;
+        if (chunks == 0)
+            ::memset(blockData, 0, blockSize);
+        else if (chunks == CHUNKS_PER_BLOCK)
+            store().doRead(blockData, offset, blockSize);
+        else
+        {
+            store().doRead(packedData, offset, (VPtrSize)chunks * CHUNK_SIZE);
+            if (!private_utils::lzfDecompress(packedData, (VPtrSize)chunks * CHUNK_SIZE, blockData, blockSize))
+                private_utils::fatalError("corrupt compressed block");
+        }
+        cachedBlock = block;
+    }
+
+    // Compresses and stores the data in blockData
+    void storeBlock(uint16_t block)
+    {
+        cachedBlock = block;
+
+        const uint8_t *data = blockData;
+        uint32_t size = 0;
+        uint8_t chunks = 0;
+        if (!isZeroBlock())
+        {
+            // only use compressed data if it saves at least one chunk
+            size = private_utils::lzfCompress(blockData, blockSize, packedData,
+                                              (CHUNKS_PER_BLOCK - 1) * CHUNK_SIZE, hashTable, HASH_BITS);
+            if (size)
+            {
+                data = packedData;
+                chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            }
+            else
+            {
+                size = blockSize;
+                chunks = CHUNKS_PER_BLOCK;
+            }
+        }
+
+        // shrink in place or move to a new location
+        const uint8_t oldchunks = extentChunks[block];
+        if (chunks <= oldchunks)
+            setChunks(extentStart[block] + chunks, oldchunks - chunks, false);
+        else
+        {
+            setChunks(extentStart[block], oldchunks, false);
+            extentStart[block] = findChunks(chunks);
+            setChunks(extentStart[block], chunks, true);
+        }
+        extentChunks[block] = chunks;
+
+        if (size)
+            store().doWrite(data, (VPtrNum)extentStart[block] * CHUNK_SIZE, size);
+    }
+
+    void doStart(void)
+    {
+        ASSERT((blockSize % CHUNKS_PER_BLOCK) == 0 && STORE_CHUNKS < 65536);
+        if (store().getPoolSize() == 0)
+            store().setPoolSize(storeSize);
+        ASSERT(store().getPoolSize() >= storeSize);
+        store().doStart();
+
+        ::memset(extentChunks, 0, sizeof(extentChunks));
+        ::memset(chunkMap, 0, sizeof(chunkMap));
+        usedChunks = 0;
+        cachedBlock = blockCount;
+    }
+
+    void doStop(void) { store().doStop(); }
+    void doFlush(void) { store().doFlush(); }
+
+    void doRead(void *data, VPtrSize offset, VPtrSize size)
+    {
+        uint8_t *d = static_cast<uint8_t *>(data);
+        while (size)
+        {
+            const uint16_t block = offset / blockSize;
+            const VPtrSize boffset = offset % blockSize;
+            const VPtrSize sz = private_utils::minimal(size, (VPtrSize)(blockSize - boffset));
+
+            if (cachedBlock != block && extentChunks[block] == CHUNKS_PER_BLOCK)
+                store().doRead(d, (VPtrNum)extentStart[block] * CHUNK_SIZE + boffset, sz); // uncompressed
+            else
+            {
+                loadBlock(block);
+                ::memcpy(d, &blockData[boffset], sz);
+            }
+
+            d += sz; offset += sz; size -= sz;
+        }
+    }
+
+    void doWrite(const void *data, VPtrSize offset, VPtrSize size)
+    {
+        const uint8_t *d = static_cast<const uint8_t *>(data);
+        while (size)
+        {
+            const uint16_t block = offset / blockSize;
+            const VPtrSize boffset = offset % blockSize;
+            const VPtrSize sz = private_utils::minimal(size, (VPtrSize)(blockSize - boffset));
+
+            if (sz < blockSize)
+                loadBlock(block); // partial update
+            ::memcpy(&blockData[boffset], d, sz);
+            storeBlock(block);
+
+            d += sz; offset += sz; size -= sz;
+        }
+    }
+
+    using BaseVAlloc::setPoolSize;
+
+public:
+    //! Constructs (but not initializes) the allocator.
+    CompressedVAllocP(void) : usedChunks(0), cachedBlock(blockCount)
+    { this->setPoolSize((VPtrSize)blockSize * blockCount); }
+
+    BackendAlloc &getBackend(void) { return backend; } //!< Returns the backend allocator, e.g. to configure it.
+    //! Returns the amount of bytes currently used in the backend.
+    VPtrSize getStoredSize(void) const { return (VPtrSize)usedChunks * CHUNK_SIZE; }
+};
+
+}
+
+#endif // VIRTMEM_COMPRESSED_ALLOC_H
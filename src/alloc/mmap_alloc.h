@@ -0,0 +1,150 @@
+#ifndef VIRTMEM_MMAP_ALLOC_H
+#define VIRTMEM_MMAP_ALLOC_H
+
+/**
+  * @file
+  * @brief This file contains the mmap virtual memory allocator (for POSIX hosts)
+  */
+
+#include "internal/alloc.h"
+#include "config/config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+namespace virtmem {
+
+/**
+ * @brief Virtual memory allocator that uses a memory mapping as memory pool.
+ *
+ * This allocator is meant for simulation and testing on POSIX systems (e.g. Linux and OS X). By
+ * default the memory pool is an anonymous mapping. Alternatively, a file can be specified (see
+ * setFile()), in which case the memory pool is stored in this file. All data is accessed directly
+ * from the mapping (see BaseVAlloc::doGetDirectData()), hence, no memory pages or file I/O (see
+ * StdioVAllocP) are used.
+ *
+ * When a file is used, \ref flush() synchronously writes all modified data back to the file (via
+ * `msync`).
+ *
+ * @tparam Properties Allocator properties, see DefaultAllocProperties
+ *
+ * @note If the pool file cannot be opened or mapped, \ref start() prints an error message and
+ * aborts the program.
+ * @note The allocator bookkeeping is initialized by \ref start(), therefore, existing data in the
+ * file can only be accessed after the allocator is restarted in persistent mode (see
+ * BaseVAlloc::setPersistent()).
+ *
+ * @sa @ref bUsing
+ */
+template <typename Properties = DefaultAllocProperties>
+class MmapVAllocP : public VAlloc<Properties, MmapVAllocP<Properties> >
+{
+    const char *fileName;
+    int fileDesc;
+    uint8_t *pool;
+
+    void doStart(void)
+    {
+        const VPtrSize size = this->getPoolSize();
+        void *m;
+
+        if (fileName)
+        {
+            fileDesc = open(fileName, O_RDWR | O_CREAT, 0644);
+            if (fileDesc == -1)
+            {
+                fprintf(stderr, "Unable to open pool file: %s\n", strerror(errno));
+                private_utils::fatalError("mmap allocator failed to start");
+            }
+
+            // accessing a mapping beyond the end of the file raises SIGBUS, so this must succeed
+            if (ftruncate(fileDesc, size) != 0)
+            {
+                fprintf(stderr, "Unable to resize pool file: %s\n", strerror(errno));
+                private_utils::fatalError("mmap allocator failed to start");
+            }
+
+            m = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDesc, 0);
+        }
+        else // anonymous mappings are zero initialized
+            m = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (m == MAP_FAILED)
+        {
+            fprintf(stderr, "Unable to map memory pool: %s\n", strerror(errno));
+            private_utils::fatalError("mmap allocator failed to start");
+        }
+
+        pool = static_cast<uint8_t *>(m);
+    }
+
+    void doSuspend(void) { }
+    void doStop(void)
+    {
+        if (pool)
+        {
+            munmap(pool, this->getPoolSize());
+            pool = 0;
+        }
+
+        if (fileDesc != -1)
+        {
+            close(fileDesc);
+            fileDesc = -1;
+        }
+    }
+
+    void doRead(void *data, VPtrSize offset, VPtrSize size)
+    {
+        ::memcpy(data, &pool[offset], size);
+    }
+
+    void doWrite(const void *data, VPtrSize offset, VPtrSize size)
+    {
+        ::memcpy(&pool[offset], data, size);
+    }
+
+    void *doGetDirectData(void) { return pool; }
+
+    void doFlush(void)
+    {
+        if (pool && fileDesc != -1 && msync(pool, this->getPoolSize(), MS_SYNC) != 0)
+            fprintf(stderr, "msync error: %s\n", strerror(errno));
+    }
+
+public:
+    /**
+     * @brief Constructs (but not initializes) the allocator.
+     * @param ps Total amount of bytes of the memory pool.
+     * @param file Path to the file used to store the memory pool. If `0`, an anonymous mapping
+     * is used.
+     * @sa setPoolSize, setFile
+     */
+    MmapVAllocP(VPtrSize ps=VIRTMEM_DEFAULT_POOLSIZE, const char *file=0) : fileName(file), fileDesc(-1), pool(0)
+    { this->setPoolSize(ps); }
+    ~MmapVAllocP(void) { doStop(); }
+
+    /**
+     * @brief Sets the file used to store the memory pool.
+     * @param file Path to the file. The file is created if it does not exist yet and resized to
+     * the size of the memory pool. If `0`, an anonymous mapping is used.
+     * @note The string is not copied and should therefore remain valid while the allocator is used.
+     * @note This function should always called before \ref start().
+     */
+    void setFile(const char *file) { fileName = file; }
+};
+
+typedef MmapVAllocP<> MmapVAlloc; //!< Shortcut to MmapVAllocP with default template arguments
+
+}
+
+#endif // VIRTMEM_MMAP_ALLOC_H
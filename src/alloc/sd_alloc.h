@@ -9,6 +9,7 @@
 #include "internal/alloc.h"
 
 #include <SdFat.h>
+#include <string.h>
 
 namespace virtmem {
 
@@ -20,45 +21,150 @@ namespace virtmem {
  * and therefore has to be installed.
  *
  * When the allocator is initialized (i.e. by calling start()) it will create a file called
- * 'ramfile.vm' in the root directory. Existing files will be reused and resized if necessary.
+ * 'ramfile.vm' in the root directory. Existing files will be reused if they are large enough,
+ * otherwise the file is (re)created. If possible, the file is preallocated, which is much
+ * faster than writing it.
+ *
+ * In persistent mode (see BaseVAlloc::setPersistent()) all data in the file remains accessible
+ * after a restart.
+ *
+ * If the `rawIO` template parameter is `true`, the file is a *contiguous* range of blocks on the
+ * SD card, which is accessed directly with multi-block transfers (see setCard()). This skips
+ * the FAT administration and the block cache of the SD FAT library, which is much faster. Parts
+ * of blocks are read/written with an additional block buffer (512 bytes). To avoid this,
+ * transfers should be aligned to blocks, for instance by setting the following allocator
+ * properties (see DefaultAllocProperties): `alignBigPages` to `true`, and `bigPageSize` and
+ * `dirtyGranularity` (if used) to a multiple of 512.
  *
  * @tparam Properties Allocator properties, see DefaultAllocProperties
+ * @tparam rawIO If `true`, the SD card is accessed directly (see above). Regular file I/O is used
+ * if no card was set or no contiguous file could be created.
  *
  * @note The SD FAT library needs to be initialized (i.e. by calling SdFat::begin()) *before*
  * initializing this allocator.
  * @sa @ref bUsing, SDVAlloc
  */
-template <typename Properties=DefaultAllocProperties>
-class SDVAllocP : public VAlloc<Properties, SDVAllocP<Properties> >
+template <typename Properties=DefaultAllocProperties, bool rawIO=false>
+class SDVAllocP : public VAlloc<Properties, SDVAllocP<Properties, rawIO> >
 {
+    enum { BLOCK_SIZE = 512, RAW_IO_RETRIES = 3 };
+
+    typedef bool (*ReadBlocksFunc)(void *, uint32_t, uint8_t *, uint32_t);
+    typedef bool (*WriteBlocksFunc)(void *, uint32_t, const uint8_t *, uint32_t);
+
     SdFile sdFile;
+    void *card;
+    ReadBlocksFunc readBlocksFunc;
+    WriteBlocksFunc writeBlocksFunc;
+    uint32_t firstBlock;
+    bool useRawIO;
+    // NOTE: never empty, as the (unused) raw I/O functions would otherwise copy from/to NULL
+    private_utils::StaticArray<uint8_t, (rawIO) ? BLOCK_SIZE : 1> blockBuffer;
+
+    // multi-block transfers, supported by all card classes of the SD FAT library
+    template <typename C> static bool readBlocks(void *c, uint32_t block, uint8_t *data, uint32_t count)
+    {
+        C *sdcard = static_cast<C *>(c);
+        if (!sdcard->readStart(block))
+            return false;
+        for (uint32_t i=0; i<count; ++i, data+=BLOCK_SIZE)
+        {
+            if (!sdcard->readData(data))
+                return false;
+        }
+        return sdcard->readStop();
+    }
+
+    template <typename C> static bool writeBlocks(void *c, uint32_t block, const uint8_t *data, uint32_t count)
+    {
+        C *sdcard = static_cast<C *>(c);
+        if (!sdcard->writeStart(block, count))
+            return false;
+        for (uint32_t i=0; i<count; ++i, data+=BLOCK_SIZE)
+        {
+            if (!sdcard->writeData(data))
+                return false;
+        }
+        return sdcard->writeStop();
+    }
+
+    // Raw block transfers are retried a few times; a persistent failure is unrecoverable, as the
+    // allocator cannot continue with lost or partially written pages
+    void rawReadBlocks(uint32_t block, uint8_t *data, uint32_t count)
+    {
+        for (uint8_t i=0; i<RAW_IO_RETRIES; ++i)
+        {
+            if (readBlocksFunc(card, block, data, count))
+                return;
+        }
+        private_utils::fatalError("raw SD read failed");
+    }
+
+    void rawWriteBlocks(uint32_t block, const uint8_t *data, uint32_t count)
+    {
+        for (uint8_t i=0; i<RAW_IO_RETRIES; ++i)
+        {
+            if (writeBlocksFunc(card, block, data, count))
+                return;
+        }
+        private_utils::fatalError("raw SD write failed");
+    }
+
+    // Checks whether the file can be accessed directly if raw I/O is requested
+    bool initRawIO(void)
+    {
+        uint32_t lastblock;
+        useRawIO = (rawIO && card && sdFile.contiguousRange(&firstBlock, &lastblock));
+        return (!rawIO || !card || useRawIO);
+    }
 
     void doStart(void)
     {
-        // file does not exist yet (can we create it)?
-        if (sdFile.open("ramfile.vm", O_CREAT | O_EXCL))
-            this->writeZeros(0, this->getPoolSize()); // make it the right size
-        else // already exists, check size
+        // NOTE: the file only has to be large enough, its contents do not matter since data that
+        // was never written is not read (it is zero filled instead)
+
+        // reuse existing file if it is large enough (and contiguous for raw I/O)
+        if (sdFile.open("ramfile.vm", O_RDWR))
         {
-            if (!sdFile.open("ramfile.vm", O_CREAT | O_RDWR))
-            {
-                Serial.println("opening ram file failed");
-                while (true)
-                    ;
-            }
-
-            const uint32_t size = sdFile.fileSize();
-            if (size < this->getPoolSize())
-                this->writeZeros(size, this->getPoolSize() - size);
+            if (sdFile.fileSize() >= this->getPoolSize() && initRawIO())
+                return;
+            sdFile.remove(); // recreate it below
         }
+
+        // preallocate the file, which only needs updating the FAT
+        if (sdFile.createContiguous(SdFile::cwd(), "ramfile.vm", this->getPoolSize()))
+        {
+            initRawIO();
+            return;
+        }
+
+        // no contiguous space available: resize file by writing to it
+        useRawIO = false;
+        if (!sdFile.open("ramfile.vm", O_CREAT | O_RDWR))
+        {
+            Serial.println("opening ram file failed");
+            while (true)
+                ;
+        }
+
+        const uint32_t size = sdFile.fileSize();
+        if (size < this->getPoolSize())
+            this->writeZeros(size, this->getPoolSize() - size);
     }
 
     void doStop(void)
     {
         sdFile.close();
     }
+
     void doRead(void *data, VPtrSize offset, VPtrSize size)
     {
+        if (useRawIO)
+        {
+            rawRead(static_cast<uint8_t *>(data), offset, size);
+            return;
+        }
+
 //        const uint32_t t = micros();
         sdFile.seekSet(offset);
         sdFile.read(data, size);
@@ -67,18 +173,82 @@ class SDVAllocP : public VAlloc<Properties, SDVAllocP<Properties> >
 
     void doWrite(const void *data, VPtrSize offset, VPtrSize size)
     {
+        if (useRawIO)
+        {
+            rawWrite(static_cast<const uint8_t *>(data), offset, size);
+            return;
+        }
+
 //        const uint32_t t = micros();
         sdFile.seekSet(offset);
         sdFile.write(data, size);
 //        Serial.print("write: "); Serial.print(size); Serial.print("/"); Serial.println(micros() - t);
     }
 
+    void rawRead(uint8_t *data, VPtrSize offset, VPtrSize size)
+    {
+        uint32_t block = firstBlock + (offset / BLOCK_SIZE);
+        const VirtPageSize boffset = offset % BLOCK_SIZE;
+
+        if (boffset) // starts in the middle of a block?
+        {
+            const VirtPageSize copysize = private_utils::minimal(size, (VPtrSize)(BLOCK_SIZE - boffset));
+            rawReadBlocks(block, blockBuffer.get(), 1);
+            ::memcpy(data, blockBuffer.get() + boffset, copysize);
+            data += copysize; size -= copysize; ++block;
+        }
+
+        const uint32_t count = size / BLOCK_SIZE;
+        if (count)
+        {
+            rawReadBlocks(block, data, count);
+            data += count * BLOCK_SIZE; size -= count * BLOCK_SIZE; block += count;
+        }
+
+        if (size) // ends in the middle of a block?
+        {
+            rawReadBlocks(block, blockBuffer.get(), 1);
+            ::memcpy(data, blockBuffer.get(), size);
+        }
+    }
+
+    void rawWrite(const uint8_t *data, VPtrSize offset, VPtrSize size)
+    {
+        // NOTE: partial blocks are read first, and written back after they were modified
+        uint32_t block = firstBlock + (offset / BLOCK_SIZE);
+        const VirtPageSize boffset = offset % BLOCK_SIZE;
+
+        if (boffset)
+        {
+            const VirtPageSize copysize = private_utils::minimal(size, (VPtrSize)(BLOCK_SIZE - boffset));
+            rawReadBlocks(block, blockBuffer.get(), 1);
+            ::memcpy(blockBuffer.get() + boffset, data, copysize);
+            rawWriteBlocks(block, blockBuffer.get(), 1);
+            data += copysize; size -= copysize; ++block;
+        }
+
+        const uint32_t count = size / BLOCK_SIZE;
+        if (count)
+        {
+            rawWriteBlocks(block, data, count);
+            data += count * BLOCK_SIZE; size -= count * BLOCK_SIZE; block += count;
+        }
+
+        if (size)
+        {
+            rawReadBlocks(block, blockBuffer.get(), 1);
+            ::memcpy(blockBuffer.get(), data, size);
+            rawWriteBlocks(block, blockBuffer.get(), 1);
+        }
+    }
+
 public:
     /** Constructs (but not initializes) the SD FAT allocator.
      * @param ps The size of the virtual memory pool
      * @sa setPoolSize
      */
-    SDVAllocP(VPtrSize ps=VIRTMEM_DEFAULT_POOLSIZE) { this->setPoolSize(ps); }
+    SDVAllocP(VPtrSize ps=VIRTMEM_DEFAULT_POOLSIZE) : card(0), readBlocksFunc(0), writeBlocksFunc(0),
+        firstBlock(0), useRawIO(false) { this->setPoolSize(ps); }
     ~SDVAllocP(void) { doStop(); }
 
     /**
@@ -86,6 +256,31 @@ public:
      * @note Only call this when the allocator is not initialized!
      */
     void removeTempFile(void) { sdFile.remove(); }
+
+    /**
+     * @brief Sets the SD card that is accessed directly if the `rawIO` template parameter is set.
+     *
+     * Example:
+     * @code
+     * SdFat sd;
+     * virtmem::SDVAllocP<AllocProperties, true> valloc;
+     * ...
+     * sd.begin(chipSelect, SPI_FULL_SPEED);
+     * valloc.setCard(sd.card());
+     * valloc.start();
+     * @endcode
+     * @param c The card object of the SD FAT library (e.g. as returned by `SdFat::card()`).
+     * @note This function should always called before \ref start().
+     */
+    template <typename C> void setCard(C *c)
+    {
+        card = c;
+        readBlocksFunc = &readBlocks<C>;
+        writeBlocksFunc = &writeBlocks<C>;
+    }
+
+    //! Returns `true` if the SD card is accessed directly (see setCard()).
+    bool usesRawIO(void) const { return useRawIO; }
 };
 
 typedef SDVAllocP<> SDVAlloc; //!< Shortcut to SDVAllocP with default template arguments
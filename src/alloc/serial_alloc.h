@@ -24,6 +24,10 @@ namespace virtmem {
  * the RAM (the _RAM host_) should run a script (`serial_host.py`) that is responsible for
  * communicating with `virtmem` and memory management.
  *
+ * Writes are not acknowledged by the RAM host, hence, writing back a page and fetching the next
+ * page only requires a single round trip. Multiple pages (e.g. read-ahead, see
+ * DefaultAllocProperties) and dirty page regions are transferred with a single vectored command.
+ *
  * __Choosing a serial port__
  *
  * By default, the allocator uses the default serial port (i.e. the `Serial` class). In this case,
@@ -134,10 +138,11 @@ class SerialVAllocP : public VAlloc<Properties, SerialVAllocP<IOStream, Properti
 {
     uint32_t baudRate;
     IOStream *stream;
+    bool compressionRequested, compressing;
 
     void doStart(void)
     {
-        serram_utils::init(stream, baudRate, this->getPoolSize());
+        compressing = serram_utils::init(stream, baudRate, this->getPoolSize(), compressionRequested);
     }
 
     void doStop(void) { }
@@ -148,8 +153,7 @@ class SerialVAllocP : public VAlloc<Properties, SerialVAllocP<IOStream, Properti
         serram_utils::sendReadCommand(stream, serram_utils::CMD_READ);
         serram_utils::writeUInt32(stream, offset);
         serram_utils::writeUInt32(stream, size);
-        Serial.flush();
-        serram_utils::readBlock(stream, (char *)data, size);
+        serram_utils::readPayload(stream, (uint8_t *)data, size, compressing);
 //        Serial.print("read: "); Serial.print(size); Serial.print("/"); Serial.println(micros() - t);
     }
 
@@ -159,10 +163,28 @@ class SerialVAllocP : public VAlloc<Properties, SerialVAllocP<IOStream, Properti
         serram_utils::sendWriteCommand(stream, serram_utils::CMD_WRITE);
         serram_utils::writeUInt32(stream, offset);
         serram_utils::writeUInt32(stream, size);
-        serram_utils::writeBlock(stream, (const uint8_t *)data, size);
+        serram_utils::writePayload(stream, (const uint8_t *)data, size, compressing);
 //        Serial.print("write: "); Serial.print(size); Serial.print("/"); Serial.println(micros() - t);
     }
 
+    // Vectored transfers: all blocks are sent in one frame, hence, multiple pages only need a
+    // single round trip
+    bool doReadV(const BaseVAlloc::IOBlock *blocks, uint8_t count)
+    {
+        serram_utils::sendReadCommand(stream, serram_utils::CMD_READV);
+        serram_utils::writeBlockList(stream, blocks, count, false, compressing);
+        for (uint8_t i=0; i<count; ++i)
+            serram_utils::readPayload(stream, blocks[i].data, blocks[i].size, compressing);
+        return true;
+    }
+
+    bool doWriteV(const BaseVAlloc::IOBlock *blocks, uint8_t count)
+    {
+        serram_utils::sendWriteCommand(stream, serram_utils::CMD_WRITEV);
+        serram_utils::writeBlockList(stream, blocks, count, true, compressing);
+        return true;
+    }
+
 public:
     /**
      * @brief Handles input of shared serial connections.
@@ -178,7 +200,8 @@ public:
      * @sa setBaudRate and setPoolSize
      */
     SerialVAllocP(VPtrSize ps=VIRTMEM_DEFAULT_POOLSIZE, uint32_t baud=115200, IOStream *s=&Serial) :
-        baudRate(baud), stream(s), input(stream) { this->setPoolSize(ps); }
+        baudRate(baud), stream(s), compressionRequested(false), compressing(false), input(stream)
+    { this->setPoolSize(ps); }
 
     // only works before start() is called
     /**
@@ -188,6 +211,22 @@ public:
      */
     void setBaudRate(uint32_t baud) { baudRate = baud; }
 
+    /**
+     * @brief Enables or disables compression of page data.
+     *
+     * When enabled, page data is run-length encoded (PackBits) by both the allocator and the RAM
+     * host before it is sent over the serial connection. This mainly speeds up transfers of pages
+     * with repetitive data (e.g. zeroed memory). Data that does not benefit from compression is
+     * sent unmodified. Compression is negotiated with the RAM host by @ref start, and is only used
+     * if the host supports it (see usesCompression()).
+     * @param c `true` to request compression. Default: `false`.
+     * @note Only call this function when the allocator is not yet initialized (i.e. before calling @ref start)
+     */
+    void setCompression(bool c) { compressionRequested = c; }
+
+    //! Returns `true` if compression was requested and accepted by the RAM host (see setCompression()).
+    bool usesCompression(void) const { return compressing; }
+
     /**
      * @brief Send a 'ping' to retrieve a response time. Useful for debugging.
      * @return Response time of serial script connected over serial, in microseconds.
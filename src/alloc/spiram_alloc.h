@@ -122,20 +122,60 @@ struct SPIRamConfig
  * virtmem::MultiSPIRAMVAllocP<scfg, 2> alloc;
  * @endcode
  *
+ * __Striping__
+ *
+ * By default, the chips are concatenated: the memory pool starts with the first chip and continues
+ * with the next chip when it is full. Alternatively, the memory pool can be _striped_ by setting
+ * the `stripeSize` template parameter. In this case the memory pool is divided in units of
+ * `stripeSize` bytes, which are distributed over the chips in a round-robin fashion. For instance,
+ * when the stripe size equals the size of a big memory page, consecutive pages are stored on
+ * different chips.
+ *
+ * @code{.cpp}
+ * // stripes of 64 bytes, the memory pool is 256 kB
+ * virtmem::MultiSPIRAMVAllocP<scfg, 2, virtmem::DefaultAllocProperties, 64> alloc;
+ * @endcode
+ *
  * @tparam SPIChips An array of SPIRamConfig that is used to configure each individual SRAM chip.
  * @tparam chipAmount Amount of SRAM chips to be used.
  * @tparam Properties Allocator properties, see DefaultAllocProperties
+ * @tparam stripeSize Size of a stripe unit, in bytes, or `0` to concatenate the chips. Using a
+ * power of two is recommended, as this keeps mapping an address to a chip cheap.
  *
+ * @note When striping is used, only the size of the smallest chip is used from each chip (hence,
+ * ideally all chips are of the same size).
  * @note The `serialram` library needs to be initialized (i.e. by calling CSerial::begin()) *before*
  * initializing this allocator.
  * @sa @ref bUsing, SPIRamConfig and SPIRAMVAllocP
  *
  */
-template <const SPIRamConfig *SPIChips, size_t chipAmount, typename Properties=DefaultAllocProperties>
-class MultiSPIRAMVAllocP : public VAlloc<Properties, MultiSPIRAMVAllocP<SPIChips, chipAmount, Properties> >
+template <const SPIRamConfig *SPIChips, size_t chipAmount, typename Properties=DefaultAllocProperties,
+          uint32_t stripeSize=0>
+class MultiSPIRAMVAllocP : public VAlloc<Properties, MultiSPIRAMVAllocP<SPIChips, chipAmount, Properties, stripeSize> >
 {
     SerialRam serialRAM[chipAmount];
 
+    void chipTransfer(uint8_t chip, char *data, VPtrNum p, VPtrSize size) { serialRAM[chip].read(data, p, size); }
+    void chipTransfer(uint8_t chip, const char *data, VPtrNum p, VPtrSize size) { serialRAM[chip].write(data, p, size); }
+
+    // Splits a transfer in stripe units, the chip of each unit is calculated directly.
+    template <typename TData> void stripedTransfer(TData *data, VPtrNum offset, VPtrSize size)
+    {
+        while (size)
+        {
+            const VPtrNum unit = offset / stripeSize;
+            const VPtrSize unitoffset = offset % stripeSize;
+            const uint8_t chip = unit % chipAmount;
+            const VPtrNum p = (unit / chipAmount) * stripeSize + unitoffset; // address relative in this chip
+            const VPtrSize sz = private_utils::minimal(size, (VPtrSize)(stripeSize - unitoffset));
+
+            chipTransfer(chip, data, p, sz);
+            size -= sz;
+            data += sz;
+            offset += sz;
+        }
+    }
+
     void doStart(void)
     {
         for (uint8_t i=0; i<chipAmount; ++i)
@@ -150,6 +190,12 @@ class MultiSPIRAMVAllocP : public VAlloc<Properties, MultiSPIRAMVAllocP<SPIChips
 
     void doRead(void *data, VPtrSize offset, VPtrSize size)
     {
+        if (stripeSize)
+        {
+            stripedTransfer((char *)data, offset, size);
+            return;
+        }
+
 //        const uint32_t t = micros();
         VPtrNum startptr = 0;
         for (uint8_t i=0; i<chipAmount; ++i)
@@ -158,7 +204,7 @@ class MultiSPIRAMVAllocP : public VAlloc<Properties, MultiSPIRAMVAllocP<SPIChips
             if (offset >= startptr && offset < endptr)
             {
                 const VPtrNum p = offset - startptr; // address relative in this chip
-                const VPtrSize sz = private_utils::minimal(size, SPIChips[i].size - p);
+                const VPtrSize sz = private_utils::minimal(size, (VPtrSize)(SPIChips[i].size - p));
                 serialRAM[i].read((char *)data, p, sz);
 
                 if (sz == size)
@@ -175,6 +221,12 @@ class MultiSPIRAMVAllocP : public VAlloc<Properties, MultiSPIRAMVAllocP<SPIChips
 
     void doWrite(const void *data, VPtrSize offset, VPtrSize size)
     {
+        if (stripeSize)
+        {
+            stripedTransfer((const char *)data, offset, size);
+            return;
+        }
+
 //        const uint32_t t = micros();
         VPtrNum startptr = 0;
         for (uint8_t i=0; i<chipAmount; ++i)
@@ -183,7 +235,7 @@ class MultiSPIRAMVAllocP : public VAlloc<Properties, MultiSPIRAMVAllocP<SPIChips
             if (offset >= startptr && offset < endptr)
             {
                 const VPtrNum p = offset - startptr; // address relative in this chip
-                const VPtrSize sz = private_utils::minimal(size, SPIChips[i].size - p);
+                const VPtrSize sz = private_utils::minimal(size, (VPtrSize)(SPIChips[i].size - p));
                 serialRAM[i].write((const char *)data, p, sz);
 
                 if (sz == size)
@@ -208,8 +260,18 @@ public:
     MultiSPIRAMVAllocP(void)
     {
         uint32_t ps = 0;
-        for (uint8_t i=0; i<chipAmount; ++i)
-            ps += SPIChips[i].size;
+        if (stripeSize)
+        {
+            uint32_t chipsize = SPIChips[0].size;
+            for (uint8_t i=1; i<chipAmount; ++i)
+                chipsize = private_utils::minimal(chipsize, SPIChips[i].size);
+            ps = (chipsize / stripeSize) * stripeSize * chipAmount;
+        }
+        else
+        {
+            for (uint8_t i=0; i<chipAmount; ++i)
+                ps += SPIChips[i].size;
+        }
         this->setPoolSize(ps);
     }
     ~MultiSPIRAMVAllocP(void) { doStop(); }
@@ -17,7 +17,10 @@ namespace virtmem {
 /**
  * @brief Virtual memory allocator that uses a static array (in regular RAM) as memory pool.
  *
- * This allocator does not have any dependencies and is mainly provided for testing.
+ * This allocator does not have any dependencies and is mainly provided for testing. Since the
+ * memory pool is directly addressable, data is accessed without using memory pages (see
+ * BaseVAlloc::doGetDirectData()). The amount of memory pages can therefore be kept to a minimum
+ * (see DefaultAllocProperties).
  *
  * @tparam poolSize The size of the memory pool.
  * @tparam Properties Allocator properties, see DefaultAllocProperties
@@ -31,7 +34,7 @@ namespace virtmem {
 template <uint32_t poolSize=VIRTMEM_DEFAULT_POOLSIZE, typename Properties=DefaultAllocProperties>
 class StaticVAllocP : public VAlloc<Properties, StaticVAllocP<poolSize, Properties> >
 {
-    char staticData[poolSize];
+    char staticData[poolSize] __attribute__ ((aligned (sizeof(BaseVAlloc::TAlign))));
 
     void doStart(void) { }
     void doSuspend(void) { }
@@ -47,6 +50,8 @@ class StaticVAllocP : public VAlloc<Properties, StaticVAllocP<poolSize, Properti
         ::memcpy(&staticData[offset], data, size);
     }
 
+    void *doGetDirectData(void) { return staticData; }
+
     using BaseVAlloc::setPoolSize;
 
 public:
@@ -34,7 +34,8 @@ class StdioVAllocP : public VAlloc<Properties, StdioVAllocP<Properties> >
         ramFile = tmpfile();
         if (!ramFile)
             fprintf(stderr, "Unable to open ram file!");
-        this->writeZeros(0, this->getPoolSize()); // make sure it gets the right size
+        // NOTE: no need to resize the file: writes beyond its end extend it, and data that was
+        // never written is not read
     }
 
     void doSuspend(void) { }
@@ -0,0 +1,248 @@
+#ifndef VIRTMEM_TIERED_ALLOC_H
+#define VIRTMEM_TIERED_ALLOC_H
+
+/**
+  * @file
+  * @brief This file contains the tiered virtual memory allocator
+  */
+
+#include "internal/alloc.h"
+
+#include <string.h>
+
+namespace virtmem {
+
+/**
+ * @brief Virtual memory allocator that combines a fast and a slow memory medium.
+ *
+ * This allocator stores its memory pool in a slow, but large, medium (e.g. an SD card or a serial
+ * connection) and uses a faster medium (e.g. SPI RAM or a static buffer) as a second level cache.
+ * The first level is formed by the (regular) memory pages of this allocator.
+ *
+ * Both media are accessed through existing allocators, the _tiers_. The cache is divided in
+ * blocks of `blockSize` bytes, which map to fixed locations of the fast tier (i.e. the cache is
+ * _direct mapped_). Data enters the cache when memory pages are swapped out: modified pages are
+ * written to the cache (write-back) and unmodified pages are copied to it if the corresponding
+ * cache block is not occupied by modified data. Only complete blocks are cached. Modified cache
+ * blocks are written to the slow tier when they are replaced or when \ref flush() is called.
+ * Adjacent modified blocks are then written in one go.
+ *
+ * The tiers are constructed by this allocator and can be configured through getFastTier() and
+ * getSlowTier(). The memory pages of the tier allocators are not used, and should be kept small
+ * with TierAllocProperties:
+ * @code{.cpp}
+ * typedef virtmem::TieredVAllocP<virtmem::SPIRAMVAllocP<virtmem::TierAllocProperties>,
+ *                                virtmem::SDVAllocP<virtmem::TierAllocProperties>, 512, 256> Alloc;
+ * Alloc valloc(1024l * 1024l * 4); // 4 MB pool on SD, with 128 kB SPI RAM cache
+ *
+ * void setup()
+ * {
+ *     valloc.getFastTier().setSettings(true, 9, SerialRam::SPEED_FULL);
+ *     valloc.start();
+ * }
+ * @endcode
+ *
+ * @tparam FastAlloc Allocator type of the fast tier.
+ * @tparam SlowAlloc Allocator type of the slow tier.
+ * @tparam blockSize Size of a cache block.
+ * @tparam blockCount Amount of cache blocks. The fast tier must hold at least `blockSize *
+ * blockCount` bytes. Every block needs about five bytes of RAM for bookkeeping.
+ * @tparam Properties Allocator properties, see DefaultAllocProperties
+ *
+ * @note The size of the memory pool of the slow tier is set by \ref start(). The pool size of the
+ * fast tier is only set when it was not configured yet.
+ * @note Only the slow tier retains data in persistent mode (see BaseVAlloc::setPersistent()).
+ * @sa @ref bUsing
+ */
+template <typename FastAlloc, typename SlowAlloc, uint16_t blockSize=512, uint16_t blockCount=64,
+          typename Properties=DefaultAllocProperties>
+class TieredVAllocP : public VAlloc<Properties, TieredVAllocP<FastAlloc, SlowAlloc, blockSize, blockCount, Properties> >
+{
+    enum { WRITE_BACK_BATCH = 8 }; // maximum amount of adjacent blocks written back at once
+
+    FastAlloc fastTier;
+    SlowAlloc slowTier;
+    VPtrNum blockTags[blockCount]; // block number + 1, or 0 if unused
+    uint8_t dirtyBlocks[(blockCount + 7) / 8];
+    uint8_t blockBuffer[blockSize];
+
+    // tiers are accessed as BaseVAlloc, which grants access to their backend functions
+    BaseVAlloc &fast(void) { return fastTier; }
+    BaseVAlloc &slow(void) { return slowTier; }
+
+    static uint16_t getSlot(VPtrNum block) { return block % blockCount; }
+    static VPtrNum getSlotOffset(uint16_t slot) { return (VPtrNum)slot * blockSize; }
+    bool isCached(uint16_t slot, VPtrNum block) const { return blockTags[slot] == (block + 1); }
+    bool isDirty(uint16_t slot) const { return dirtyBlocks[slot / 8] & (1 << (slot & 7)); }
+    void setDirty(uint16_t slot, bool d)
+    {
+        if (d)
+            dirtyBlocks[slot / 8] |= (1 << (slot & 7));
+        else
+            dirtyBlocks[slot / 8] &= ~(1 << (slot & 7));
+    }
+    VPtrSize getBlockSize(VPtrNum block) const
+    { return private_utils::minimal((VPtrSize)blockSize, (VPtrSize)(this->getPoolSize() - block * blockSize)); }
+
+    // Writes back a modified block, and any directly following modified blocks
+    void writeBackBlocks(uint16_t slot)
+    {
+        VPtrNum block = blockTags[slot] - 1;
+        for (uint8_t i=0; i<WRITE_BACK_BATCH && isCached(slot, block) && isDirty(slot); ++i)
+        {
+            const VPtrSize size = getBlockSize(block);
+            fast().doRead(blockBuffer, getSlotOffset(slot), size);
+            slow().doWrite(blockBuffer, block * blockSize, size);
+            setDirty(slot, false);
+            slot = getSlot(++block);
+        }
+    }
+
+    // Stores a complete block in the cache. Unmodified data does not replace modified blocks.
+    void storeBlock(VPtrNum block, const void *data, bool dirty)
+    {
+        const uint16_t slot = getSlot(block);
+        if (!isCached(slot, block))
+        {
+            if (blockTags[slot] && isDirty(slot))
+            {
+                if (!dirty)
+                    return;
+                writeBackBlocks(slot);
+            }
+            blockTags[slot] = block + 1;
+            setDirty(slot, false);
+        }
+        else if (!dirty)
+            return; // already there
+
+        fast().doWrite(data, getSlotOffset(slot), getBlockSize(block));
+        if (dirty)
+            setDirty(slot, true);
+    }
+
+    void doStart(void)
+    {
+        if (fast().getPoolSize() == 0)
+            fast().setPoolSize((VPtrSize)blockSize * blockCount);
+        ASSERT(fast().getPoolSize() >= (VPtrSize)blockSize * blockCount);
+        slow().setPoolSize(this->getPoolSize());
+
+        fast().doStart();
+        slow().doStart();
+
+        for (uint16_t i=0; i<blockCount; ++i)
+            blockTags[i] = 0;
+        ::memset(dirtyBlocks, 0, sizeof(dirtyBlocks));
+    }
+
+    void doStop(void)
+    {
+        fast().doStop();
+        slow().doStop();
+    }
+
+    void doRead(void *data, VPtrSize offset, VPtrSize size)
+    {
+        // uncached data is read from the slow tier, adjacent blocks at once
+        uint8_t *d = static_cast<uint8_t *>(data), *missdata = d;
+        VPtrNum missoffset = offset;
+        VPtrSize misssize = 0;
+
+        while (size)
+        {
+            const VPtrNum block = offset / blockSize;
+            const VPtrSize boffset = offset % blockSize;
+            const VPtrSize sz = private_utils::minimal(size, (VPtrSize)(blockSize - boffset));
+            const uint16_t slot = getSlot(block);
+
+            if (isCached(slot, block))
+            {
+                if (misssize)
+                {
+                    slow().doRead(missdata, missoffset, misssize);
+                    misssize = 0;
+                }
+                fast().doRead(d, getSlotOffset(slot) + boffset, sz);
+            }
+            else
+            {
+                if (!misssize)
+                {
+                    missdata = d;
+                    missoffset = offset;
+                }
+                misssize += sz;
+            }
+
+            d += sz; offset += sz; size -= sz;
+        }
+
+        if (misssize)
+            slow().doRead(missdata, missoffset, misssize);
+    }
+
+    void doWrite(const void *data, VPtrSize offset, VPtrSize size)
+    {
+        const uint8_t *d = static_cast<const uint8_t *>(data);
+        while (size)
+        {
+            const VPtrNum block = offset / blockSize;
+            const VPtrSize boffset = offset % blockSize;
+            const VPtrSize sz = private_utils::minimal(size, (VPtrSize)(blockSize - boffset));
+            const uint16_t slot = getSlot(block);
+
+            if (isCached(slot, block))
+            {
+                fast().doWrite(d, getSlotOffset(slot) + boffset, sz);
+                setDirty(slot, true);
+            }
+            else if (boffset == 0 && sz == getBlockSize(block))
+                storeBlock(block, d, true);
+            else
+                slow().doWrite(d, offset, sz); // partial blocks are not cached
+
+            d += sz; offset += sz; size -= sz;
+        }
+    }
+
+    void doDiscard(const void *data, VPtrSize offset, VPtrSize size)
+    {
+        // cache all complete blocks
+        const uint8_t *d = static_cast<const uint8_t *>(data);
+        VPtrNum block = (offset + blockSize - 1) / blockSize;
+        for (; (block * blockSize) < (offset + size); ++block)
+        {
+            const VPtrNum bstart = block * blockSize;
+            if ((bstart + getBlockSize(block)) > (offset + size))
+                break;
+            storeBlock(block, d + (bstart - offset), false);
+        }
+    }
+
+    void doFlush(void)
+    {
+        for (uint16_t i=0; i<blockCount; ++i)
+        {
+            if (blockTags[i] && isDirty(i))
+                writeBackBlocks(i);
+        }
+        fast().doFlush();
+        slow().doFlush();
+    }
+
+public:
+    /**
+     * @brief Constructs (but not initializes) the allocator.
+     * @param ps Total amount of bytes of the memory pool (i.e. the size of the slow tier).
+     * @sa setPoolSize
+     */
+    TieredVAllocP(VPtrSize ps=VIRTMEM_DEFAULT_POOLSIZE) { this->setPoolSize(ps); }
+
+    FastAlloc &getFastTier(void) { return fastTier; } //!< Returns the allocator of the fast tier, e.g. to configure it.
+    SlowAlloc &getSlowTier(void) { return slowTier; } //!< Returns the allocator of the slow tier, e.g. to configure it.
+};
+
+}
+
+#endif // VIRTMEM_TIERED_ALLOC_H
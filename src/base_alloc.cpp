@@ -9,6 +9,7 @@
  */
 
 #include "internal/base_alloc.h"
+#include "internal/page_policy.h"
 #include "internal/utils.h"
 
 #include <string.h>
@@ -19,8 +20,75 @@
 #include <stdio.h>
 #endif
 
+#ifdef VIRTMEM_TRACE_COUNTERS
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <time.h>
+#endif
+#endif
+
 namespace virtmem {
 
+#ifdef VIRTMEM_TRACE_COUNTERS
+namespace {
+
+uint32_t getMicros(void)
+{
+#if defined(ARDUINO)
+    return micros();
+#elif defined(CLOCK_MONOTONIC)
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return (uint32_t)((uint64_t)clock() * 1000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+// Adds the duration of a backend transfer to a histogram when it goes out of scope
+class IOTimer
+{
+    BaseVAlloc::IOTimes &times;
+    const uint32_t start;
+    bool active;
+
+public:
+    IOTimer(BaseVAlloc::IOTimes &t) : times(t), start(getMicros()), active(true) { }
+    ~IOTimer(void)
+    {
+        if (!active)
+            return;
+
+        const uint32_t duration = getMicros() - start;
+        uint8_t bucket = 0;
+        for (uint32_t d=duration>>4; d && bucket<7; d>>=2)
+            ++bucket;
+        ++times.histogram[bucket];
+        times.totalMicros += duration;
+    }
+    void discard(void) { active = false; } // no transfer took place
+};
+
+}
+
+#define VIRTMEM_COUNT(c) (++counters.c)
+#define VIRTMEM_TIME_IO(t) IOTimer iotimer(counters.t)
+#define VIRTMEM_DISCARD_IO_TIME() iotimer.discard()
+#define VIRTMEM_PAGE_EVENT(e, p) notifyPageEvent(e, p)
+#else
+#define VIRTMEM_COUNT(c)
+#define VIRTMEM_TIME_IO(t)
+#define VIRTMEM_DISCARD_IO_TIME()
+#define VIRTMEM_PAGE_EVENT(e, p)
+#endif
+
+#ifdef VIRTMEM_TRACE_ACCESS
+#define VIRTMEM_TRACE(e, p, s) traceAccess(e, p, s)
+#else
+#define VIRTMEM_TRACE(e, p, s)
+#endif
+
 
 void BaseVAlloc::initPages(PageInfo *info, LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize)
 {
@@ -42,6 +110,20 @@ void BaseVAlloc::initPages(PageInfo *info, LockPage *pages, uint8_t *pool, uint8
     }
 }
 
+void BaseVAlloc::initBigPageTable(int8_t *buckets, int8_t *chain, uint8_t bcount)
+{
+    bigPageTable.buckets = buckets;
+    bigPageTable.chain = chain;
+    bigPageTable.mask = bcount - 1;
+
+    // hash by the largest power of two that fits in a big page
+    bigPageTable.shift = 0;
+    while ((bigPages.size >> (bigPageTable.shift + 1)) != 0)
+        ++bigPageTable.shift;
+
+    resetBigPageTable();
+}
+
 VPtrNum BaseVAlloc::getMem(VPtrSize size)
 {
     size = private_utils::maximal(size, (VPtrSize)MIN_ALLOC_SIZE);
@@ -59,7 +141,7 @@ VPtrNum BaseVAlloc::getMem(VPtrSize size)
         // HACK: increase here to balance the subtraction by free()
         memUsed += totalsize;
 #endif
-        freeRaw(poolFreePos + sizeof(UMemHeader));
+        freeBlock(poolFreePos + sizeof(UMemHeader));
         poolFreePos += totalsize;
     }
     else
@@ -68,6 +150,148 @@ VPtrNum BaseVAlloc::getMem(VPtrSize size)
     return freePointer;
 }
 
+// Marks a range (relative to the page start) of a big page as modified
+void BaseVAlloc::markBigPageDirty(LockPage *page, VPtrSize offset, VPtrSize size)
+{
+    page->dirty = true;
+
+    if (dirtyGranularity && size)
+    {
+        uint8_t *map = getDirtyMap(page);
+        const VirtPageSize last = (offset + size - 1) / dirtyGranularity;
+        for (VirtPageSize bit=offset / dirtyGranularity; bit<=last; ++bit)
+            map[bit / 8] |= (1 << (bit & 7));
+    }
+}
+
+// Marks a complete big page as modified or unmodified
+void BaseVAlloc::setBigPageDirty(LockPage *page, bool dirty)
+{
+    page->dirty = dirty;
+    if (dirtyGranularity)
+        memset(getDirtyMap(page), (dirty) ? 0xFF : 0, dirtyMapSize);
+}
+
+// Finishes any outstanding asynchronous page read
+void BaseVAlloc::completeRead()
+{
+    if (pendingPage != -1)
+    {
+        while (!doPollRead())
+            ;
+        pendingPage = -1;
+    }
+}
+
+// Finishes any outstanding asynchronous page write
+void BaseVAlloc::completeWrite()
+{
+    if (pendingWriteSize)
+    {
+        while (!doPollWrite())
+            ;
+        pendingWriteSize = 0;
+    }
+}
+
+// Finishes an outstanding asynchronous write if it overlaps with the given range, as this data
+// may only be accessed afterwards
+void BaseVAlloc::waitForWrite(VPtrNum offset, VPtrSize size)
+{
+    if (pendingWriteSize && offset < (pendingWriteStart + pendingWriteSize) && pendingWriteStart < (offset + size))
+        completeWrite();
+}
+
+// Zero fills the part of a block that was never written to the backend (i.e. at or above
+// writtenEnd). Returns the amount of bytes that still need to be read.
+VPtrSize BaseVAlloc::zeroUnwritten(void *data, VPtrNum offset, VPtrSize size) const
+{
+    if ((offset + size) <= writtenEnd)
+        return size;
+
+    const VPtrSize rdsize = (offset < writtenEnd) ? (writtenEnd - offset) : 0;
+    memset(static_cast<uint8_t *>(data) + rdsize, 0, size - rdsize);
+    return rdsize;
+}
+
+// Writes zeros to the backend from writtenEnd up to offset, as data below writtenEnd is read from
+// the backend, which may hold anything (e.g. a new file or uninitialized SPI RAM). This is
+// called before data beyond writtenEnd is written.
+void BaseVAlloc::fillUnwritten(VPtrNum offset)
+{
+    if (offset <= writtenEnd)
+        return;
+
+    uint8_t zeros[ZERO_FILL_SIZE];
+    memset(zeros, 0, sizeof(zeros));
+    VIRTMEM_TIME_IO(writes);
+    for (; writtenEnd < offset; )
+    {
+        const VPtrSize size = private_utils::minimal((VPtrSize)sizeof(zeros), (VPtrSize)(offset - writtenEnd));
+        doWrite(zeros, writtenEnd, size);
+        writtenEnd += size;
+    }
+}
+
+// NOTE: all backend IO should go via the following functions, as backends cannot process other
+// requests while an asynchronous read is in progress, and data that is written asynchronously
+// may not be accessed.
+void BaseVAlloc::readBackend(void *data, VPtrNum offset, VPtrSize size)
+{
+    completeRead();
+    waitForWrite(offset, size);
+    size = zeroUnwritten(data, offset, size);
+    if (size)
+    {
+        VIRTMEM_TIME_IO(reads);
+        doRead(data, offset, size);
+    }
+}
+
+void BaseVAlloc::writeBackend(const void *data, VPtrNum offset, VPtrSize size)
+{
+    completeRead();
+    waitForWrite(offset, size);
+    fillUnwritten(offset);
+    VIRTMEM_TIME_IO(writes);
+    doWrite(data, offset, size);
+    if ((offset + size) > writtenEnd)
+        writtenEnd = offset + size;
+}
+
+// Writes multiple blocks at once if supported by the allocator
+void BaseVAlloc::writeBackendV(IOBlock *blocks, uint8_t count)
+{
+    completeRead();
+    for (uint8_t i=0; i<count; ++i)
+    {
+        waitForWrite(blocks[i].offset, blocks[i].size);
+        fillUnwritten(blocks[i].offset);
+        // NOTE: the block is written below, so only gaps between blocks are filled
+        if ((blocks[i].offset + blocks[i].size) > writtenEnd)
+            writtenEnd = blocks[i].offset + blocks[i].size;
+    }
+    VIRTMEM_TIME_IO(writes);
+    if (count == 1 || !doWriteV(blocks, count))
+    {
+        for (uint8_t i=0; i<count; ++i)
+            doWrite(blocks[i].data, blocks[i].offset, blocks[i].size);
+    }
+
+#ifdef VIRTMEM_TRACE_STATS
+    for (uint8_t i=0; i<count; ++i)
+        bytesWritten += blocks[i].size;
+#endif
+}
+
+void BaseVAlloc::writeBigPage(LockPage *page, VPtrSize offset, VPtrSize size)
+{
+    writeBackend(page->pool + offset, page->start + offset, size);
+#ifdef VIRTMEM_TRACE_STATS
+    bytesWritten += size;
+#endif
+}
+
 void BaseVAlloc::syncBigPage(LockPage *page)
 {
     ASSERT(page->start != 0);
@@ -75,13 +299,49 @@ void BaseVAlloc::syncBigPage(LockPage *page)
     if (page->dirty)
     {
 //        std::cout << "dirty page\n";
-        const VirtPageSize wrsize = private_utils::minimal((poolSize - page->start), (VPtrSize)bigPages.size);
-        doWrite(page->pool, page->start, wrsize);
-        page->dirty = false;
+        const VPtrSize wrsize = private_utils::minimal((VPtrSize)(poolSize - page->start), (VPtrSize)page->size);
+
+        if (!dirtyGranularity)
+            writeBigPage(page, 0, wrsize);
+        else
+        {
+            // only write modified blocks, adjacent blocks are written at once. All spans of
+            // modified blocks are passed to the allocator in one go (see doWriteV())
+            const uint8_t *map = getDirtyMap(page);
+            IOBlock blocks[MAX_IO_BLOCKS];
+            uint8_t count = 0;
+            VPtrSize spanstart = wrsize;
+            for (VPtrSize offset=0; offset<wrsize || spanstart!=wrsize; offset+=dirtyGranularity)
+            {
+                const VirtPageSize bit = offset / dirtyGranularity;
+                if (offset < wrsize && (map[bit / 8] & (1 << (bit & 7))))
+                {
+                    if (spanstart == wrsize)
+                        spanstart = offset;
+                }
+                else if (spanstart != wrsize)
+                {
+                    blocks[count].data = page->pool + spanstart;
+                    blocks[count].offset = page->start + spanstart;
+                    blocks[count].size = private_utils::minimal(offset, wrsize) - spanstart;
+                    if (++count == MAX_IO_BLOCKS)
+                    {
+                        writeBackendV(blocks, count);
+                        count = 0;
+                    }
+                    spanstart = wrsize;
+                }
+            }
+
+            if (count)
+                writeBackendV(blocks, count);
+        }
+
+        setBigPageDirty(page, false);
         page->cleanSkips = 0;
+        VIRTMEM_PAGE_EVENT(PAGE_WRITE, page);
 #ifdef VIRTMEM_TRACE_STATS
         ++bigPageWrites;
-        bytesWritten += wrsize;
 #endif
     }
 }
@@ -92,37 +352,35 @@ void BaseVAlloc::copyRawData(void *dest, VPtrNum p, VPtrSize size)
     // Note that the size of these pages are never smaller than the copy size,
     // so it is impossible that more than two pages overlap
 
-    for (int8_t i=bigPages.freeIndex; i!=-1 && size; i=bigPages.pages[i].next)
+    int8_t index = findBigPage(p);
+    if (index != -1) // start address within this page?
     {
-        if (!bigPages.pages[i].start)
-            continue;
+        waitForPage(index);
+        const LockPage &page = bigPages.pages[index];
+        const VPtrSize offset = p - page.start;
+        const VPtrSize copysize = private_utils::minimal(size, (VPtrSize)(page.size - offset));
+        memcpy(dest, page.pool + offset, copysize);
+
+        // move start to end of this page
+        dest = (uint8_t *)dest + copysize;
+        p += copysize;
+        size -= copysize;
+    }
 
-        const VPtrNum pageend = bigPages.pages[i].start + bigPages.size;
-        if (p >= bigPages.pages[i].start && p < pageend) // start address within this page?
-        {
-            const VPtrSize offset = p - bigPages.pages[i].start;
-            const VPtrSize copysize = private_utils::minimal(size, bigPages.pages[i].size - offset);
-            memcpy(dest, bigPages.pages[i].pool + offset, copysize);
-
-            // move start to end of this page
-            dest = (uint8_t *)dest + copysize;
-            p += copysize;
-            size -= copysize;
-        }
-        // end overlaps?
-        else if (p < bigPages.pages[i].start && (p + size) > bigPages.pages[i].start)
-        {
-            const VPtrSize offset = bigPages.pages[i].start - p;
-            const VPtrSize copysize = private_utils::minimal(size - offset, (VPtrSize)bigPages.pages[i].size);
-            memcpy((uint8_t *)dest + offset, bigPages.pages[i].pool, copysize);
-            size = offset;
-        }
+    // end overlaps?
+    if (size > 0 && (index = findBigPage(p + size - 1)) != -1)
+    {
+        waitForPage(index);
+        const LockPage &page = bigPages.pages[index];
+        const VPtrSize offset = page.start - p;
+        memcpy((uint8_t *)dest + offset, page.pool, size - offset);
+        size = offset;
     }
 
     if (size > 0)
     {
         // read in rest of the data
-        doRead(dest, p, size);
+        readBackend(dest, p, size);
 #ifdef VIRTMEM_TRACE_STATS
         bytesRead += size;
 #endif
@@ -132,98 +390,105 @@ void BaseVAlloc::copyRawData(void *dest, VPtrNum p, VPtrSize size)
 // This function is the reverse of copyRawData()
 void BaseVAlloc::saveRawData(void *src, VPtrNum p, VPtrSize size)
 {
-    for (int8_t i=bigPages.freeIndex; i!=-1 && size; i=bigPages.pages[i].next)
+    int8_t index = findBigPage(p);
+    if (index != -1) // start address within this page?
     {
-        if (!bigPages.pages[i].start)
-            continue;
+        waitForPage(index);
+        LockPage &page = bigPages.pages[index];
+        const VPtrSize offset = p - page.start;
+        const VPtrSize copysize = private_utils::minimal(size, (VPtrSize)(page.size - offset));
 
-        const VPtrNum pageend = bigPages.pages[i].start + bigPages.size;
-        if (p >= bigPages.pages[i].start && p < pageend) // start address within this page?
+        // only copy data if regular page is already dirty or data changed
+        if (page.dirty || memcmp(page.pool + offset, src, copysize) != 0)
         {
-            const VPtrSize offset = p - bigPages.pages[i].start;
-            const VPtrSize copysize = private_utils::minimal(size, bigPages.pages[i].size - offset);
-
-            // only copy data if regular page is already dirty or data changed
-            if (bigPages.pages[i].dirty || memcmp(bigPages.pages[i].pool + offset, src, copysize) != 0)
-            {
-                memcpy(bigPages.pages[i].pool + offset, src, copysize);
-                bigPages.pages[i].dirty = true;
-            }
-
-            // move start to end of this page
-            src = (uint8_t *)src + copysize;
-            p += copysize;
-            size -= copysize;
+            memcpy(page.pool + offset, src, copysize);
+            markBigPageDirty(&page, offset, copysize);
         }
-        // end overlaps?
-        else if (p < bigPages.pages[i].start && (p + size) > bigPages.pages[i].start)
-        {
-            const VPtrSize offset = bigPages.pages[i].start - p;
-            const VPtrSize copysize = private_utils::minimal(size - offset, (VPtrSize)bigPages.pages[i].size);
 
-            // only copy data if regular page is already dirty or data changed
-            if (bigPages.pages[i].dirty || memcmp(bigPages.pages[i].pool, (uint8_t *)src + offset, copysize) != 0)
-            {
-                memcpy(bigPages.pages[i].pool, (uint8_t *)src + offset, copysize);
-                bigPages.pages[i].dirty = true;
-            }
+        // move start to end of this page
+        src = (uint8_t *)src + copysize;
+        p += copysize;
+        size -= copysize;
+    }
 
-            size = offset;
+    // end overlaps?
+    if (size > 0 && (index = findBigPage(p + size - 1)) != -1)
+    {
+        waitForPage(index);
+        LockPage &page = bigPages.pages[index];
+        const VPtrSize offset = page.start - p;
+        const VPtrSize copysize = size - offset;
+
+        // only copy data if regular page is already dirty or data changed
+        if (page.dirty || memcmp(page.pool, (uint8_t *)src + offset, copysize) != 0)
+        {
+            memcpy(page.pool, (uint8_t *)src + offset, copysize);
+            markBigPageDirty(&page, 0, copysize);
         }
+
+        size = offset;
     }
 
     if (size > 0)
     {
         // read in rest of the data
-        doWrite(src, p, size);
+        writeBackend(src, p, size);
 #ifdef VIRTMEM_TRACE_STATS
         bytesWritten += size;
 #endif
     }
 }
 
-void *BaseVAlloc::pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forcestart)
+// If nofetch is set the caller overwrites all data in the given range: a page that is loaded
+// for this range is then not read if the range covers the whole page.
+void *BaseVAlloc::pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forcestart, bool nofetch)
 {
     ASSERT(p && p < poolSize);
 
     /* If a page is found which fits within the pointer: take that and abort search; no overlap can occur
-     * If a page partially overlaps take that, as it has to be cleared out anyway. Keep searching for
-     * other overlapping pages.
+     * If a page partially overlaps take that, as it has to be cleared out anyway. Since loaded pages never
+     * overlap each other, at most two pages (one at the start and one at the end) can be found.
      * Otherwise if an empty page is found use it but keep searching for the above.
      * Otherwise if a 'clean' page is found use that but keep searching for the above.
      * Otherwise look for dirty pages in a FIFO way. */
 
     int8_t pageindex = -1;
     enum { STATE_GOTFULL, STATE_GOTPARTIAL, STATE_GOTEMPTY, STATE_GOTCLEAN, STATE_GOTDIRTY, STATE_GOTNONE } pagefindstate = STATE_GOTNONE;
+    VPtrNum newstart;
+    VirtPageSize newsize;
 
     // Start by looking for fitting pages, the ideal situation
-    if ((pageindex = findFreePage(&bigPages, p, size, forcestart)) != -1)
+    if ((pageindex = findFreePage(p, size, forcestart)) != -1)
+    {
         pagefindstate = STATE_GOTFULL;
+        VIRTMEM_COUNT(pageHits[PAGE_BIG]);
+        if (pagePolicy)
+            pagePolicy->pageAccessed(pageindex);
+    }
     else
     {
-        const VPtrNum newpageend = p + bigPages.size;
+        getBigPageRange(p, size, forcestart, newstart, newsize);
 
-        for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+        const int8_t overlaps[2] = { findBigPage(newstart), findBigPage(newstart + newsize - 1) };
+        for (uint8_t i=0; i<2; ++i)
         {
-            if (bigPages.pages[i].start != 0)
+            if (overlaps[i] != -1 && overlaps[i] != pageindex)
             {
-                const VPtrNum pageend = bigPages.pages[i].start + bigPages.size;
-                if ((p >= bigPages.pages[i].start && p < pageend) ||
-                    (newpageend >= bigPages.pages[i].start && newpageend <= pageend))
-                {
-                    pageindex = i;
-                    syncBigPage(&bigPages.pages[pageindex]);
-                    bigPages.pages[i].start = 0; // invalidate
-                    pagefindstate = STATE_GOTPARTIAL;
-                }
+                pageindex = overlaps[i];
+                invalidateBigPage(pageindex);
+                pagefindstate = STATE_GOTPARTIAL;
+                VIRTMEM_COUNT(partialEvictions);
             }
-            else if (pagefindstate != STATE_GOTPARTIAL)
+        }
+
+        for (int8_t i=bigPages.freeIndex; i!=-1 && pagefindstate > STATE_GOTEMPTY; i=bigPages.pages[i].next)
+        {
+            if (bigPages.pages[i].start == 0)
             {
                 pageindex = i;
                 pagefindstate = STATE_GOTEMPTY;
             }
-
-            if (pagefindstate > STATE_GOTCLEAN)
+            else if (pagefindstate > STATE_GOTCLEAN && !pagePolicy)
             {
                 if (!bigPages.pages[i].dirty || (++bigPages.pages[i].cleanSkips) >= PAGE_MAX_CLEAN_SKIPS)
                 {
@@ -239,6 +504,13 @@ void *BaseVAlloc::pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forc
         }
     }
 
+    // no empty or overlapping pages? let the replacement policy decide (if any)
+    if (pagePolicy && pagefindstate == STATE_GOTNONE)
+    {
+        pageindex = pagePolicy->selectVictim();
+        pagefindstate = STATE_GOTCLEAN;
+    }
+
     // 'pageindex' should now point to page which is within or closest to pointer range
     ASSERT(pageindex != -1);
 
@@ -247,9 +519,6 @@ void *BaseVAlloc::pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forc
     {
 //        std::cout << "getPool switches " << (page - memPageList) << " from: " << page->start << " to " << p << std::endl;
 
-        if (bigPages.pages[pageindex].start != 0)
-            syncBigPage(&bigPages.pages[pageindex]);
-
         if (pagefindstate == STATE_GOTDIRTY)
         {
             nextPageToSwap = bigPages.pages[pageindex].next;
@@ -259,31 +528,27 @@ void *BaseVAlloc::pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forc
         else
             nextPageToSwap = bigPages.freeIndex;
 
-        // Load in page
-        if (/*!forcestart*/false) // check alignment UNDONE
-        {
-            const VPtrNum alignp = p - (p & (sizeof(TAlign) - 1));
-            if ((alignp + bigPages.size) >= (p + size))
-                bigPages.pages[pageindex].start = alignp;
-            else
-                bigPages.pages[pageindex].start = p;
-        }
-        else
-            bigPages.pages[pageindex].start = p;
+        // sequential access? (i.e. new page starts in or right after the previously loaded page)
+        const bool sequential = (newstart <= lastLoadEnd && (newstart + newsize) > lastLoadEnd);
+        lastLoadEnd = newstart + newsize;
 
-//        std::cout << "start: " << bigPages.pages[pageindex].start <<"/" << p << std::endl;
+        // no need to read a page that will be overwritten completely
+        const VPtrNum newend = newstart + private_utils::minimal((VPtrSize)(poolSize - newstart), (VPtrSize)newsize);
+        const bool fetch = !nofetch || p > newstart || (p + size) < newend;
 
-        const VirtPageSize rdsize = private_utils::minimal((poolSize - bigPages.pages[pageindex].start), (VPtrSize)bigPages.size);
-        doRead(bigPages.pages[pageindex].pool, bigPages.pages[pageindex].start, rdsize);
+        loadBigPage(pageindex, newstart, newsize, false, fetch);
+        VIRTMEM_COUNT(pageMisses[PAGE_BIG]);
 
-#ifdef VIRTMEM_TRACE_STATS
-        ++bigPageReads;
-        bytesRead += rdsize;
-#endif
+        if (readAhead && sequential && !forcestart && fetch)
+            readAheadPages(pageindex);
     }
+    else if (readAhead && bigPages.pages[pageindex].start == readAheadStart)
+        readAheadPages(pageindex); // first access of a page that was read ahead: keep reading ahead
 
     if (!readonly)
-        bigPages.pages[pageindex].dirty = true;
+        markBigPageDirty(&bigPages.pages[pageindex], p - bigPages.pages[pageindex].start, size);
+
+    mruBigPage = pageindex;
 
     ASSERT(p >= bigPages.pages[pageindex].start);
 
@@ -295,9 +560,189 @@ void *BaseVAlloc::pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forc
     return &((uint8_t *)bigPages.pages[pageindex].pool)[p - bigPages.pages[pageindex].start];
 }
 
+// Determines the address range of a new big page that should contain the given data
+void BaseVAlloc::getBigPageRange(VPtrNum p, VPtrSize size, bool forcestart, VPtrNum &start, VirtPageSize &psize) const
+{
+    start = p;
+    psize = bigPages.size;
+
+    if (alignBigPages && !forcestart)
+    {
+        // start page at a page boundary, unless the data doesn't fit. The first page is shortened
+        // as address zero is never used.
+        VPtrNum alignp = p - (p % bigPages.size);
+        VirtPageSize alignsize = bigPages.size;
+        if (alignp == 0)
+        {
+            alignp = START_OFFSET;
+            alignsize -= START_OFFSET;
+        }
+
+        if ((p + size) <= (alignp + alignsize))
+        {
+            start = alignp;
+            psize = alignsize;
+        }
+    }
+}
+
+// (Re)loads an unlocked big page with new data. If async is set an asynchronous read is started if
+// supported by the allocator. If fetch is not set no data is read, i.e. the page contents are
+// undefined and should be overwritten by the caller.
+void BaseVAlloc::loadBigPage(int8_t index, VPtrNum start, VirtPageSize size, bool async, bool fetch)
+{
+    LockPage &page = bigPages.pages[index];
+
+    if (page.start != 0)
+    {
+        if (!page.dirty)
+        {
+            waitForPage(index);
+            doDiscard(page.pool, page.start, private_utils::minimal((VPtrSize)(poolSize - page.start), (VPtrSize)page.size));
+        }
+        invalidateBigPage(index);
+    }
+
+    page.start = start;
+    page.size = size;
+    addBigPageToTable(index);
+    VIRTMEM_PAGE_EVENT(PAGE_LOAD, &page);
+
+//        std::cout << "start: " << page.start << std::endl;
+
+    if (fetch)
+        fetchBigPage(index, async);
+    else
+        waitForPage(index); // the page pool may still be written by an asynchronous read
+}
+
+// Reads the data of a (re)loaded big page
+void BaseVAlloc::fetchBigPage(int8_t index, bool async)
+{
+    LockPage &page = bigPages.pages[index];
+
+    completeRead();
+    const VirtPageSize rdsize = zeroUnwritten(page.pool, page.start, private_utils::minimal((VPtrSize)(poolSize - page.start), (VPtrSize)page.size));
+    if (!rdsize)
+        return; // never written: no need to read anything
+
+    // a page that is written back asynchronously may be reloaded right away
+    waitForWrite(page.start, rdsize);
+
+    if (async && doReadAsync(page.pool, page.start, rdsize))
+        pendingPage = index;
+    else
+    {
+        VIRTMEM_TIME_IO(reads);
+        doRead(page.pool, page.start, rdsize);
+    }
+
+#ifdef VIRTMEM_TRACE_STATS
+    ++bigPageReads;
+    bytesRead += rdsize;
+#endif
+}
+
+// Reads the data of multiple (re)loaded big pages, with a single request if supported by the
+// allocator (see doReadV()). Otherwise pages are read asynchronously (if supported).
+void BaseVAlloc::fetchBigPages(const int8_t *indices, uint8_t count)
+{
+    if (count > 1)
+    {
+        completeRead();
+
+        IOBlock blocks[MAX_IO_BLOCKS];
+        uint8_t bcount = 0;
+        for (uint8_t i=0; i<count; ++i)
+        {
+            LockPage &page = bigPages.pages[indices[i]];
+            blocks[bcount].data = page.pool;
+            blocks[bcount].offset = page.start;
+            blocks[bcount].size = zeroUnwritten(page.pool, page.start, private_utils::minimal((VPtrSize)(poolSize - page.start), (VPtrSize)page.size));
+            if (blocks[bcount].size)
+            {
+                waitForWrite(blocks[bcount].offset, blocks[bcount].size);
+                ++bcount;
+            }
+        }
+
+        if (bcount == 0)
+            return;
+
+        VIRTMEM_TIME_IO(reads);
+        if (bcount > 1 && doReadV(blocks, bcount))
+        {
+#ifdef VIRTMEM_TRACE_STATS
+            for (uint8_t i=0; i<bcount; ++i)
+            {
+                ++bigPageReads;
+                bytesRead += blocks[i].size;
+            }
+#endif
+            return;
+        }
+        VIRTMEM_DISCARD_IO_TIME();
+    }
+
+    for (uint8_t i=0; i<count; ++i)
+        fetchBigPage(indices[i], true);
+}
+
+// Prefetches the pages following a page that is sequentially accessed
+void BaseVAlloc::readAheadPages(int8_t index)
+{
+    const VPtrNum end = bigPages.pages[index].start + bigPages.pages[index].size;
+    lastBigPage = index; // make sure this page is kept
+    readAheadStart = end;
+    prefetch(end, (VPtrSize)readAhead * bigPages.size);
+}
+
+// Returns whether a page may be replaced by prefetched data. Pages with data in the given range
+// (i.e. data that was just prefetched) and the page that was last used are kept.
+bool BaseVAlloc::canPrefetchInPage(int8_t index, VPtrNum keepstart, VPtrNum keepend) const
+{
+    const LockPage &page = bigPages.pages[index];
+    return index != lastBigPage && !page.dirty && (page.start < keepstart || page.start >= keepend);
+}
+
+// Returns an empty or unmodified page that can be used to prefetch data, or -1 if there is none
+int8_t BaseVAlloc::findPrefetchPage(VPtrNum keepstart, VPtrNum keepend)
+{
+    int8_t ret = -1;
+    for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    {
+        if (bigPages.pages[i].start == 0)
+            return i;
+        else if (ret == -1 && !pagePolicy && canPrefetchInPage(i, keepstart, keepend))
+            ret = i;
+    }
+
+    if (pagePolicy)
+    {
+        ret = pagePolicy->selectVictim();
+        if (ret != -1 && !canPrefetchInPage(ret, keepstart, keepend))
+            ret = -1;
+    }
+
+    return ret;
+}
+
+// Returns whether a page contains data within the given range. If so, ostart and osize are set to
+// the overlapping range.
+bool BaseVAlloc::getPageOverlap(const LockPage *page, VPtrNum p, VPtrSize size, VPtrNum &ostart, VPtrSize &osize) const
+{
+    ostart = private_utils::maximal(p, page->start);
+    const VPtrNum oend = private_utils::minimal(p + size, page->start + page->size);
+    if (page->start == 0 || ostart >= oend)
+        return false;
+    osize = oend - ostart;
+    return true;
+}
+
 void BaseVAlloc::pushRawData(VPtrNum p, const void *d, VPtrSize size)
 {
-    void *pool = pullRawData(p, size, false, false);
+    // the page doesn't have to be read if the data covers it, as all data is overwritten below
+    void *pool = pullRawData(p, size, false, false, true);
     memcpy(pool, d, size);
 }
 
@@ -316,19 +761,136 @@ void BaseVAlloc::updateHeader(VPtrNum p, UMemHeader *h)
         write(p, h, sizeof(UMemHeader));
 }
 
-int8_t BaseVAlloc::findFreePage(BaseVAlloc::PageInfo *pinfo, VPtrNum p, VPtrSize size, bool atstart)
+void BaseVAlloc::resetBigPageTable()
 {
-    const VPtrNum pend = p + size;
-    for (int8_t i=pinfo->freeIndex; i!=-1; i=pinfo->pages[i].next)
+    memset(bigPageTable.buckets, -1, bigPageTable.mask + 1);
+    if (pagePolicy)
+        pagePolicy->reset();
+}
+
+void BaseVAlloc::addBigPageToTable(int8_t index)
+{
+    ASSERT(bigPages.pages[index].start != 0);
+    // findBigPage() relies on unlocked pages never overlapping
+    ASSERT(!overlapsBigPages(bigPages.pages[index].start, bigPages.pages[index].size, index));
+    int8_t &bucket = bigPageTable.buckets[(bigPages.pages[index].start >> bigPageTable.shift) & bigPageTable.mask];
+    bigPageTable.chain[index] = bucket;
+    bucket = index;
+
+    // the table contains exactly those pages that may be replaced
+    if (pagePolicy)
+        pagePolicy->pageAdded(index);
+}
+
+void BaseVAlloc::removeBigPageFromTable(int8_t index)
+{
+    int8_t *i = &bigPageTable.buckets[(bigPages.pages[index].start >> bigPageTable.shift) & bigPageTable.mask];
+    for (; *i!=index; i=&bigPageTable.chain[*i])
+        ASSERT(*i != -1);
+    *i = bigPageTable.chain[index];
+
+    if (pagePolicy)
+        pagePolicy->pageRemoved(index);
+    if (index == mruBigPage)
+        mruBigPage = -1;
+}
+
+// Synchronizes a (unlocked) big page and marks it as empty
+void BaseVAlloc::invalidateBigPage(int8_t index)
+{
+    LockPage &page = bigPages.pages[index];
+
+    // The page contents are discarded, so a modified page can be written back asynchronously from
+    // its current pool while the page continues with the spare buffer. Only complete pages are
+    // written this way, as the dirty map may cover data that was never fetched.
+    if (writeBackBuffer && page.dirty && !dirtyGranularity)
     {
-        if (pinfo->pages[i].start != 0 && ((atstart && pinfo->pages[i].start == p) ||
-            (!atstart && p >= pinfo->pages[i].start && pend <= (pinfo->pages[i].start + pinfo->pages[i].size))))
-            return i;
+        completeRead(); // no other requests while a read is outstanding
+        completeWrite(); // the spare buffer may still be written
+        fillUnwritten(page.start);
+        const VPtrSize wrsize = private_utils::minimal((VPtrSize)(poolSize - page.start), (VPtrSize)page.size);
+        if (doWriteAsync(page.pool, page.start, wrsize))
+        {
+            uint8_t *pool = page.pool;
+            page.pool = writeBackBuffer;
+            writeBackBuffer = pool;
+            pendingWriteStart = page.start;
+            pendingWriteSize = wrsize;
+
+            if ((page.start + wrsize) > writtenEnd)
+                writtenEnd = page.start + wrsize;
+            setBigPageDirty(&page, false);
+            page.cleanSkips = 0;
+            VIRTMEM_PAGE_EVENT(PAGE_WRITE, &page);
+#ifdef VIRTMEM_TRACE_STATS
+            ++bigPageWrites;
+            bytesWritten += wrsize;
+#endif
+        }
+    }
+
+    syncBigPage(&page);
+    VIRTMEM_PAGE_EVENT(PAGE_EVICT, &page);
+    removeBigPageFromTable(index);
+    page.start = 0;
+}
+
+// Returns the unlocked big page that contains p, or -1 if there is none
+int8_t BaseVAlloc::findBigPage(VPtrNum p) const
+{
+    // Pages are at most twice the size used for hashing, hence, a page containing p can only start
+    // in the same or in the two preceeding table slots.
+    const VPtrNum key = p >> bigPageTable.shift;
+    for (uint8_t k=0; k<3 && k<=key; ++k)
+    {
+        for (int8_t i=bigPageTable.buckets[(key - k) & bigPageTable.mask]; i!=-1; i=bigPageTable.chain[i])
+        {
+            if (p >= bigPages.pages[i].start && (p - bigPages.pages[i].start) < bigPages.pages[i].size)
+                return i;
+        }
+    }
+
+    return -1;
+}
+
+// Returns whether any unlocked big page (except skip) contains data within the given range
+bool BaseVAlloc::overlapsBigPages(VPtrNum p, VPtrSize size, int8_t skip) const
+{
+    for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
+    {
+        VPtrNum ostart;
+        VPtrSize osize;
+        if (i != skip && getPageOverlap(&bigPages.pages[i], p, size, ostart, osize))
+            return true;
+    }
+    return false;
+}
+
+int8_t BaseVAlloc::findFreePage(VPtrNum p, VPtrSize size, bool atstart)
+{
+    // the most recently used page is the most likely candidate
+    int8_t index = mruBigPage;
+    if (index == -1 || p < bigPages.pages[index].start || (p - bigPages.pages[index].start) >= bigPages.pages[index].size)
+        index = findBigPage(p);
+
+    if (index != -1 && (!atstart || bigPages.pages[index].start == p) &&
+        (p + size) <= (bigPages.pages[index].start + bigPages.pages[index].size))
+    {
+        waitForPage(index);
+        mruBigPage = index;
+        return index;
     }
 
     return -1;
 }
 
+// Returns whether a page starts at a page boundary (only relevant if alignBigPages is set)
+bool BaseVAlloc::isAlignedBigPage(const LockPage *page) const
+{
+    return (page->start == START_OFFSET && page->size == (bigPages.size - START_OFFSET)) ||
+            (page->start % bigPages.size) == 0;
+}
+
 int8_t BaseVAlloc::findUnusedLockedPage(PageInfo *pinfo)
 {
     for (int8_t i=pinfo->lockedIndex; i!=-1; i=pinfo->pages[i].next)
@@ -349,7 +911,7 @@ void BaseVAlloc::syncLockedPage(BaseVAlloc::LockPage *page)
         saveRawData(page->pool, page->start, page->size);
 #else
         void *data = pullRawData(page->start, page->size, true, false);
-        const int8_t pageindex = findFreePage(&bigPages, page->start, page->size, false);
+        const int8_t pageindex = findFreePage(page->start, page->size, false);
         ASSERT(pageindex != -1);
 
         // only copy data if regular page is already dirty or data changed
@@ -364,7 +926,9 @@ void BaseVAlloc::syncLockedPage(BaseVAlloc::LockPage *page)
     }
 }
 
-int8_t BaseVAlloc::lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size)
+// Locks a free page. If nofetch is set the caller overwrites all locked data, hence, big pages do not
+// have to be read.
+int8_t BaseVAlloc::lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size, bool nofetch)
 {
     int8_t index;
 
@@ -372,10 +936,13 @@ int8_t BaseVAlloc::lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size)
     {
         // read in data and lock the page that was used
         // NOTE: set readonly here, the eventual ro flag should be set afterwards
-        pullRawData(ptr, size, true, true);
-        index = findFreePage(pinfo, ptr, size, true);
+        // NOTE: data outside a smaller lock is discarded when the lock is released, so with nofetch
+        // the complete page may be claimed without reading it.
+        pullRawData(ptr, (nofetch) ? pinfo->size : size, true, true, nofetch);
+        index = findFreePage(ptr, size, true);
         if (size < pinfo->size)
             syncBigPage(&bigPages.pages[index]); // synchronize if there is data outside lock range
+        removeBigPageFromTable(index); // only unlocked pages are stored in the table
     }
     else
         index = pinfo->freeIndex;
@@ -411,6 +978,28 @@ int8_t BaseVAlloc::freeLockedPage(BaseVAlloc::PageInfo *pinfo, int8_t index)
         // restore as regular unused free page
         pinfo->pages[index].start = 0;
         pinfo->pages[index].size = pinfo->size;
+        setBigPageDirty(&pinfo->pages[index], false);
+    }
+    else
+    {
+        // modifications while locked are not tracked
+        setBigPageDirty(&pinfo->pages[index], pinfo->pages[index].dirty);
+
+        // The page will be re-used for regular IO: invalidate any other big pages that were loaded
+        // in the same range while this page was locked, as they may contain outdated data.
+        LockPage &page = pinfo->pages[index];
+        int8_t i;
+        while ((i = findBigPage(page.start)) != -1 || (i = findBigPage(page.start + page.size - 1)) != -1)
+            invalidateBigPage(i);
+
+        // Locked pages are never aligned: don't keep them around in aligned mode so pages cannot overlap
+        if (alignBigPages && !isAlignedBigPage(&page))
+        {
+            syncBigPage(&page);
+            page.start = 0;
+        }
+        else
+            addBigPageToTable(index);
     }
 
     const int8_t ret = pinfo->pages[index].next;
@@ -432,6 +1021,7 @@ int8_t BaseVAlloc::freeLockedPage(BaseVAlloc::PageInfo *pinfo, int8_t index)
         nextPageToSwap = pinfo->freeIndex;
 
     pinfo->pages[index].locks = 0;
+    invalidateLockedRange();
 
     return ret;
 }
@@ -447,6 +1037,38 @@ int8_t BaseVAlloc::findLockedPage(PageInfo *pinfo, VPtrNum p)
     return -1;
 }
 
+// Returns whether the given range may overlap with a page from any of the locked lists
+bool BaseVAlloc::inLockedRange(VPtrNum p, VPtrSize size)
+{
+    if (!lockedRangeValid)
+    {
+        lockedRangeStart = lockedRangeEnd = 0;
+
+        PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
+        for (uint8_t pindex=0; pindex<3; ++pindex)
+        {
+            for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+            {
+                const LockPage &page = plist[pindex]->pages[i];
+                if (lockedRangeStart == lockedRangeEnd)
+                {
+                    lockedRangeStart = page.start;
+                    lockedRangeEnd = page.start + page.size;
+                }
+                else
+                {
+                    lockedRangeStart = private_utils::minimal(lockedRangeStart, page.start);
+                    lockedRangeEnd = private_utils::maximal(lockedRangeEnd, (VPtrNum)(page.start + page.size));
+                }
+            }
+        }
+
+        lockedRangeValid = true;
+    }
+
+    return p < lockedRangeEnd && (p + size) > lockedRangeStart;
+}
+
 BaseVAlloc::LockPage *BaseVAlloc::findLockedPage(VPtrNum p)
 {
     int8_t index = findLockedPage(&smallPages, p);
@@ -483,17 +1105,135 @@ uint8_t BaseVAlloc::getUnlockedPages(const PageInfo *pinfo) const
 
 /**
  * @brief Writes zeros to raw virtual memory. Can be used to initialize the memory pool.
+ *
+ * Note that this is normally not needed: data that was never written since \ref start() is
+ * not read from the memory pool, but zero filled instead. Allocators should merely make sure
+ * that the pool is of the right size, in which case this function may be used to extend it.
  * @param start Start address
  * @param n Amount of bytes (zeros) to write
  */
 void BaseVAlloc::writeZeros(VPtrNum start, VPtrSize n)
 {
+    // NOTE: called from doStart(), i.e. before directData is set
+    uint8_t *direct = static_cast<uint8_t *>(doGetDirectData());
+    if (direct)
+    {
+        memset(direct + start, 0, n);
+        return;
+    }
+
     ASSERT(bigPages.pages[0].start == 0);
 
     // Use zeroed page as buffer
     memset(bigPages.pages[0].pool, 0, bigPages.size);
+    // NOTE: doWrite() is used directly, since the zeros don't have to be read back (see writeBackend())
     for (VPtrSize i=0; i<n; i+=bigPages.size)
-        doWrite(bigPages.pages[0].pool, start + i, private_utils::minimal(n - i, (VPtrSize)bigPages.size));
+        doWrite(bigPages.pages[0].pool, start + i, private_utils::minimal((VPtrSize)(n - i), (VPtrSize)bigPages.size));
+}
+
+// Size of the allocator state stored in persistent mode
+VPtrSize BaseVAlloc::getPersistentDataSize() const
+{
+    return sizeof(PersistentHeader) + (slabCount * sizeof(Slab)) + (slabCount * slabMapSize);
+}
+
+// Returns the address of the first memory block. In persistent mode the allocator state is stored
+// in front of it (at START_OFFSET).
+VPtrNum BaseVAlloc::getHeapStart() const
+{
+    if (!persistent)
+        return START_OFFSET;
+
+    // round up so blocks remain aligned
+    const VPtrSize quantity = (getPersistentDataSize() + sizeof(UMemHeader) - 1) / sizeof(UMemHeader);
+    return START_OFFSET + quantity * sizeof(UMemHeader);
+}
+
+// FNV-1a hash over the persistent header (excluding its checksum) and all slab data
+uint32_t BaseVAlloc::getStateChecksum(const PersistentHeader &header) const
+{
+    PersistentHeader h = header;
+    h.checksum = 0;
+
+    const void *blocks[3] = { &h, slabs, slabMaps };
+    VPtrSize sizes[3];
+    sizes[0] = sizeof(h);
+    sizes[1] = slabCount * sizeof(Slab);
+    sizes[2] = slabCount * slabMapSize;
+
+    uint32_t ret = 2166136261UL;
+    for (uint8_t i=0; i<3; ++i)
+    {
+        const uint8_t *data = static_cast<const uint8_t *>(blocks[i]);
+        for (VPtrSize j=0; j<sizes[i]; ++j)
+            ret = (ret ^ data[j]) * 16777619UL;
+    }
+    return ret;
+}
+
+void BaseVAlloc::saveState()
+{
+    PersistentHeader header;
+    memset(&header, 0, sizeof(header)); // clear padding, as it is included in the checksum
+    header.magic = PERSISTENT_MAGIC;
+    header.poolSize = poolSize;
+    header.dataSize = getPersistentDataSize();
+    header.slabSize = slabSize;
+    header.slabCount = slabCount;
+    header.freePointer = freePointer;
+    header.poolFreePos = poolFreePos;
+    header.writtenEnd = private_utils::maximal(writtenEnd, (VPtrNum)(START_OFFSET + header.dataSize));
+    header.root = rootPointer;
+    header.baseFreeListNext = baseFreeList.s.next;
+    header.baseFreeListSize = baseFreeList.s.size;
+    header.checksum = getStateChecksum(header);
+
+    // NOTE: writeBulk() also updates any pages that overlap with the header
+    writeBulk(&header, START_OFFSET, sizeof(header));
+    if (slabCount)
+    {
+        writeBulk(slabs, START_OFFSET + sizeof(header), slabCount * sizeof(Slab));
+        writeBulk(slabMaps, START_OFFSET + sizeof(header) + (slabCount * sizeof(Slab)), slabCount * slabMapSize);
+    }
+}
+
+// Restores the allocator state stored by saveState(). Returns false if no (valid) state was found.
+bool BaseVAlloc::loadState()
+{
+    if (poolSize < (getHeapStart() + sizeof(UMemHeader)))
+        return false;
+
+    // the pool contents are unknown yet: make sure everything is actually read
+    writtenEnd = poolSize;
+
+    PersistentHeader header;
+    readBulk(&header, START_OFFSET, sizeof(header));
+    bool valid = (header.magic == PERSISTENT_MAGIC && header.poolSize == poolSize &&
+                  header.dataSize == getPersistentDataSize() && header.slabSize == slabSize &&
+                  header.slabCount == slabCount);
+
+    if (valid && slabCount)
+    {
+        readBulk(slabs, START_OFFSET + sizeof(header), slabCount * sizeof(Slab));
+        readBulk(slabMaps, START_OFFSET + sizeof(header) + (slabCount * sizeof(Slab)), slabCount * slabMapSize);
+    }
+
+    valid = valid && getStateChecksum(header) == header.checksum;
+    if (!valid)
+    {
+        writtenEnd = 0;
+        for (uint8_t i=0; i<slabCount; ++i)
+            slabs[i].start = 0;
+        return false;
+    }
+
+    freePointer = header.freePointer;
+    poolFreePos = header.poolFreePos;
+    writtenEnd = header.writtenEnd;
+    rootPointer = header.root;
+    baseFreeList.s.next = header.baseFreeListNext;
+    baseFreeList.s.size = header.baseFreeListSize;
+    return true;
 }
 
 /**
@@ -502,18 +1242,34 @@ void BaseVAlloc::writeZeros(VPtrNum start, VPtrSize n)
  *
  * This function should always be called during initialization, i.e. in *setup()* function of your sketch.
  * If the allocator was stopped (see \ref stop()), this function should be called again before using the allocator.
- * All used virtual memory (if any) will be cleared during initialization.
+ * All used virtual memory (if any) will be cleared during initialization, unless the state of a
+ * previous session is restored in persistent mode (see setPersistent()).
  */
 void BaseVAlloc::start()
 {
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_START, poolSize, 0);
     freePointer = 0;
     nextPageToSwap = 0;
+    mruBigPage = -1;
+    invalidateLockedRange();
+    pendingPage = lastBigPage = -1;
+    pendingWriteSize = 0;
+    lastLoadEnd = readAheadStart = 0;
     baseFreeList.s.next = 0;
     baseFreeList.s.size = 0;
-    poolFreePos = START_OFFSET + sizeof(UMemHeader);
+    poolFreePos = getHeapStart() + sizeof(UMemHeader);
+    writtenEnd = 0;
+    rootPointer = 0;
+    restoredState = false;
 #ifdef VIRTMEM_TRACE_STATS
     resetStats();
 #endif
+#ifdef VIRTMEM_TRACE_COUNTERS
+    resetCounters();
+#endif
+
+    resetBigPageTable();
 
     PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
     for (uint8_t pindex=0; pindex<3; ++pindex)
@@ -537,27 +1293,40 @@ void BaseVAlloc::start()
         }
     }
 
+    if (dirtyGranularity)
+        memset(bigPageDirtyMap, 0, bigPages.count * dirtyMapSize);
+
+    for (uint8_t i=0; i<slabCount; ++i)
+        slabs[i].start = 0;
+
     doStart();
+    directData = static_cast<uint8_t *>(doGetDirectData());
+
+    if (persistent)
+        restoredState = loadState();
 }
 
 /**
  * @fn BaseVAlloc::stop
  * @brief Deinitializes the allocator.
  *
- * Run \ref start() before using the allocator to re-initialize it.
+ * Run \ref start() before using the allocator to re-initialize it. In persistent mode (see
+ * setPersistent()) all data and the allocator state is written first (see \ref flush()).
  */
 void BaseVAlloc::stop()
 {
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_STOP, 0, 0);
+    if (persistent)
+        flush();
+
+    completeTransfers();
     doStop();
+    directData = 0;
 }
 
-/**
- * @fn BaseVAlloc::allocRaw
- * @brief Allocates a piece of raw (virtual) memory.
- * @param size the size of the memory block
- * @return The starting address of the memory block. Will return zero if out of memory.
- */
-VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
+// Allocates a block from the (first fit) free list. Returns zero if out of memory.
+VPtrNum BaseVAlloc::allocBlock(VPtrSize size)
 {
     const VPtrSize quantity = (size + sizeof(UMemHeader) - 1) / sizeof(UMemHeader) + 1;
     VPtrNum prevp = freePointer;
@@ -572,10 +1341,16 @@ VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
         baseFreeList.s.size = 0;
     }
 
+    VIRTMEM_COUNT(allocations);
+#ifdef VIRTMEM_TRACE_COUNTERS
+    const uint32_t startsteps = counters.freeListSteps;
+#endif
+
     VPtrNum p = getHeaderConst(prevp)->s.next;
     while (true)
     {
         const UMemHeader *consth = getHeaderConst(p);
+        VIRTMEM_COUNT(freeListSteps);
 
         // big enough ?
         if (consth->s.size >= quantity)
@@ -613,6 +1388,9 @@ VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
             }
 
             freePointer = prevp;
+#ifdef VIRTMEM_TRACE_COUNTERS
+            counters.maxFreeListSteps = private_utils::maximal(counters.maxFreeListSteps, counters.freeListSteps - startsteps);
+#endif
             return p + sizeof(UMemHeader);
         }
 
@@ -627,28 +1405,20 @@ VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
             if ((p = getMem(quantity)) == 0)
             {
 //                std::cout << "!! Memory allocation failed !!\n";
-                ASSERT(false);
                 return 0;
             }
             consth = getHeaderConst(p);
         }
 
-        prevp = p;
-        p = consth->s.next;
-        ASSERT(p);
-    }
-}
-
-/**
- * @fn BaseVAlloc::freeRaw
- * @brief Frees a memory block for re-usage.
- * @param ptr starting address of the memory block. This function will do nothing if \a ptr is zero.
- */
-void BaseVAlloc::freeRaw(VPtrNum ptr)
-{
-    if (!ptr)
-        return;
-
+        prevp = p;
+        p = consth->s.next;
+        ASSERT(p);
+    }
+}
+
+// Returns a block to the free list
+void BaseVAlloc::freeBlock(VPtrNum ptr)
+{
     // Scans the free list, starting at freePointer, looking the the place to insert the
     // free block. This is either between two existing blocks or at the end of the
     // list. In any case, if the block being freed is adjacent to either neighbor,
@@ -684,7 +1454,7 @@ void BaseVAlloc::freeRaw(VPtrNum ptr)
     memcpy(&stath, consth, sizeof(UMemHeader));
 
     // Try to combine with the higher neighbor
-    if ((hdrptr + statheader.s.size) == stath.s.next)
+    if ((hdrptr + statheader.s.size * sizeof(UMemHeader)) == stath.s.next)
     {
         const UMemHeader *nexth = getHeaderConst(stath.s.next);
         statheader.s.size += nexth->s.size;
@@ -697,7 +1467,7 @@ void BaseVAlloc::freeRaw(VPtrNum ptr)
     updateHeader(hdrptr, &statheader);
 
     // Try to combine with the lower neighbor
-    if (p + stath.s.size == hdrptr)
+    if ((p + stath.s.size * sizeof(UMemHeader)) == hdrptr)
     {
         stath.s.size += statheader.s.size;
         stath.s.next = statheader.s.next;
@@ -712,6 +1482,120 @@ void BaseVAlloc::freeRaw(VPtrNum ptr)
     freePointer = p;
 }
 
+// Allocates a slot from a slab. Returns zero if no slot could be allocated.
+VPtrNum BaseVAlloc::allocSlot(VPtrSize size)
+{
+    // find smallest fitting slot size. Slabs contain at least eight slots.
+    if (size > (slabSize / 8))
+        return 0;
+    uint8_t shift = 0;
+    while (((VPtrSize)1 << shift) < (VPtrSize)SLAB_MIN_SLOT_SIZE || ((VPtrSize)1 << shift) < size)
+        ++shift;
+    if ((slabSize >> shift) < 8)
+        return 0;
+
+    Slab *slab = 0, *unused = 0;
+    for (uint8_t i=0; i<slabCount && !slab; ++i)
+    {
+        if (slabs[i].start == 0)
+        {
+            if (!unused)
+                unused = &slabs[i];
+        }
+        else if (slabs[i].slotShift == shift && slabs[i].freeSlots)
+            slab = &slabs[i];
+    }
+
+    if (!slab)
+    {
+        if (!unused || (unused->start = allocBlock(slabSize)) == 0)
+            return 0;
+        slab = unused;
+        slab->slotShift = shift;
+        slab->freeSlots = slabSize >> shift;
+        memset(getSlabMap(slab), 0, slabMapSize);
+    }
+
+    uint8_t *map = getSlabMap(slab);
+    uint16_t slot = 0;
+    for (; map[slot / 8] & (1 << (slot & 7)); ++slot)
+        ;
+    map[slot / 8] |= (1 << (slot & 7));
+    --slab->freeSlots;
+    return slab->start + ((VPtrNum)slot << shift);
+}
+
+// Frees a slot from a slab. Returns false if the pointer is not within a slab.
+bool BaseVAlloc::freeSlot(VPtrNum ptr)
+{
+    for (uint8_t i=0; i<slabCount; ++i)
+    {
+        Slab &slab = slabs[i];
+        if (slab.start != 0 && ptr >= slab.start && (ptr - slab.start) < slabSize)
+        {
+            const uint16_t slot = (ptr - slab.start) >> slab.slotShift;
+            ASSERT(getSlabMap(&slab)[slot / 8] & (1 << (slot & 7)));
+            getSlabMap(&slab)[slot / 8] &= ~(1 << (slot & 7));
+            ++slab.freeSlots;
+
+            // Release an empty slab, unless it is the only one of its size with free slots. This
+            // avoids repeatedly allocating and releasing a slab.
+            if (slab.freeSlots == (slabSize >> slab.slotShift))
+            {
+                for (uint8_t j=0; j<slabCount; ++j)
+                {
+                    if (j != i && slabs[j].start != 0 && slabs[j].slotShift == slab.slotShift && slabs[j].freeSlots)
+                    {
+                        freeBlock(slab.start);
+                        slab.start = 0;
+                        break;
+                    }
+                }
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @fn BaseVAlloc::allocRaw
+ * @brief Allocates a piece of raw (virtual) memory.
+ * @param size the size of the memory block
+ * @return The starting address of the memory block. Will return zero if out of memory.
+ * @note If the allocator properties define slabs (see DefaultAllocProperties), small blocks are
+ * allocated from slabs, which does not require any access to virtual memory.
+ */
+VPtrNum BaseVAlloc::allocRaw(VPtrSize size)
+{
+    AccessGuard guard(this);
+    ASSERT(size);
+
+    VPtrNum ret = (slabCount) ? allocSlot(size) : 0;
+    if (!ret)
+        ret = allocBlock(size);
+
+    ASSERT(ret != 0); // out of memory?
+    return ret;
+}
+
+/**
+ * @fn BaseVAlloc::freeRaw
+ * @brief Frees a memory block for re-usage.
+ * @param ptr starting address of the memory block. This function will do nothing if \a ptr is zero.
+ */
+void BaseVAlloc::freeRaw(VPtrNum ptr)
+{
+    AccessGuard guard(this);
+    if (!ptr)
+        return;
+
+    if (!slabCount || !freeSlot(ptr))
+        freeBlock(ptr);
+}
+
 /**
  * @fn BaseVAlloc::read
  * @brief Reads a raw block of (virtual) memory.
@@ -719,39 +1603,51 @@ void BaseVAlloc::freeRaw(VPtrNum ptr)
  * @param size number of bytes to read
  * @return a pointer to a memory block (a memory page) containing the data
  * @note The memory block returned by this function is temporary and may be invalidated
- * during a page swap. To use the memory accross reads and writes it should be locked.
+ * during a page swap. To use the memory accross reads and writes it should be locked. This
+ * includes accesses by other tasks if the allocator is shared (see BaseMutex).
  */
 void *BaseVAlloc::read(VPtrNum p, VPtrSize size)
 {
-    PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
-    const VPtrNum pend = p + size;
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_READ, p, size);
+    if (directData)
+        return directData + p;
 
-    for (uint8_t pindex=0; pindex<3; ++pindex)
+    // skip locked pages if they cannot contain the data
+    if (inLockedRange(p, size))
     {
-        for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
-        {
-            const bool beginoverlaps = (p >= plist[pindex]->pages[i].start &&
-                                      p < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size));
-            const bool endoverlaps = (p < plist[pindex]->pages[i].start && pend > plist[pindex]->pages[i].start);
+        PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
+        const VPtrNum pend = p + size;
 
-            if (beginoverlaps)
+        for (uint8_t pindex=0; pindex<3; ++pindex)
+        {
+            for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
             {
-                const VPtrNum offset = p - plist[pindex]->pages[i].start;
-                // data fits in this page?
-                if ((offset + size) <= plist[pindex]->pages[i].size)
+                const bool beginoverlaps = (p >= plist[pindex]->pages[i].start &&
+                                          p < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size));
+                const bool endoverlaps = (p < plist[pindex]->pages[i].start && pend > plist[pindex]->pages[i].start);
+
+                if (beginoverlaps)
                 {
-        //            std::cout << "using temp lock page " << (int)(pageindex) << ", " << p << std::endl;
-                    return (char *)plist[pindex]->pages[i].pool + offset;
+                    const VPtrNum offset = p - plist[pindex]->pages[i].start;
+                    // data fits in this page?
+                    if ((offset + size) <= plist[pindex]->pages[i].size)
+                    {
+            //            std::cout << "using temp lock page " << (int)(pageindex) << ", " << p << std::endl;
+                        VIRTMEM_COUNT(pageHits[pindex]);
+                        return (char *)plist[pindex]->pages[i].pool + offset;
+                    }
                 }
-            }
 
-            if (beginoverlaps || endoverlaps)
-            {
-                // only fits partially... mirror data to normal page so a continuous block can be returned
-                pushRawData(plist[pindex]->pages[i].start, plist[pindex]->pages[i].pool,
-                            plist[pindex]->pages[i].size); // UNDONE: partial copy, check dirty?
+                if (beginoverlaps || endoverlaps)
+                {
+                    // only fits partially... mirror data to normal page so a continuous block can be returned
+                    pushRawData(plist[pindex]->pages[i].start, plist[pindex]->pages[i].pool,
+                                plist[pindex]->pages[i].size); // UNDONE: partial copy, check dirty?
+                    VIRTMEM_COUNT(partialMirrors);
 
-//                std::cout << "mirrored partial page: " << (int)pindex << "/" << (int)(i) << std::endl;
+    //                std::cout << "mirrored partial page: " << (int)pindex << "/" << (int)(i) << std::endl;
+                }
             }
         }
     }
@@ -760,6 +1656,56 @@ void *BaseVAlloc::read(VPtrNum p, VPtrSize size)
     return pullRawData(p, size, true, false);
 }
 
+/**
+ * @fn BaseVAlloc::acquireWritable
+ * @brief Provides direct access to a raw block of (virtual) memory that will be modified.
+ *
+ * This function is similar to \ref read(), but the data is marked as modified. This allows
+ * read-modify-write operations (e.g. incrementing a value) with a single lookup.
+ * @param p starting address of memory block
+ * @param size number of bytes to access
+ * @return a pointer to a memory block (a memory page) containing the data. If the data only
+ * partially overlaps with locked data, zero is returned: \ref read() and \ref write() should be
+ * used instead.
+ * @note Like the memory returned by \ref read(), the memory block returned by this function is
+ * temporary and may be invalidated by any subsequent access to virtual memory.
+ */
+void *BaseVAlloc::acquireWritable(VPtrNum p, VPtrSize size)
+{
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_MODIFY, p, size);
+    if (directData)
+        return directData + p;
+
+    // skip locked pages if they cannot contain the data
+    if (inLockedRange(p, size))
+    {
+        PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
+        const VPtrNum pend = p + size;
+
+        for (uint8_t pindex=0; pindex<3; ++pindex)
+        {
+            for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+            {
+                LockPage &page = plist[pindex]->pages[i];
+                const bool beginoverlaps = (p >= page.start && p < (page.start + page.size));
+                const bool endoverlaps = (p < page.start && pend > page.start);
+
+                if (beginoverlaps && (p - page.start + size) <= page.size)
+                {
+                    VIRTMEM_COUNT(pageHits[pindex]);
+                    page.dirty = true;
+                    return page.pool + (p - page.start);
+                }
+                else if (beginoverlaps || endoverlaps)
+                    return 0; // data would have to be modified in multiple pages
+            }
+        }
+    }
+
+    return pullRawData(p, size, false, false);
+}
+
 /**
  * @fn BaseVAlloc::write
  * @brief Writes a piece of raw data to (virtual) memory.
@@ -769,62 +1715,302 @@ void *BaseVAlloc::read(VPtrNum p, VPtrSize size)
  */
 void BaseVAlloc::write(VPtrNum p, const void *d, VPtrSize size)
 {
-    PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
-    const VPtrNum pend = p + size;
+    AccessGuard guard(this);
+#ifdef VIRTMEM_TRACE_ACCESS
+    if (size <= bigPages.size || directData)
+        traceAccess(TRACE_WRITE, p, size); // larger writes are traced by writeBulk()
+#endif
+    if (directData)
+    {
+        memmove(directData + p, d, size);
+        return;
+    }
 
-    for (uint8_t pindex=0; pindex<3; ++pindex)
+    // skip locked pages if they cannot contain the data
+    if (inLockedRange(p, size))
     {
-        for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+        PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
+        const VPtrNum pend = p + size;
+
+        for (uint8_t pindex=0; pindex<3; ++pindex)
         {
-            const bool beginoverlaps = (p >= plist[pindex]->pages[i].start &&
-                                      p < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size));
-            const bool endoverlaps = (p < plist[pindex]->pages[i].start && pend > plist[pindex]->pages[i].start);
+            for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+            {
+                const bool beginoverlaps = (p >= plist[pindex]->pages[i].start &&
+                                          p < (plist[pindex]->pages[i].start + plist[pindex]->pages[i].size));
+                const bool endoverlaps = (p < plist[pindex]->pages[i].start && pend > plist[pindex]->pages[i].start);
 
-            if (!plist[pindex]->pages[i].dirty && (beginoverlaps || endoverlaps))
-                plist[pindex]->pages[i].dirty = true;
+                if (!plist[pindex]->pages[i].dirty && (beginoverlaps || endoverlaps))
+                    plist[pindex]->pages[i].dirty = true;
 
-            if (beginoverlaps)
-            {
-                const VPtrNum offset = p - plist[pindex]->pages[i].start;
-                // data fits in this page?
-                if ((offset + size) <= plist[pindex]->pages[i].size)
+                if (beginoverlaps)
                 {
-                    memcpy((char *)plist[pindex]->pages[i].pool + offset, d, size);
-                    return;
+                    const VPtrNum offset = p - plist[pindex]->pages[i].start;
+                    // data fits in this page?
+                    if ((offset + size) <= plist[pindex]->pages[i].size)
+                    {
+                        memcpy((char *)plist[pindex]->pages[i].pool + offset, d, size);
+                        VIRTMEM_COUNT(pageHits[pindex]);
+                        return;
+                    }
+                    else
+                    {
+                        // partial fit (data too large), copy stuff that fits in page
+                        memcpy((char *)plist[pindex]->pages[i].pool + offset, d, plist[pindex]->pages[i].size - offset);
+                    }
                 }
-                else
+                else if (endoverlaps)
                 {
-                    // partial fit (data too large), copy stuff that fits in page
-                    memcpy((char *)plist[pindex]->pages[i].pool + offset, d, plist[pindex]->pages[i].size - offset);
+                    // partial fit (data starts before), copy stuff that fits in page
+                    const VPtrNum offset = plist[pindex]->pages[i].start - p;
+                    memcpy((char *)plist[pindex]->pages[i].pool, (uint8_t *)d + offset, size - offset);
                 }
             }
-            else if (endoverlaps)
-            {
-                // partial fit (data starts before), copy stuff that fits in page
-                const VPtrNum offset = plist[pindex]->pages[i].start - p;
-                memcpy((char *)plist[pindex]->pages[i].pool, (uint8_t *)d + offset, size - offset);
-            }
         }
     }
 
     // data was either not or partially in a lock if we are here
     // UNDONE: partial copy if data was partially in locks?
-    pushRawData(p, d, size);
+    if (size > bigPages.size)
+        writeBulk(d, p, size); // doesn't fit in a page
+    else
+        pushRawData(p, d, size);
+}
+
+/**
+ * @fn BaseVAlloc::readBulk
+ * @brief Reads a (large) block of virtual memory directly from the storage medium.
+ *
+ * Unlike \ref read(), the data is not loaded into memory pages first: it is read with a single
+ * request to the allocator and copied to the given buffer. Modified data from memory pages that
+ * was not synchronized yet is taken into account. This function is more efficient for transfers
+ * of (at least) the size of a *big* page, since loaded pages are retained and all data is
+ * copied only once.
+ * @param d pointer to a buffer that receives the data
+ * @param p starting address of the virtual memory block
+ * @param size number of bytes to read
+ * @sa writeBulk
+ */
+void BaseVAlloc::readBulk(void *d, VPtrNum p, VPtrSize size)
+{
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_READ_BULK, p, size);
+    ASSERT(p && (p + size) <= poolSize);
+
+    if (directData)
+    {
+        memmove(d, directData + p, size);
+        return;
+    }
+
+    readBackend(d, p, size);
+#ifdef VIRTMEM_TRACE_STATS
+    bytesRead += size;
+#endif
+
+    // Copy any modified data that was not written yet. Locked pages are processed last, as their
+    // data is the most recent (see read())
+    PageInfo *plist[4] = { &bigPages, &smallPages, &mediumPages, &bigPages };
+    for (uint8_t pindex=0; pindex<4; ++pindex)
+    {
+        for (int8_t i=(pindex == 0) ? bigPages.freeIndex : plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+        {
+            const LockPage &page = plist[pindex]->pages[i];
+            VPtrNum ostart;
+            VPtrSize osize;
+            if (page.dirty && getPageOverlap(&page, p, size, ostart, osize))
+                memcpy((uint8_t *)d + (ostart - p), page.pool + (ostart - page.start), osize);
+        }
+    }
+}
+
+/**
+ * @fn BaseVAlloc::writeBulk
+ * @brief Writes a (large) block of data directly to the storage medium.
+ *
+ * This function is the counterpart of \ref readBulk(): the data is written with a single request
+ * to the allocator, and any loaded or locked memory pages containing the written range are updated.
+ * @param d pointer to data to be written
+ * @param p starting address of the virtual memory block
+ * @param size number of bytes to write
+ */
+void BaseVAlloc::writeBulk(const void *d, VPtrNum p, VPtrSize size)
+{
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_WRITE_BULK, p, size);
+    ASSERT(p && (p + size) <= poolSize);
+
+    if (directData)
+    {
+        memmove(directData + p, d, size);
+        return;
+    }
+
+    writeBackend(d, p, size);
+#ifdef VIRTMEM_TRACE_STATS
+    bytesWritten += size;
+#endif
+
+    // NOTE: pages keep their dirty state, as any later synchronization writes the same data
+    PageInfo *plist[4] = { &bigPages, &smallPages, &mediumPages, &bigPages };
+    for (uint8_t pindex=0; pindex<4; ++pindex)
+    {
+        for (int8_t i=(pindex == 0) ? bigPages.freeIndex : plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+        {
+            LockPage &page = plist[pindex]->pages[i];
+            VPtrNum ostart;
+            VPtrSize osize;
+            if (getPageOverlap(&page, p, size, ostart, osize))
+                memcpy(page.pool + (ostart - page.start), (const uint8_t *)d + (ostart - p), osize);
+        }
+    }
+}
+
+/**
+ * @fn BaseVAlloc::zeroRaw
+ * @brief Sets a block of virtual memory to zero.
+ *
+ * This function is faster than writing zeros: the block is cleared in *big* memory pages that are
+ * not read first (data that was never written since \ref start() is not read either), and no
+ * source buffer is copied.
+ * @param p starting address of the virtual memory block
+ * @param size number of bytes to clear
+ * @sa VAlloc::newArray
+ */
+void BaseVAlloc::zeroRaw(VPtrNum p, VPtrSize size)
+{
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_WRITE_BULK, p, size);
+    ASSERT(p && (p + size) <= poolSize);
+
+    if (directData)
+    {
+        memset(directData + p, 0, size);
+        return;
+    }
+
+    for (VPtrSize i=0; i<size; )
+    {
+        // clear a page at a time, i.e. in aligned mode chunks end at page boundaries
+        VPtrNum start;
+        VirtPageSize psize;
+        getBigPageRange(p + i, 1, false, start, psize);
+        const VPtrSize n = private_utils::minimal((VPtrSize)(size - i), (VPtrSize)(start + psize - (p + i)));
+        memset(pullRawData(p + i, n, false, false, true), 0, n);
+        i += n;
+    }
+
+    // locked pages contain the most recent data (see write())
+    if (inLockedRange(p, size))
+    {
+        PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
+        for (uint8_t pindex=0; pindex<3; ++pindex)
+        {
+            for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+            {
+                LockPage &page = plist[pindex]->pages[i];
+                VPtrNum ostart;
+                VPtrSize osize;
+                if (getPageOverlap(&page, p, size, ostart, osize))
+                {
+                    memset(page.pool + (ostart - page.start), 0, osize);
+                    page.dirty = true;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @fn BaseVAlloc::prefetch
+ * @brief Loads a block of virtual memory in advance.
+ *
+ * This function can be used as a hint if it is known which data will be accessed next. The
+ * data is loaded in *big* pages that are either empty or unmodified, hence, data is never written
+ * as a result of prefetching. If supported by the allocator, data is read asynchronously.
+ * @param p starting address of the virtual memory block
+ * @param size number of bytes to prefetch. Data that does not fit in the available pages is ignored.
+ * @note The `readAhead` allocator property can be used to automatically prefetch data during
+ * sequential access (see DefaultAllocProperties).
+ */
+void BaseVAlloc::prefetch(VPtrNum p, VPtrSize size)
+{
+    AccessGuard guard(this);
+    if (directData)
+        return;
+
+    int8_t indices[MAX_IO_BLOCKS];
+    uint8_t count = 0;
+    const VPtrNum first = p, end = private_utils::minimal((VPtrNum)(p + size), poolSize);
+    while (p < end)
+    {
+        int8_t index = findBigPage(p);
+        if (index == -1)
+        {
+            VPtrNum start;
+            VirtPageSize psize;
+            getBigPageRange(p, 1, false, start, psize);
+
+            // don't bother if the page would overlap with loaded data or no pages are available. NOTE:
+            // aligned pages may start before p, i.e. in data of an existing (unaligned) page.
+            if (overlapsBigPages(start, psize, -1) || (index = findPrefetchPage(first, p)) == -1)
+                break;
+
+            // pages are assigned to their new range first, and read together afterwards
+            loadBigPage(index, start, psize, true, false);
+            indices[count++] = index;
+            if (count == MAX_IO_BLOCKS)
+            {
+                fetchBigPages(indices, count);
+                count = 0;
+            }
+        }
+        p = bigPages.pages[index].start + bigPages.pages[index].size;
+    }
+
+    if (count)
+        fetchBigPages(indices, count);
 }
 
 /**
  * @fn BaseVAlloc::flush
- * @brief Synchronizes all *big* memory pages.
- * @note This function is merely used for debugging.
+ * @brief Synchronizes all memory pages.
+ *
+ * In persistent mode (see setPersistent()) the allocator state is stored afterwards. Finally,
+ * the allocator is given the chance to commit all written data to the storage medium (see
+ * doFlush()).
+ * @note This function is merely used for debugging or for allocators with a persistent memory
+ * pool (e.g. MmapVAllocP).
  */
 void BaseVAlloc::flush()
 {
-    // UNDONE: also flush locked pages?
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_FLUSH, 0, 0);
+    // copy data from (previously) locked pages first, as it is more recent
+    PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
+    for (uint8_t pindex=0; pindex<3; ++pindex)
+    {
+        for (int8_t i=plist[pindex]->lockedIndex; i!=-1; i=plist[pindex]->pages[i].next)
+        {
+            LockPage &page = plist[pindex]->pages[i];
+            syncLockedPage(&page);
+            // modifications while locked are not tracked, so pages that are still locked stay dirty
+            if (page.locks == 0)
+                page.dirty = false;
+        }
+    }
+
     for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
     {
         if (bigPages.pages[i].start != 0)
             syncBigPage(&bigPages.pages[i]);
     }
+
+    if (persistent)
+        saveState();
+
+    completeTransfers();
+    doFlush();
 }
 
 /**
@@ -834,14 +2020,13 @@ void BaseVAlloc::flush()
  */
 void BaseVAlloc::clearPages()
 {
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_CLEAR, 0, 0);
     // wipe all pages
     for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
     {
         if (bigPages.pages[i].start != 0)
-        {
-            syncBigPage(&bigPages.pages[i]);
-            bigPages.pages[i].start = 0;
-        }
+            invalidateBigPage(i);
     }
 }
 
@@ -851,6 +2036,7 @@ void BaseVAlloc::clearPages()
  */
 uint8_t BaseVAlloc::getFreeBigPages() const
 {
+    AccessGuard guard(this);
     uint8_t ret = 0;
 
     for (int8_t i=bigPages.freeIndex; i!=-1; i=bigPages.pages[i].next)
@@ -865,7 +2051,13 @@ uint8_t BaseVAlloc::getFreeBigPages() const
 // @cond HIDDEN_SYMBOLS
 void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
 {
+    AccessGuard guard(this);
+    VIRTMEM_TRACE((ro) ? TRACE_LOCK_RO : TRACE_LOCK, ptr, size);
     ASSERT(ptr != 0);
+
+    if (directData)
+        return directData + ptr;
+
     ASSERT(size <= bigPages.size);
 
     PageInfo *pinfo, *secpinfo = 0;
@@ -1064,6 +2256,7 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
             }
             else
             {
+                VIRTMEM_COUNT(lockFailures);
                 ASSERT(false);
                 return 0; // no space left
             }
@@ -1107,9 +2300,17 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
         }
 
         pinfo->pages[pageindex].start = ptr;
+        pinfo->pages[pageindex].size = size;
+#ifdef VIRTMEM_TRACE_COUNTERS
+        if (pinfo != &bigPages)
+            ++counters.pageMisses[getPageClass(pinfo)]; // big pages are counted when loaded
+        notifyPageEvent(PAGE_LOCK, &pinfo->pages[pageindex]);
+#endif
     }
     else
     {
+        VIRTMEM_COUNT(pageHits[getPageClass(pinfo)]);
+
         // size increased? (this can happen when either this page was used for a smaller data type, or other pages don't overlap anymore
         if (size > pinfo->pages[pageindex].size)
         {
@@ -1136,17 +2337,26 @@ void *BaseVAlloc::makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro)
 
     ++pinfo->pages[pageindex].locks;
     pinfo->pages[pageindex].size = size;
+    invalidateLockedRange();
+    VIRTMEM_COUNT(lockAcquires);
 //    std::cout << "temp lock page: " << (int)pageindex << ", " << ptr << "/" << size << "/" << pinfo->size << std::endl;
     ASSERT(size <= pinfo->size);
     return pinfo->pages[pageindex].pool;
 }
 
 // makes a lock that will not resize existing locks. If ptr is in an existing lock, this lock will be used.
-// Otherwise a new lock is created with an apropiate size to avoid overlap
-void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
+// Otherwise a new lock is created with an apropiate size to avoid overlap. If nofetch is set the caller
+// overwrites all locked data: new locks are then not filled with data.
+void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro, bool nofetch)
 {
+    AccessGuard guard(this);
+    VIRTMEM_TRACE((ro) ? TRACE_LOCK_RO : TRACE_LOCK, ptr, size);
     ASSERT(ptr != 0);
 
+    if (directData)
+        return directData + ptr;
+
+
     size = private_utils::minimal(size, bigPages.size);
 
     PageInfo *plist[3] = { &smallPages, &mediumPages, &bigPages };
@@ -1217,6 +2427,7 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
 
         if (plistindex == -1)
         {
+            VIRTMEM_COUNT(lockFailures);
             ASSERT(false);
             return 0;
         }
@@ -1224,7 +2435,7 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
         bool syncpool = true;
         if (plist[plistindex]->freeIndex != -1)
         {
-            pageindex = lockPage(plist[plistindex], ptr, size);
+            pageindex = lockPage(plist[plistindex], ptr, size, nofetch);
             syncpool = plist[plistindex] != &bigPages; // big pages are already synced when locked
         }
         else
@@ -1234,15 +2445,21 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
             plist[plistindex]->pages[pageindex].dirty = false;
         }
 
-        if (syncpool)
+        if (syncpool && !nofetch)
             copyRawData(plist[plistindex]->pages[pageindex].pool, ptr, size);
 
         plist[plistindex]->pages[pageindex].start = ptr;
         plist[plistindex]->pages[pageindex].size = size;
+#ifdef VIRTMEM_TRACE_COUNTERS
+        if (plistindex != PAGE_BIG)
+            ++counters.pageMisses[plistindex]; // big pages are counted when loaded
+        notifyPageEvent(PAGE_LOCK, &plist[plistindex]->pages[pageindex]);
+#endif
     }
     else
     {
 //        std::cout << "fitting lock: Useing existing\n";
+        VIRTMEM_COUNT(pageHits[plistindex]);
 
         offset = (ptr - plist[plistindex]->pages[pageindex].start);
 
@@ -1252,6 +2469,8 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
 
     // else add to lock count
     ++plist[plistindex]->pages[pageindex].locks;
+    invalidateLockedRange();
+    VIRTMEM_COUNT(lockAcquires);
 
     if (!plist[plistindex]->pages[pageindex].dirty)
         plist[plistindex]->pages[pageindex].dirty = !ro;
@@ -1261,14 +2480,67 @@ void *BaseVAlloc::makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro)
     return plist[plistindex]->pages[pageindex].pool + offset;
 }
 
+// Locks a block that may be larger than a big page with (at most maxsegs) consecutive fitting locks
+// (see makeFittingLock()). Parts after the first are only locked if at least one big page remains
+// unlocked. In aligned mode the first part ends at a page boundary, so that the others are aligned.
+// Returns the amount of parts, size is set to the total size that was locked.
+uint8_t BaseVAlloc::makeMultiLock(VPtrNum ptr, VPtrSize &size, LockSegment *segments, uint8_t maxsegs, bool ro, bool nofetch)
+{
+    AccessGuard guard(this);
+    ASSERT(ptr != 0 && ptr < poolSize && maxsegs > 0);
+
+    size = private_utils::minimal(size, (VPtrSize)(poolSize - ptr));
+
+    if (directData)
+    {
+        VIRTMEM_TRACE((ro) ? TRACE_LOCK_RO : TRACE_LOCK, ptr, size);
+        segments[0].data = directData + ptr;
+        segments[0].ptr = ptr;
+        segments[0].size = size;
+        return 1;
+    }
+
+    VPtrSize locked = 0;
+    uint8_t count = 0;
+    for (; count<maxsegs && locked<size; ++count)
+    {
+        const VPtrNum p = ptr + locked;
+
+        // don't take the last unlocked big page, unless the part is already locked
+        if (count > 0 && !findLockedPage(p) && getUnlockedPages(&bigPages) < 2)
+            break;
+
+        VirtPageSize psize = (VirtPageSize)private_utils::minimal((VPtrSize)(size - locked), (VPtrSize)bigPages.size);
+        if (alignBigPages && count == 0)
+            psize = private_utils::minimal(psize, (VirtPageSize)(bigPages.size - (p % bigPages.size)));
+
+        segments[count].data = static_cast<uint8_t *>(makeFittingLock(p, psize, ro, nofetch));
+        if (!segments[count].data)
+            break;
+        segments[count].ptr = p;
+        segments[count].size = psize;
+        locked += psize;
+    }
+
+    size = locked;
+    return count;
+}
+
 void BaseVAlloc::releaseLock(VPtrNum ptr)
 {
+    AccessGuard guard(this);
+    VIRTMEM_TRACE(TRACE_UNLOCK, ptr, 0);
+    if (directData)
+        return;
+
     LockPage *page = findLockedPage(ptr);
     ASSERT(page && page->locks);
 //    std::cout << "temp unlock page: " << (int)ptr << "/" << (int)page->locks << std::endl;
     --page->locks;
     if (!page->locks)
     {
+        VIRTMEM_PAGE_EVENT(PAGE_UNLOCK, page);
+
         // was it a big page? free it so that it can be re-used for non locked IO
         const int8_t index = findLockedPage(&bigPages, ptr);
         if (index != -1)
@@ -1276,17 +2548,66 @@ void BaseVAlloc::releaseLock(VPtrNum ptr)
     }
 }
 
+void BaseVAlloc::releaseMultiLock(const LockSegment *segments, uint8_t count)
+{
+    AccessGuard guard(this);
+    for (uint8_t i=0; i<count; ++i)
+        releaseLock(segments[i].ptr);
+}
+
+// Returns the size that can be locked by makeMultiLock() if the currently unlocked big pages (bar
+// one) are shared by the given amount of locks. Returns zero if locks is zero or if all big pages
+// are locked: in this case only data that is locked already can be locked again.
+VPtrSize BaseVAlloc::getMaxMultiLockSize(uint8_t maxsegs, uint8_t locks) const
+{
+    AccessGuard guard(this);
+    if (directData)
+        return poolSize;
+
+    const uint8_t unlocked = getUnlockedPages(&bigPages);
+    if (locks == 0 || unlocked == 0)
+        return 0;
+
+    const uint8_t pages = (unlocked - 1) / locks;
+    return (VPtrSize)private_utils::maximal((uint8_t)1, private_utils::minimal(pages, maxsegs)) * bigPages.size;
+}
+
+#ifdef VIRTMEM_TRACE_ACCESS
+void BaseVAlloc::traceAccess(AccessTraceEvent event, VPtrNum p, VPtrSize size)
+{
+    if (!accessTracer)
+        return;
+
+    // large accesses are split, as records only hold a 16 bit size
+    do
+    {
+        const uint16_t s = private_utils::minimal(size, (VPtrSize)0xFFFF);
+        accessTracer->trace(event, p, s);
+        p += s; size -= s;
+    }
+    while (size);
+}
+#endif
+
+#ifdef VIRTMEM_TRACE_COUNTERS
+void BaseVAlloc::resetCounters()
+{
+    memset(&counters, 0, sizeof(counters));
+}
+#endif
+
 void BaseVAlloc::printStats()
 {
+    AccessGuard guard(this);
 #ifdef PRINTF_STATS
     printf("------ Memory manager stats ------\n\n");
-    printf("Pool: free_pos = %u (%u bytes left)\n\n", poolFreePos, poolSize - poolFreePos);
+    printf("Pool: free_pos = %lu (%lu bytes left)\n\n", (unsigned long)poolFreePos, (unsigned long)(poolSize - poolFreePos));
 
-    VPtrNum p = START_OFFSET + sizeof(UMemHeader);
+    VPtrNum p = getHeapStart() + sizeof(UMemHeader);
     while (p < poolFreePos)
     {
         const UMemHeader *h = getHeaderConst(p);
-        printf("  * Addr: %8u; Size: %8u\n", p, h->s.size);
+        printf("  * Addr: %8lu; Size: %8lu\n", (unsigned long)p, (unsigned long)h->s.size);
         p += (h->s.size * sizeof(UMemHeader));
         if (!h->s.size || h->s.next < p)
             break;
@@ -1301,7 +2622,7 @@ void BaseVAlloc::printStats()
         while (1)
         {
             const UMemHeader *h = getHeaderConst(p);
-            printf("  * Addr: %8u; Size: %8u; Next: %8u\n", p, h->s.size, h->s.next);
+            printf("  * Addr: %8lu; Size: %8lu; Next: %8lu\n", (unsigned long)p, (unsigned long)h->s.size, (unsigned long)h->s.next);
 
             p = h->s.next;
 
@@ -13,6 +13,8 @@
 #undef VIRTMEM_WRAP_CPOINTERS
 #undef VIRTMEM_VIRT_ADDRESS_OPERATOR
 #undef VIRTMEM_TRACE_STATS
+#undef VIRTMEM_TRACE_COUNTERS
+#undef VIRTMEM_TRACE_ACCESS
 #undef VIRTMEM_CPP11
 #undef VIRTMEM_EXPLICIT
 #endif
@@ -46,13 +48,59 @@
   */
 //#define VIRTMEM_TRACE_STATS
 
+/**
+  * @def VIRTMEM_TRACE_COUNTERS
+  * @brief If defined, allocators keep detailed performance counters, such as page hits and
+  * misses, lock statistics and duration histograms of backend transfers, and report page events
+  * to an optional callback. This costs some RAM and CPU time per access.
+  * @see \ref counterf "Performance counters"
+  */
+//#define VIRTMEM_TRACE_COUNTERS
+
+/**
+  * @def VIRTMEM_TRACE_ACCESS
+  * @brief If defined, all virtual memory accesses can be recorded, see BaseAccessTracer and
+  * BaseVAlloc::setAccessTracer().
+  */
+//#define VIRTMEM_TRACE_ACCESS
+
+/**
+  * @def VIRTMEM_VPTR_BITS
+  * @brief Width of virtual addresses and sizes in bits: 16, 32 (default) or 64.
+  *
+  * This determines the types virtmem::VPtrNum and virtmem::VPtrSize, and therefore the size of
+  * virtual pointers and the administration of allocated memory blocks. For small memory pools
+  * (less than 64 kB, e.g. a 32 kB SPI RAM chip) 16 bit addresses save RAM and make data
+  * structures that store virtual pointers more compact. 64 bit addresses allow memory pools
+  * larger than 4 GB.
+  *
+  * The setting applies to all allocators and may be overridden by the build system (e.g.
+  * `-DVIRTMEM_VPTR_BITS=16`).
+  * @note When \ref VIRTMEM_WRAP_CPOINTERS is defined, the most significant bit may be used to
+  * mark wrapped pointers. For instance, on AVR platforms with 16 bit addresses virtual addresses
+  * should not exceed 32 kB.
+  * @note Allocated memory blocks stay aligned to the largest type of the platform (e.g. `double`,
+  * or 16 bytes on x86-64), and so does the administration header of each block. Therefore, the
+  * per block overhead shrinks only if this alignment is smaller than the header. For instance,
+  * on AVR the header shrinks from 8 to 4 bytes, while 16 bit addresses do not reduce it on x86-64.
+  * @note Not all backends support pools larger than 4 GB, e.g. SerialVAllocP transfers 32 bit
+  * offsets and the files used by SDVAllocP are limited to 4 GB by the FAT file system.
+  */
+#ifndef VIRTMEM_VPTR_BITS
+#define VIRTMEM_VPTR_BITS 32
+#endif
+
 /**
   * @brief The default poolsize for allocators supporting a variable sized pool.
   *
   * This value is used for variable sized allocators, such as SDVAlloc and
   * SerialVAlloc.
   */
+#if VIRTMEM_VPTR_BITS == 16
+#define VIRTMEM_DEFAULT_POOLSIZE 1024l * 32l
+#else
 #define VIRTMEM_DEFAULT_POOLSIZE 1024l * 1024l
+#endif
 
 /**
   * @def VIRTMEM_CPP11
@@ -111,6 +159,9 @@ struct DefaultAllocProperties
     static const uint16_t mediumPageSize = 256;
     static const uint8_t bigPageCount = 4;
     static const uint16_t bigPageSize = 1024 * 32;
+    static const uint16_t dirtyGranularity = 512;
+    static const uint8_t slabCount = 16;
+    static const uint16_t slabSize = 1024;
 };
 #else
 // Small AVR like MCUs (e.g. Arduino Uno) or unknown platform. In the latter case these settings
@@ -167,6 +218,42 @@ struct AllocProperties
 SDVAllocP<AllocProperties> alloc;
   @endcode
   *
+  * Besides the page settings described above, a customized structure may define the following
+  * optional members. If a member is not defined its default value is used.
+  * - `static const bool alignBigPages`: if `true`, *big* pages used for regular virtual memory access
+  * always start at a multiple of `bigPageSize` (the first page starts right after the reserved NULL
+  * address). This prevents overlapping pages, and therefore additional page swaps, with sequential
+  * access, and allows page transfers to match the sector or page boundaries of the storage medium.
+  * Data that crosses a page boundary is loaded in an unaligned page. Default: `false`.
+  * - `static const bool asyncWriteBack`: if `true`, a modified *big* page that is swapped out is
+  * written back asynchronously if supported by the allocator (e.g. by DMA), so that the CPU can
+  * continue while the data is transferred. This requires an extra buffer of `bigPageSize` bytes.
+  * Only used if `dirtyGranularity` is disabled. Default: `false`.
+  * - `static const uint16_t dirtyGranularity`: if non-zero, modifications of *big* pages are tracked
+  * in blocks of this size, so that only modified blocks are written when a page is synchronized
+  * (adjacent blocks are written at once). Each big page needs a bit per block of RAM for bookkeeping.
+  * Default: `0` (disabled), `512` for PC like platforms.
+  * - `typedef ... Mutex`: the mutex used to make the allocator thread safe (see BaseMutex). Available
+  * mutexes are FreeRTOSMutex (FreeRTOS/ESP32) and StdMutex (C++11 on PC like platforms). This is a
+  * coarse lock: one mutex serializes all operations of the allocator, including page hits. Raw
+  * pointers to data that is not locked (e.g. from BaseVAlloc::read()) are not safe (see BaseMutex).
+  * Default: NoMutex (not thread safe, no overhead).
+  * - `typedef ... PagePolicy`: the replacement policy used to select which *big* page is swapped out.
+  * Available policies are LRUPagePolicy, ClockPagePolicy and TwoQueuePagePolicy (scan resistant).
+  * Default: DefaultPagePolicy (built-in heuristic without any overhead).
+  * - `static const uint8_t readAhead`: the amount of *big* pages that are prefetched when sequential
+  * access is detected (see BaseVAlloc::prefetch()). Only empty or unmodified pages are used for this.
+  * This value should be lower than `bigPageCount`. Default: `0` (disabled).
+  * - `static const uint8_t slabCount`: the amount of *slabs* used for small allocations. A slab is a
+  * block of virtual memory that is divided in equally sized slots (a power of two, each slab contains at
+  * least eight slots). Used slots are administered in RAM, hence, allocating and freeing small blocks
+  * does not require any access to virtual memory and has no memory overhead per block. Larger blocks,
+  * or blocks that do not fit in the available slabs, are allocated as usual. Each slab needs a few bytes
+  * of RAM plus a bit for every 16 (8 on most MCUs) bytes of the slab. Default: `0` (disabled), `16` for
+  * PC like platforms.
+  * - `static const uint16_t slabSize`: the size of a slab (see `slabCount`). Default: `512`, `1024` for PC
+  * like platforms.
+  *
   * @sa @ref alloc_properties.ino example
   *
   * @var DefaultAllocProperties::smallPageCount
@@ -184,6 +271,21 @@ SDVAllocP<AllocProperties> alloc;
   * @brief The size of a *big* page. @hideinitializer
   */
 
+/**
+ * @brief Allocator properties for allocators that are used by another allocator (i.e. by
+ * TieredVAllocP or CompressedVAllocP).
+ *
+ * The memory pages of such allocators are not used, hence, these properties keep them as small as
+ * possible.
+ */
+struct TierAllocProperties
+{
+    static const uint8_t smallPageCount = 1, smallPageSize = 8;
+    static const uint8_t mediumPageCount = 1, mediumPageSize = 8;
+    static const uint8_t bigPageCount = 1;
+    static const uint16_t bigPageSize = 32;
+};
+
 /**
   * @example alloc_properties.ino
   * This example shows the size and amount of memory pages of an allocator can be configured.
@@ -208,6 +310,14 @@ SDVAllocP<AllocProperties> alloc;
 #ifndef VIRTMEM_TRACE_STATS
 #define VIRTMEM_TRACE_STATS
 #endif
+
+#ifndef VIRTMEM_TRACE_COUNTERS
+#define VIRTMEM_TRACE_COUNTERS
+#endif
+
+#ifndef VIRTMEM_TRACE_ACCESS
+#define VIRTMEM_TRACE_ACCESS
+#endif
 #endif
 
 #endif // CONFIG_H
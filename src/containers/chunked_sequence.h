@@ -0,0 +1,507 @@
+#ifndef VIRTMEM_CHUNKED_SEQUENCE_H
+#define VIRTMEM_CHUNKED_SEQUENCE_H
+
+/**
+  * @file
+  * @brief This file contains the base class of the sequence containers (VVector and VDeque).
+  */
+
+#include "config/config.h"
+#include "internal/utils.h"
+#include "internal/vptr.h"
+#include "internal/vptr_utils.h"
+
+#include <string.h>
+
+namespace virtmem {
+
+// \cond HIDDEN_SYMBOLS
+namespace private_utils {
+
+// Circular array with the addresses of the chunks of a container, stored in virtual memory. The
+// address of the chunk that was accessed last is cached.
+template <typename A> class ChunkMap
+{
+    enum { INITIAL_CAPACITY = 4 };
+
+    VPtrNum map;
+    VPtrSize capacity, first, count;
+    mutable VPtrSize cachedIndex;
+    mutable VPtrNum cachedChunk; // zero if nothing is cached
+
+    ChunkMap(const ChunkMap &);
+    ChunkMap &operator=(const ChunkMap &);
+
+    static BaseVAlloc *getAlloc(void) { return A::getInstance(); }
+    VPtrNum getEntryNum(VPtrSize i) const { return map + ((first + i) % capacity) * sizeof(VPtrNum); }
+    void setEntry(VPtrSize i, VPtrNum chunk) { getAlloc()->write(getEntryNum(i), &chunk, sizeof(VPtrNum)); }
+
+    void grow(void)
+    {
+        const VPtrSize newcap = capacity ? (capacity * 2) : (VPtrSize)INITIAL_CAPACITY;
+        const VPtrNum newmap = getAlloc()->allocRaw(newcap * sizeof(VPtrNum));
+        for (VPtrSize i=0; i<count; ++i)
+        {
+            const VPtrNum chunk = get(i);
+            getAlloc()->write(newmap + i * sizeof(VPtrNum), &chunk, sizeof(VPtrNum));
+        }
+        if (map)
+            getAlloc()->freeRaw(map);
+        map = newmap; capacity = newcap; first = 0;
+        cachedChunk = 0;
+    }
+
+public:
+    ChunkMap(void) : map(0), capacity(0), first(0), count(0), cachedIndex(0), cachedChunk(0) { }
+
+    VPtrSize size(void) const { return count; }
+    VPtrNum get(VPtrSize i) const
+    {
+        if (!cachedChunk || cachedIndex != i)
+        {
+            cachedChunk = *static_cast<const VPtrNum *>(getAlloc()->read(getEntryNum(i), sizeof(VPtrNum)));
+            cachedIndex = i;
+        }
+        return cachedChunk;
+    }
+
+    void pushBack(VPtrNum chunk)
+    {
+        if (count == capacity)
+            grow();
+        setEntry(count++, chunk);
+    }
+    void pushFront(VPtrNum chunk)
+    {
+        if (count == capacity)
+            grow();
+        first = (first + capacity - 1) % capacity;
+        ++count;
+        setEntry(0, chunk);
+        cachedChunk = 0;
+    }
+    VPtrNum popBack(void)
+    {
+        const VPtrNum ret = get(count - 1);
+        --count;
+        cachedChunk = 0;
+        return ret;
+    }
+    VPtrNum popFront(void)
+    {
+        const VPtrNum ret = get(0);
+        first = (first + 1) % capacity;
+        --count;
+        cachedChunk = 0;
+        return ret;
+    }
+
+    // NOTE: chunks are not freed
+    void clear(void)
+    {
+        if (map)
+            getAlloc()->freeRaw(map);
+        map = 0; capacity = first = count = 0;
+        cachedChunk = 0;
+    }
+};
+
+// Provides writable access to data in virtual memory with a single lookup (see
+// BaseVAlloc::acquireWritable()). Data that partially overlaps with a lock is locked instead.
+template <typename T> class WritableData
+{
+    BaseVAlloc *alloc;
+    VPtrNum ptr;
+    T *data;
+    bool locked;
+
+    WritableData(const WritableData &);
+    WritableData &operator=(const WritableData &);
+
+public:
+    WritableData(BaseVAlloc *a, VPtrNum p) : alloc(a), ptr(p), locked(false)
+    {
+        data = static_cast<T *>(alloc->acquireWritable(p, sizeof(T)));
+        if (!data)
+        {
+            data = static_cast<T *>(alloc->makeDataLock(p, sizeof(T)));
+            locked = true;
+        }
+    }
+    ~WritableData(void) { if (locked) alloc->releaseLock(ptr); }
+
+    T *get(void) { return data; }
+};
+
+}
+// \endcond
+
+/**
+ * @brief Base class of sequence containers that store their elements in chunks of virtual memory.
+ *
+ * Elements are stored in separately allocated _chunks_, each of which holds as many elements as
+ * fit in a *big* memory page (see getElementsPerChunk()). Hence, elements never straddle a page
+ * boundary and a whole chunk can be accessed through a single lock (see VPtrLock). Growing the
+ * container allocates new chunks, existing elements never move.
+ *
+ * The addresses of all chunks are stored in a small table in virtual memory. The address of the
+ * chunk that was accessed last is kept in RAM, which makes sequential access cheap.
+ *
+ * Elements can be accessed through virtual pointers (see getPtr()), by value (get() and set()),
+ * or, most efficiently, through locked chunks (see begin() and forEachChunk()). The bulk
+ * functions (e.g. append(), erase() and resize()) lock a chunk at a time as well.
+ *
+ * @tparam T Type of the elements. The size of an element must not exceed the size of a *big* page.
+ * @tparam A Type of the virtual memory allocator.
+ *
+ * @note Like all data in virtual memory, elements are copied bytewise (e.g. when memory pages are
+ * swapped or elements move after erase()). Elements should therefore not contain pointers to
+ * themselves.
+ * @note The allocator should be started before the container is used, and containers should be
+ * cleared (or destroyed) before the allocator is stopped.
+ * @note Bulk functions may lock two chunks at the same time, which requires at least two *big* (or
+ * *medium*) pages that can be locked.
+ * @sa VVector, VDeque
+ */
+template <typename T, typename A> class VChunkedSequence
+{
+public:
+    typedef VPtr<T, A> TVPtr; //!< Virtual pointer type to elements.
+
+    /**
+     * @brief Iterator used to access the elements of a container through locks.
+     *
+     * The elements of the current chunk (or part of it) are locked, and the next part of the
+     * container is locked when the iterator moves past it. Iterators are obtained by begin() and
+     * end().
+     * @note Iterators cannot be assigned, and the container should not be resized while an
+     * iterator is in use.
+     */
+    class Iterator
+    {
+        VChunkedSequence *seq;
+        VPtrLock<TVPtr> vlock;
+        VPtrSize next; // first element after the locked part
+        T *cur, *lockEnd;
+        bool readOnly;
+
+        Iterator &operator=(const Iterator &);
+
+        void lockNext(void)
+        {
+            vlock.unlock();
+            if (!seq || next >= seq->elements)
+            {
+                cur = lockEnd = 0;
+                return;
+            }
+
+            const VPtrSize count = seq->getContiguous(next, seq->elements - next);
+            vlock.lock(seq->getPtr(next), (VirtPageSize)(count * sizeof(T)), readOnly);
+            const VPtrSize locked = vlock.getLockSize() / sizeof(T);
+            ASSERT(locked > 0);
+            cur = *vlock;
+            lockEnd = cur + locked;
+            next += locked;
+        }
+
+        Iterator(VChunkedSequence *s, bool ro) : seq(s), next(0), cur(0), lockEnd(0), readOnly(ro) { lockNext(); }
+
+        friend class VChunkedSequence;
+
+    public:
+        T &operator*(void) { return *cur; } //!< Returns the current element.
+        T *operator->(void) { return cur; } //!< Provides access to the current element.
+        //! Moves to the next element.
+        Iterator &operator++(void) { if (++cur == lockEnd) lockNext(); return *this; }
+        bool operator==(const Iterator &other) const { return cur == other.cur; } //!< Compares iterators.
+        bool operator!=(const Iterator &other) const { return cur != other.cur; } //!< Compares iterators.
+    };
+
+private:
+    // Functions applied to locked elements
+    struct CopyConstruct
+    {
+        const T *src;
+        CopyConstruct(const T *s) : src(s) { }
+        void operator()(T *data, VPtrSize n) { for (VPtrSize i=0; i<n; ++i, ++src) new (&data[i]) T(*src); }
+    };
+    struct FillConstruct
+    {
+        const T &value;
+        FillConstruct(const T &v) : value(v) { }
+        void operator()(T *data, VPtrSize n) { for (VPtrSize i=0; i<n; ++i) new (&data[i]) T(value); }
+    };
+    struct Destruct
+    {
+        void operator()(T *data, VPtrSize n) { for (VPtrSize i=0; i<n; ++i) data[i].~T(); }
+    };
+
+    VChunkedSequence(const VChunkedSequence &); // not copyable
+    VChunkedSequence &operator=(const VChunkedSequence &);
+
+    friend class Iterator;
+
+protected:
+    // \cond HIDDEN_SYMBOLS
+    private_utils::ChunkMap<A> chunks;
+    VPtrSize elements;
+    VirtPageSize frontOffset; // unused elements at the start of the first chunk
+    mutable VirtPageSize chunkElements; // initialized on first use, as the allocator may not exist yet
+
+    VChunkedSequence(void) : elements(0), frontOffset(0), chunkElements(0) { }
+    ~VChunkedSequence(void) { clear(); }
+
+    static BaseVAlloc *getAlloc(void) { return A::getInstance(); }
+    VPtrSize getChunkBytes(void) const { return (VPtrSize)getElementsPerChunk() * sizeof(T); }
+
+    VPtrNum getElementNum(VPtrSize i) const
+    {
+        const VPtrSize j = i + frontOffset, ce = getElementsPerChunk();
+        return chunks.get(j / ce) + (j % ce) * sizeof(T);
+    }
+
+    // Amount of elements, up to n, that are stored contiguously from element i
+    VPtrSize getContiguous(VPtrSize i, VPtrSize n) const
+    {
+        const VPtrSize ce = getElementsPerChunk();
+        return private_utils::minimal(n, (VPtrSize)(ce - ((i + frontOffset) % ce)));
+    }
+
+    void addFrontChunk(void)
+    {
+        chunks.pushFront(getAlloc()->allocRaw(getChunkBytes()));
+        frontOffset += getElementsPerChunk();
+    }
+    void freeFrontChunk(void)
+    {
+        getAlloc()->freeRaw(chunks.popFront());
+        frontOffset -= getElementsPerChunk();
+    }
+
+    void construct(VPtrSize i, const T &value)
+    {
+        private_utils::WritableData<T> d(getAlloc(), getElementNum(i));
+        new (d.get()) T(value);
+    }
+    void destruct(VPtrSize i)
+    {
+        if (!private_utils::TrivialDestructor<T>::value)
+            static_cast<T *>(getAlloc()->read(getElementNum(i), sizeof(T)))->~T();
+    }
+    void destructRange(VPtrSize first, VPtrSize n)
+    {
+        if (!private_utils::TrivialDestructor<T>::value)
+        {
+            Destruct fn;
+            lockRange(first, n, true, false, fn);
+        }
+    }
+
+    // Calls fn for every locked part of the elements [first, first+n)
+    template <typename F> void lockRange(VPtrSize first, VPtrSize n, bool ro, bool nofetch, F &fn)
+    {
+        VPtrLock<TVPtr> vlock;
+        while (n)
+        {
+            vlock.lock(getPtr(first), (VirtPageSize)(getContiguous(first, n) * sizeof(T)), ro, nofetch);
+            const VPtrSize locked = vlock.getLockSize() / sizeof(T);
+            ASSERT(locked > 0);
+            fn(*vlock, locked);
+            vlock.unlock();
+            first += locked; n -= locked;
+        }
+    }
+
+    // Moves the elements [src, size()) towards the start of the container, to dst
+    void moveElements(VPtrSize dst, VPtrSize src)
+    {
+        // NOTE: if the source is within the locked destination, the same page is used for both locks
+        VPtrLock<TVPtr> dlock, slock;
+        while (src < elements)
+        {
+            dlock.lock(getPtr(dst), (VirtPageSize)(getContiguous(dst, elements - src) * sizeof(T)));
+            slock.lock(getPtr(src), (VirtPageSize)(getContiguous(src, elements - src) * sizeof(T)), true);
+            const VPtrSize n = private_utils::minimal(dlock.getLockSize(), slock.getLockSize()) / sizeof(T);
+            ASSERT(n > 0);
+            ::memmove(static_cast<void *>(*dlock), *slock, n * sizeof(T));
+            slock.unlock(); dlock.unlock();
+            dst += n; src += n;
+        }
+    }
+    // \endcond
+
+public:
+    VPtrSize size(void) const { return elements; } //!< Returns the amount of elements.
+    bool empty(void) const { return elements == 0; } //!< Returns `true` if the container has no elements.
+    //! Returns the amount of elements that can be stored without allocating new chunks.
+    VPtrSize capacity(void) const { return chunks.size() * getElementsPerChunk() - frontOffset; }
+    //! Returns the amount of elements per chunk, i.e. the amount that fit in a *big* page.
+    VirtPageSize getElementsPerChunk(void) const
+    {
+        if (!chunkElements)
+        {
+            chunkElements = A::getInstance()->getBigPageSize() / sizeof(T);
+            ASSERT(chunkElements > 0);
+        }
+        return chunkElements;
+    }
+
+    //! Returns a virtual pointer to element `i`. Only elements of the same chunk are stored contiguously.
+    TVPtr getPtr(VPtrSize i) const { TVPtr ret; ret.setRawNum(getElementNum(i)); return ret; }
+    //! Returns (a copy of) element `i`.
+    T get(VPtrSize i) const
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        return *static_cast<const T *>(getAlloc()->read(getElementNum(i), sizeof(T)));
+    }
+    //! Assigns `value` to element `i`.
+    void set(VPtrSize i, const T &value)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        private_utils::WritableData<T> d(getAlloc(), getElementNum(i));
+        *d.get() = value;
+    }
+    T front(void) const { return get(0); } //!< Returns (a copy of) the first element.
+    T back(void) const { return get(elements - 1); } //!< Returns (a copy of) the last element.
+
+    //! Adds an element to the end of the container.
+    void pushBack(const T &value)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        reserve(elements + 1);
+        construct(elements, value);
+        ++elements;
+    }
+    //! Removes the last element. Its chunk remains allocated (see shrinkToFit()).
+    void popBack(void)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        ASSERT(elements > 0);
+        destruct(--elements);
+    }
+
+    /**
+     * @brief Adds multiple elements to the end of the container.
+     *
+     * The elements are copied in chunks to locks that are not read first (see VPtrLock::VPtrLock),
+     * which is much faster than adding them one by one.
+     * @param data Pointer to the elements to add.
+     * @param n Amount of elements.
+     */
+    void append(const T *data, VPtrSize n)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        reserve(elements + n);
+        CopyConstruct fn(data);
+        lockRange(elements, n, false, true, fn);
+        elements += n;
+    }
+
+    /**
+     * @brief Removes elements.
+     *
+     * The elements after the removed elements are moved towards the start of the container, a
+     * locked chunk at a time.
+     * @param pos Index of the first element to remove.
+     * @param n Amount of elements to remove.
+     */
+    void erase(VPtrSize pos, VPtrSize n=1)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        ASSERT((pos + n) <= elements);
+        destructRange(pos, n);
+        moveElements(pos, pos + n);
+        elements -= n;
+    }
+
+    /**
+     * @brief Changes the amount of elements.
+     * @param n The new amount of elements.
+     * @param value Value that is copied to new elements.
+     */
+    void resize(VPtrSize n, const T &value=T())
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        if (n < elements)
+            erase(n, elements - n);
+        else if (n > elements)
+        {
+            reserve(n);
+            FillConstruct fn(value);
+            lockRange(elements, n - elements, false, true, fn);
+            elements = n;
+        }
+    }
+
+    //! Allocates chunks until `n` elements can be stored.
+    void reserve(VPtrSize n)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        while (capacity() < n)
+            chunks.pushBack(getAlloc()->allocRaw(getChunkBytes()));
+    }
+
+    //! Frees chunks that do not contain any elements.
+    void shrinkToFit(void)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        const VPtrSize ce = getElementsPerChunk();
+        const VPtrSize used = (elements) ? ((frontOffset + elements + ce - 1) / ce) : 0;
+        while (chunks.size() > used)
+            getAlloc()->freeRaw(chunks.popBack());
+        if (!chunks.size())
+        {
+            chunks.clear();
+            frontOffset = 0;
+        }
+    }
+
+    //! Removes all elements and frees all memory.
+    void clear(void)
+    {
+        if (!chunks.size())
+        {
+            chunks.clear(); // the chunk table may still exist
+            return;
+        }
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        destructRange(0, elements);
+        elements = 0;
+        shrinkToFit();
+    }
+
+    /**
+     * @brief Calls a function for each locked part of the container.
+     * @param fn A function (or function object) which is called with a pointer to the locked
+     * elements (`T *`) and their amount (VPtrSize). Every call covers at most one chunk.
+     * @param ro Whether the elements are only read (`true`) or (also) modified (`false`).
+     * @sa virtmem::forEachChunk
+     */
+    template <typename F> void forEachChunk(F fn, bool ro=false)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        lockRange(0, elements, ro, false, fn);
+    }
+
+    /**
+     * @brief Returns an iterator to the first element.
+     * @param ro Whether the elements are only read (`true`) or (also) modified (`false`).
+     *
+     * Example:
+     * @code
+     * int sum = 0;
+     * for (virtmem::VVector<int, SDVAlloc>::Iterator it=vec.begin(true); it!=vec.end(); ++it)
+     *     sum += *it;
+     * // or on C++11
+     * for (int &i : vec)
+     *     sum += i;
+     * @endcode
+     */
+    Iterator begin(bool ro=false) { return Iterator(this, ro); }
+    Iterator end(void) { return Iterator(0, true); } //!< Returns an iterator past the last element.
+};
+
+}
+
+#endif // VIRTMEM_CHUNKED_SEQUENCE_H
@@ -0,0 +1,70 @@
+#ifndef VIRTMEM_VDEQUE_H
+#define VIRTMEM_VDEQUE_H
+
+/**
+  * @file
+  * @brief This file contains the virtual memory double-ended queue container.
+  */
+
+#include "chunked_sequence.h"
+
+namespace virtmem {
+
+/**
+ * @brief Double-ended queue in virtual memory, which is stored in page sized chunks.
+ *
+ * This container is similar to VVector, but elements can also be added and removed at the
+ * front, similar to `std::deque`. This makes it suitable for FIFO queues, such as buffers for
+ * sensor data or messages. Chunks at the front are freed as soon as all their elements were
+ * removed.
+ *
+ * Example:
+ * @code
+ * virtmem::VDeque<Message, SDVAlloc> queue;
+ * queue.pushBack(msg);
+ * ...
+ * while (!queue.empty())
+ * {
+ *     process(queue.front());
+ *     queue.popFront();
+ * }
+ * @endcode
+ *
+ * @tparam T Type of the elements.
+ * @tparam A Type of the virtual memory allocator.
+ * @sa VChunkedSequence, VVector
+ */
+template <typename T, typename A> class VDeque : public VChunkedSequence<T, A>
+{
+    typedef VChunkedSequence<T, A> Base;
+
+public:
+    VDeque(void) { } //!< Constructs an empty queue. No memory is allocated until elements are added.
+
+    //! Adds an element to the front of the queue.
+    void pushFront(const T &value)
+    {
+        BaseVAlloc::AccessGuard guard(Base::getAlloc());
+        if (this->frontOffset == 0)
+            this->addFrontChunk();
+        --this->frontOffset;
+        ++this->elements;
+        this->construct(0, value);
+    }
+
+    //! Removes the first element. Its chunk is freed if it becomes empty.
+    void popFront(void)
+    {
+        BaseVAlloc::AccessGuard guard(Base::getAlloc());
+        ASSERT(this->elements > 0);
+        this->destruct(0);
+        ++this->frontOffset;
+        --this->elements;
+        if (this->frontOffset == this->getElementsPerChunk())
+            this->freeFrontChunk();
+    }
+};
+
+}
+
+#endif // VIRTMEM_VDEQUE_H
@@ -0,0 +1,372 @@
+#ifndef VIRTMEM_VHASHMAP_H
+#define VIRTMEM_VHASHMAP_H
+
+/**
+  * @file
+  * @brief This file contains the virtual memory hash map container.
+  */
+
+#include "chunked_sequence.h"
+#include "internal/vspan.h"
+
+namespace virtmem {
+
+/**
+ * @brief Default hash function of VHashMap.
+ *
+ * Computes a FNV-1a hash over the bytes of the key. This is suitable for numeric keys and
+ * structures without padding bytes. Other keys (e.g. classes that contain pointers) need a custom
+ * hash function, which is a function object with the same signature.
+ * @tparam K Type of the key.
+ */
+template <typename K> struct VHash
+{
+    //! Returns the hash of `key`.
+    uint32_t operator()(const K &key) const
+    {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(&key);
+        uint32_t ret = 2166136261UL;
+        for (uint16_t i=0; i<sizeof(K); ++i)
+            ret = (ret ^ data[i]) * 16777619UL;
+        return ret;
+    }
+};
+
+/**
+ * @brief Hash map in virtual memory that keeps the lookup of a key within a single page.
+ *
+ * This container maps keys to values with open addressing. Its slots are divided in _groups_ that
+ * fit in a *big* memory page. A key is only stored in another group than its home group (derived
+ * from its hash) when the home group is full. As the table is never more than 75% full, this is
+ * rare, hence, looking up a key typically involves a single page, which is accessed directly
+ * (without copying slots).
+ *
+ * Example:
+ * @code
+ * virtmem::VHashMap<uint32_t, float, SDVAlloc> map;
+ * map.set(1234, 1.5);
+ * float v;
+ * if (map.get(1234, v))
+ *     Serial.println(v);
+ * map.remove(1234);
+ * @endcode
+ *
+ * @tparam K Type of the keys, which should be comparable with `==`. Comparing keys should not
+ * access virtual memory.
+ * @tparam V Type of the values.
+ * @tparam A Type of the virtual memory allocator.
+ * @tparam H Hash function, see VHash.
+ *
+ * @note Like all data in virtual memory, keys and values are copied bytewise (e.g. when memory
+ * pages are swapped). They should therefore not contain pointers to themselves.
+ * @note The allocator should be started before the map is used, and maps should be cleared (or
+ * destroyed) before the allocator is stopped.
+ * @note Growing the table (see reserve()) locks a part of the old table while entries are moved,
+ * which requires at least two *big* pages.
+ * @sa VVector, VDeque
+ */
+template <typename K, typename V, typename A, typename H=VHash<K> > class VHashMap
+{
+public:
+    typedef VPtr<V, A> TValuePtr; //!< Virtual pointer type to values.
+
+private:
+    enum { SLOT_EMPTY = 0, SLOT_USED, SLOT_DELETED };
+
+    struct Slot
+    {
+        K key;
+        V value;
+        uint8_t state;
+    };
+
+    VPtrNum table;
+    VPtrSize groupCount, used, deleted;
+    mutable VirtPageSize groupSlots; // initialized on first use, as the allocator may not exist yet
+    H hash;
+
+    VHashMap(const VHashMap &); // not copyable
+    VHashMap &operator=(const VHashMap &);
+
+    static BaseVAlloc *getAlloc(void) { return A::getInstance(); }
+    VirtPageSize getGroupSlots(void) const
+    {
+        if (!groupSlots)
+        {
+            groupSlots = A::getInstance()->getBigPageSize() / sizeof(Slot);
+            ASSERT(groupSlots > 0);
+        }
+        return groupSlots;
+    }
+    VPtrNum getSlotNum(VPtrSize s) const { return table + s * sizeof(Slot); }
+
+    // Searches for a key along its probe sequence: its home group, followed by the next groups.
+    // Returns the slot of the key if found, or otherwise the first slot where it can be inserted.
+    VPtrSize findSlot(const K &key, bool &found) const
+    {
+        const uint32_t h = hash(key);
+        const VirtPageSize gslots = getGroupSlots();
+        const VirtPageSize start = (h / groupCount) % gslots;
+        const VPtrSize capacity = getCapacity();
+        VPtrSize group = h % groupCount, insertslot = capacity;
+
+        found = false;
+        for (VPtrSize g=0; g<groupCount; ++g, group=((group + 1) % groupCount))
+        {
+            // the whole group is accessed in a single page
+            const VPtrSize first = group * gslots;
+            const Slot *slots = static_cast<const Slot *>(getAlloc()->read(getSlotNum(first), gslots * sizeof(Slot)));
+            for (VirtPageSize i=0; i<gslots; ++i)
+            {
+                const VirtPageSize s = (start + i) % gslots;
+                if (slots[s].state == SLOT_EMPTY)
+                    return (insertslot != capacity) ? insertslot : (first + s);
+                if (slots[s].state == SLOT_DELETED)
+                {
+                    if (insertslot == capacity)
+                        insertslot = first + s;
+                }
+                else if (slots[s].key == key)
+                {
+                    found = true;
+                    return first + s;
+                }
+            }
+        }
+        return insertslot;
+    }
+
+    void insertNew(const K &key, const V &value)
+    {
+        bool found;
+        const VPtrSize s = findSlot(key, found);
+        ASSERT(!found && s < getCapacity());
+        private_utils::WritableData<Slot> d(getAlloc(), getSlotNum(s));
+        Slot *slot = d.get();
+        if (slot->state == SLOT_DELETED)
+            --deleted;
+        new (&slot->key) K(key);
+        new (&slot->value) V(value);
+        slot->state = SLOT_USED;
+        ++used;
+    }
+
+    // Rebuilds the table with the given amount of groups, which also removes deleted slots
+    void rehash(VPtrSize groups)
+    {
+        const VPtrNum oldtable = table;
+        const VPtrSize oldcapacity = getCapacity();
+
+        const VPtrSize bytes = groups * getGroupSlots() * sizeof(Slot);
+        table = getAlloc()->allocRaw(bytes);
+        getAlloc()->zeroRaw(table, bytes);
+        groupCount = groups;
+        used = deleted = 0;
+
+        if (!oldtable)
+            return;
+
+        // entries are moved while a part of the old table is locked
+        VPtr<Slot, A> oldptr;
+        oldptr.setRawNum(oldtable);
+        VSpan<Slot, A> span(oldptr, oldcapacity, true);
+        while (span.next())
+        {
+            Slot *slots = span.data();
+            for (VPtrSize i=0; i<span.size(); ++i)
+            {
+                if (slots[i].state == SLOT_USED)
+                {
+                    insertNew(slots[i].key, slots[i].value);
+                    slots[i].key.~K();
+                    slots[i].value.~V();
+                }
+            }
+        }
+        getAlloc()->freeRaw(oldtable);
+    }
+
+    // Makes sure that another key can be inserted without exceeding the maximum load
+    void reserveInsert(void)
+    {
+        const VPtrSize capacity = getCapacity();
+        if ((used + deleted + 1) * 4 <= capacity * 3)
+            return;
+        if ((used + 1) * 2 <= capacity)
+            rehash(groupCount); // mostly deleted slots
+        else
+            rehash(groupCount ? (groupCount * 2) : 1);
+    }
+
+public:
+    //! Constructs an empty map. No memory is allocated until an entry is added.
+    VHashMap(const H &h=H()) : table(0), groupCount(0), used(0), deleted(0), groupSlots(0), hash(h) { }
+    ~VHashMap(void) { clear(); } //!< Destroys the map, see clear().
+
+    VPtrSize size(void) const { return used; } //!< Returns the amount of entries.
+    bool empty(void) const { return used == 0; } //!< Returns `true` if the map has no entries.
+    //! Returns the amount of slots. At most 75% of them contain an entry.
+    VPtrSize getCapacity(void) const { return groupCount * getGroupSlots(); }
+
+    /**
+     * @brief Adds an entry, or replaces the value of an existing entry.
+     * @param key The key of the entry.
+     * @param value The value.
+     * @return `true` if a new entry was added, `false` if the value of an existing entry was replaced.
+     */
+    bool set(const K &key, const V &value)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        if (groupCount)
+        {
+            bool found;
+            const VPtrSize s = findSlot(key, found);
+            if (found)
+            {
+                private_utils::WritableData<Slot> d(getAlloc(), getSlotNum(s));
+                d.get()->value = value;
+                return false;
+            }
+        }
+
+        reserveInsert();
+        insertNew(key, value);
+        return true;
+    }
+
+    /**
+     * @brief Retrieves the value of an entry.
+     * @param key The key of the entry.
+     * @param value Receives (a copy of) the value if the entry was found.
+     * @return `true` if the entry was found, `false` otherwise.
+     */
+    bool get(const K &key, V &value) const
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        if (!groupCount)
+            return false;
+        bool found;
+        const VPtrSize s = findSlot(key, found);
+        if (found)
+            value = static_cast<const Slot *>(getAlloc()->read(getSlotNum(s), sizeof(Slot)))->value;
+        return found;
+    }
+
+    /**
+     * @brief Returns a virtual pointer to the value of an entry.
+     * @param key The key of the entry.
+     * @return Pointer to the value, or a null pointer if the entry was not found.
+     * @note The pointer is invalidated when entries are added or removed.
+     */
+    TValuePtr find(const K &key) const
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        TValuePtr ret;
+        ret.setRawNum(0);
+        if (groupCount)
+        {
+            bool found;
+            const VPtrSize s = findSlot(key, found);
+            if (found)
+                ret.setRawNum(getSlotNum(s) + private_utils::getMembrOffset(&Slot::value));
+        }
+        return ret;
+    }
+
+    //! Returns `true` if an entry with the given key exists.
+    bool contains(const K &key) const
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        bool found = false;
+        if (groupCount)
+            findSlot(key, found);
+        return found;
+    }
+
+    /**
+     * @brief Removes an entry.
+     * @param key The key of the entry.
+     * @return `true` if the entry was found and removed, `false` otherwise.
+     */
+    bool remove(const K &key)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        if (!groupCount)
+            return false;
+        bool found;
+        const VPtrSize s = findSlot(key, found);
+        if (found)
+        {
+            private_utils::WritableData<Slot> d(getAlloc(), getSlotNum(s));
+            Slot *slot = d.get();
+            slot->key.~K();
+            slot->value.~V();
+            slot->state = SLOT_DELETED;
+            --used; ++deleted;
+        }
+        return found;
+    }
+
+    //! Grows the table (if needed) so that `n` entries can be stored without rebuilding it.
+    void reserve(VPtrSize n)
+    {
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        VPtrSize groups = groupCount ? groupCount : 1;
+        while ((groups * getGroupSlots() * 3) < (n * 4))
+            groups *= 2;
+        if (groups != groupCount)
+            rehash(groups);
+    }
+
+    //! Removes all entries and frees all memory.
+    void clear(void)
+    {
+        if (!table)
+            return;
+
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        if (!private_utils::TrivialDestructor<K>::value || !private_utils::TrivialDestructor<V>::value)
+            forEach(Destruct(), true);
+        getAlloc()->freeRaw(table);
+        table = 0;
+        groupCount = used = deleted = 0;
+    }
+
+    /**
+     * @brief Calls a function for each entry.
+     *
+     * The table is processed a locked part at a time (see VSpan).
+     * @param fn A function (or function object) which is called with the key (`const K &`) and
+     * value (`V &`) of each entry. It should not add or remove entries.
+     * @param ro Whether values are only read (`true`) or (also) modified (`false`).
+     */
+    template <typename F> void forEach(F fn, bool ro=false)
+    {
+        if (!table)
+            return;
+
+        BaseVAlloc::AccessGuard guard(getAlloc());
+        VPtr<Slot, A> ptr;
+        ptr.setRawNum(table);
+        VSpan<Slot, A> span(ptr, getCapacity(), ro);
+        while (span.next())
+        {
+            Slot *slots = span.data();
+            for (VPtrSize i=0; i<span.size(); ++i)
+            {
+                if (slots[i].state == SLOT_USED)
+                    fn(static_cast<const K &>(slots[i].key), slots[i].value);
+            }
+        }
+    }
+
+private:
+    struct Destruct
+    {
+        void operator()(const K &key, V &value) { key.~K(); value.~V(); }
+    };
+};
+
+}
+
+#endif // VIRTMEM_VHASHMAP_H
@@ -0,0 +1,47 @@
+#ifndef VIRTMEM_VVECTOR_H
+#define VIRTMEM_VVECTOR_H
+
+/**
+  * @file
+  * @brief This file contains the virtual memory vector container.
+  */
+
+#include "chunked_sequence.h"
+
+namespace virtmem {
+
+/**
+ * @brief Dynamic array in virtual memory, which is stored in page sized chunks.
+ *
+ * This container provides an array that grows at its end, similar to `std::vector`. Unlike
+ * arrays allocated with VAlloc::newArray(), elements are laid out in chunks that fit in a *big*
+ * memory page (see VChunkedSequence), so that accessing an element never involves more than one
+ * page, and growing never copies existing elements.
+ *
+ * Example:
+ * @code
+ * virtmem::VVector<int, SDVAlloc> vec;
+ * for (int i=0; i<1000; ++i)
+ *     vec.pushBack(i);
+ *
+ * int sum = 0;
+ * for (virtmem::VVector<int, SDVAlloc>::Iterator it=vec.begin(true); it!=vec.end(); ++it)
+ *     sum += *it;
+ *
+ * vec.erase(10, 100); // removes elements 10-109
+ * *vec.getPtr(5) += 3; // access through a virtual pointer
+ * @endcode
+ *
+ * @tparam T Type of the elements.
+ * @tparam A Type of the virtual memory allocator.
+ * @sa VChunkedSequence, VDeque, VHashMap
+ */
+template <typename T, typename A> class VVector : public VChunkedSequence<T, A>
+{
+public:
+    VVector(void) { } //!< Constructs an empty vector. No memory is allocated until elements are added.
+};
+
+}
+
+#endif // VIRTMEM_VVECTOR_H
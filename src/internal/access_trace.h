@@ -0,0 +1,143 @@
+#ifndef VIRTMEM_ACCESS_TRACE_H
+#define VIRTMEM_ACCESS_TRACE_H
+
+/**
+  * @file
+  * @brief This file contains classes to record virtual memory accesses.
+  */
+
+#include <stdint.h>
+
+namespace virtmem {
+
+/**
+ * @brief Types of events recorded by access tracers (see BaseAccessTracer).
+ *
+ * Every event carries an address and a size. The meaning of both is given below.
+ */
+enum AccessTraceEvent
+{
+    TRACE_START = 0, //!< The allocator was started, the address field contains the pool size.
+    TRACE_READ, //!< Data was read (see BaseVAlloc::read()).
+    TRACE_WRITE, //!< Data was written (see BaseVAlloc::write()).
+    TRACE_MODIFY, //!< Data was read and modified (see BaseVAlloc::acquireWritable()).
+    TRACE_READ_BULK, //!< Data was read with BaseVAlloc::readBulk().
+    TRACE_WRITE_BULK, //!< Data was written with BaseVAlloc::writeBulk().
+    TRACE_LOCK, //!< Data was locked for reading and writing (e.g. by VPtrLock).
+    TRACE_LOCK_RO, //!< Data was locked read-only.
+    TRACE_UNLOCK, //!< A lock was released, the size is zero.
+    TRACE_FLUSH, //!< All modified data was written (see BaseVAlloc::flush()), the address and size are zero.
+    TRACE_CLEAR, //!< All pages were cleared (see BaseVAlloc::clearPages()), the address and size are zero.
+    TRACE_STOP //!< The allocator was stopped, the address and size are zero.
+};
+
+/**
+ * @brief Interface for classes that record virtual memory accesses.
+ *
+ * Access tracing is only available if \ref VIRTMEM_TRACE_ACCESS is defined. A tracer is set with
+ * BaseVAlloc::setAccessTracer(). Accesses are recorded before they are processed by the allocator,
+ * and include accesses made by the allocator itself (e.g. to administer allocated memory).
+ *
+ * Events are typically stored as compact _records_ of seven bytes: the event type
+ * (AccessTraceEvent), the address (four bytes) and the size (two bytes), both little endian.
+ * Accesses larger than 65535 bytes are split in multiple records, and addresses are truncated to
+ * 32 bits (see \ref VIRTMEM_VPTR_BITS). Such traces can be analyzed by `extras/trace_tuner.py`,
+ * which finds page settings (see DefaultAllocProperties) that minimize the data transferred by
+ * the allocator.
+ *
+ * @sa StreamAccessTracer, BufferAccessTracer
+ */
+class BaseAccessTracer
+{
+public:
+    enum { RECORD_SIZE = 7 }; //!< Size of a compact trace record.
+
+    //! Called for every event. Accesses larger than 65535 bytes are reported in parts.
+    virtual void trace(AccessTraceEvent event, uint32_t address, uint16_t size) = 0;
+
+    //! Stores a compact record of an event in `record` (which should be RECORD_SIZE bytes).
+    static void encode(uint8_t *record, AccessTraceEvent event, uint32_t address, uint16_t size)
+    {
+        record[0] = event;
+        for (uint8_t i=0; i<4; ++i)
+            record[1 + i] = (address >> (i * 8)) & 0xFF;
+        record[5] = size & 0xFF;
+        record[6] = size >> 8;
+    }
+};
+
+/**
+ * @brief Access tracer that writes compact records to a stream.
+ *
+ * This can be used to send traces to a computer (e.g. over the serial port, use `trace_tuner.py
+ * record` to store them) or to write them to a file on an SD card.
+ * @tparam IOStream Type of the stream, which should have a `write(const uint8_t *, size_t)`
+ * function (e.g. `HardwareSerial` or `File`).
+ * @note Tracing slows down every access, and the stream should not be used by the allocator
+ * itself (i.e. use a different serial port when tracing SerialVAllocP).
+ */
+template <typename IOStream> class StreamAccessTracer : public BaseAccessTracer
+{
+    IOStream *stream;
+
+public:
+    //! Constructs the tracer, data is written to stream `s`.
+    StreamAccessTracer(IOStream *s) : stream(s) { }
+
+    // \cond HIDDEN_SYMBOLS
+    void trace(AccessTraceEvent event, uint32_t address, uint16_t size)
+    {
+        uint8_t record[RECORD_SIZE];
+        encode(record, event, address, size);
+        stream->write(record, RECORD_SIZE);
+    }
+    // \endcond
+};
+
+/**
+ * @brief Access tracer that stores compact records in RAM.
+ *
+ * Records are added until the buffer is full, after which further events are dropped (see
+ * hasOverflowed()). The buffer can be sent to a stream with writeTo(), for instance after a
+ * specific part of the program was traced.
+ * @tparam recordCount Maximum amount of records, each record needs BaseAccessTracer::RECORD_SIZE
+ * bytes.
+ */
+template <uint16_t recordCount> class BufferAccessTracer : public BaseAccessTracer
+{
+    uint8_t records[recordCount * RECORD_SIZE];
+    uint16_t count;
+    bool overflow;
+
+public:
+    BufferAccessTracer(void) : count(0), overflow(false) { } //!< Constructs an empty tracer.
+
+    // \cond HIDDEN_SYMBOLS
+    void trace(AccessTraceEvent event, uint32_t address, uint16_t size)
+    {
+        if (count == recordCount)
+            overflow = true;
+        else
+            encode(&records[count++ * RECORD_SIZE], event, address, size);
+    }
+    // \endcond
+
+    const uint8_t *getData(void) const { return records; } //!< Returns the recorded data.
+    uint16_t getRecordCount(void) const { return count; } //!< Returns the amount of recorded events.
+    bool hasOverflowed(void) const { return overflow; } //!< Returns `true` if events were dropped since the buffer was full.
+    void clear(void) { count = 0; overflow = false; } //!< Removes all records.
+
+    /**
+     * @brief Writes all records to a stream and clears the buffer.
+     * @param stream Stream with a `write(const uint8_t *, size_t)` function, see StreamAccessTracer.
+     */
+    template <typename IOStream> void writeTo(IOStream *stream)
+    {
+        stream->write(records, count * RECORD_SIZE);
+        clear();
+    }
+};
+
+}
+
+#endif // VIRTMEM_ACCESS_TRACE_H
@@ -8,12 +8,30 @@
 
 #include "base_alloc.h"
 #include "config/config.h"
+#include "page_policy.h"
+#include "utils.h"
 #include "vptr.h"
 
 namespace virtmem {
 
 template <typename, typename> class VPtr;
 
+// \cond HIDDEN_SYMBOLS
+namespace private_utils {
+
+// Optional allocator properties (see DefaultAllocProperties)
+VIRTMEM_OPTIONAL_PROPERTY(alignBigPages, bool, false)
+VIRTMEM_OPTIONAL_PROPERTY(asyncWriteBack, bool, false)
+VIRTMEM_OPTIONAL_PROPERTY(dirtyGranularity, uint16_t, 0)
+VIRTMEM_OPTIONAL_TYPE_PROPERTY(Mutex, NoMutex)
+VIRTMEM_OPTIONAL_TYPE_PROPERTY(PagePolicy, DefaultPagePolicy)
+VIRTMEM_OPTIONAL_PROPERTY(readAhead, uint8_t, 0)
+VIRTMEM_OPTIONAL_PROPERTY(slabCount, uint8_t, 0)
+VIRTMEM_OPTIONAL_PROPERTY(slabSize, uint16_t, 512)
+
+}
+// \endcond
+
 /**
  * @brief Base template class for virtual memory allocators.
  *
@@ -30,6 +48,27 @@ class VAlloc : public BaseVAlloc
     LockPage smallPagesData[Properties::smallPageCount];
     LockPage mediumPagesData[Properties::mediumPageCount];
     LockPage bigPagesData[Properties::bigPageCount];
+    int8_t bigPageBuckets[private_utils::NextPow2<Properties::bigPageCount>::value];
+    int8_t bigPageChain[Properties::bigPageCount];
+
+    enum
+    {
+        DirtyGranularity = private_utils::dirtyGranularityProperty<Properties>::value,
+        // bytes needed to store a bit for each block of a big page
+        DirtyMapSize = DirtyGranularity ? (((Properties::bigPageSize + DirtyGranularity - 1) / (DirtyGranularity ? DirtyGranularity : 1) + 7) / 8) : 0,
+        SlabCount = private_utils::slabCountProperty<Properties>::value,
+        SlabSize = private_utils::slabSizeProperty<Properties>::value,
+        // bytes needed to store a bit for each slot (of the smallest size) of a slab
+        SlabMapSize = SlabCount ? ((SlabSize / SLAB_MIN_SLOT_SIZE + 7) / 8) : 0
+    };
+    private_utils::StaticArray<uint8_t, Properties::bigPageCount * DirtyMapSize> bigPageDirtyMap;
+    private_utils::StaticArray<Slab, SlabCount> slabsData;
+    private_utils::StaticArray<uint8_t, SlabCount * SlabMapSize> slabMaps;
+    // spare big page buffer for asynchronous write-back
+    private_utils::StaticArray<TAlign, private_utils::asyncWriteBackProperty<Properties>::value ?
+        ((Properties::bigPageSize + sizeof(TAlign) - 1) / sizeof(TAlign)) : 0> writeBackBufferData;
+    typename private_utils::PagePolicyProperty<Properties>::type::template Impl<Properties::bigPageCount> pagePolicy;
+    typename private_utils::MutexProperty<Properties>::type mutex;
 #ifdef NVALGRIND
     uint8_t smallPagePool[Properties::smallPageCount * Properties::smallPageSize] __attribute__ ((aligned (sizeof(TAlign))));
     uint8_t mediumPagePool[Properties::mediumPageCount * Properties::mediumPageSize] __attribute__ ((aligned (sizeof(TAlign))));
@@ -41,6 +80,62 @@ class VAlloc : public BaseVAlloc
 #endif
     static VAlloc *instance;
 
+    template <typename T> static void constructArrayChunk(T *data, VPtrSize n) { for (VPtrSize i=0; i<n; ++i) new (&data[i]) T; }
+    template <typename T> static void destructArrayChunk(T *data, VPtrSize n) { for (VPtrSize i=0; i<n; ++i) data[i].~T(); }
+
+    // Calls fn for a single array element, which is accessed directly if possible (see acquireWritable())
+    template <typename T> void forArrayElement(VPtrNum p, bool ro, void (*fn)(T *, VPtrSize))
+    {
+        T *data = static_cast<T *>((ro) ? read(p, sizeof(T)) : acquireWritable(p, sizeof(T)));
+        if (data)
+            fn(data, 1);
+        else
+        {
+            // partially overlaps with a lock
+            fn(static_cast<T *>(makeDataLock(p, sizeof(T), ro)), 1);
+            releaseLock(p);
+        }
+    }
+
+    // Calls fn for the array elements starting at p, a locked part (of at most a big page) at a time.
+    // Like makeMultiLock(), the last unlocked big page is never locked: it is required for any other
+    // access (e.g. by the constructors), and makeFittingLock() fails if all pages are locked. In this
+    // case the elements are accessed one at a time instead.
+    template <typename T> void forEachArrayChunk(VPtrNum p, VPtrSize n, bool ro, bool nofetch, void (*fn)(T *, VPtrSize))
+    {
+        while (n)
+        {
+            T *data = 0;
+            VPtrSize count = 1;
+            if (getUnlockedBigPages() > 1)
+            {
+                VirtPageSize size = (VirtPageSize)(private_utils::minimal(n, (VPtrSize)(Properties::bigPageSize / sizeof(T))) * sizeof(T));
+                data = static_cast<T *>(makeFittingLock(p, size, ro, nofetch));
+                if (data)
+                {
+                    count = size / sizeof(T);
+                    if (!count)
+                    {
+                        // the lock was shrunk to avoid an overlap with another lock
+                        releaseLock(p);
+                        data = 0;
+                        count = 1;
+                    }
+                }
+            }
+
+            if (data)
+            {
+                fn(data, count);
+                releaseLock(p);
+            }
+            else
+                forArrayElement(p, ro, fn);
+
+            p += count * sizeof(T); n -= count;
+        }
+    }
+
 protected:
     VAlloc(void)
     {
@@ -54,6 +149,16 @@ protected:
         initSmallPages(smallPagesData, &smallPagePool[pad], Properties::smallPageCount, Properties::smallPageSize);
         initMediumPages(mediumPagesData, &mediumPagePool[pad], Properties::mediumPageCount, Properties::mediumPageSize);
         initBigPages(bigPagesData, &bigPagePool[pad], Properties::bigPageCount, Properties::bigPageSize);
+#endif
+        initBigPageTable(bigPageBuckets, bigPageChain, private_utils::NextPow2<Properties::bigPageCount>::value);
+        setBigPageAlignment(private_utils::alignBigPagesProperty<Properties>::value);
+        initBigPageDirtyMap(bigPageDirtyMap.get(), DirtyGranularity, DirtyMapSize);
+        setPagePolicy(pagePolicy.get());
+        setMutex(mutex.get());
+        setReadAhead(private_utils::readAheadProperty<Properties>::value);
+        initSlabs(slabsData.get(), slabMaps.get(), SlabCount, SlabSize, SlabMapSize);
+        initWriteBackBuffer(reinterpret_cast<uint8_t *>(writeBackBufferData.get()));
+#ifndef NVALGRIND
         VALGRIND_MAKE_MEM_NOACCESS(&smallPagePool[0], pad); VALGRIND_MAKE_MEM_NOACCESS(&smallPagePool[Properties::smallPageCount * Properties::smallPageSize + pad], pad);
         VALGRIND_MAKE_MEM_NOACCESS(&mediumPagePool[0], pad); VALGRIND_MAKE_MEM_NOACCESS(&mediumPagePool[Properties::mediumPageCount * Properties::mediumPageSize + pad], pad);
         VALGRIND_MAKE_MEM_NOACCESS(&bigPagePool[0], pad); VALGRIND_MAKE_MEM_NOACCESS(&bigPagePool[Properties::bigPageCount * Properties::bigPageSize + pad], pad);
@@ -122,15 +227,20 @@ public:
      *
      * This function is similar to the C++ `new` operator. Similar to \ref alloc, this function will
      * allocate a block of virtual memory. Subsequently, the default constructor of the data type is
-     * called. For this reason, this function is typically used for C++ classes.
+     * called. For this reason, this function is typically used for C++ classes. Data types with a
+     * trivial default constructor (e.g. structures without constructors) are zero-filled instead
+     * (see BaseVAlloc::zeroRaw).
      * @note This function should be used together with \ref deleteClass.
      * @sa deleteClass, newArray, alloc
      */
     template <typename T> VPtr<T, Derived> newClass(VPtrSize size=sizeof(T))
     {
+        AccessGuard guard(this);
         virtmem::VPtr<T, Derived> ret = alloc<T>(size);
-        T *ptr = static_cast<T *>(read(ret.getRawNum(), sizeof(T)));
-        new (ptr) T; // UNDONE: can this be ro?
+        if (private_utils::TrivialConstructor<T>::value)
+            zeroRaw(ret.getRawNum(), sizeof(T));
+        else
+            forEachArrayChunk<T>(ret.getRawNum(), 1, false, true, &constructArrayChunk<T>);
         return ret;
     }
 
@@ -145,7 +255,9 @@ public:
      */
     template <typename T> void deleteClass(VPtr<T, Derived> &p)
     {
-        p->~T();
+        AccessGuard guard(this);
+        if (!private_utils::TrivialDestructor<T>::value)
+            static_cast<T *>(read(p.getRawNum(), sizeof(T)))->~T(); // NOTE: the data is freed, so it doesn't have to be written
         freeRaw(p.getRawNum());
     }
 
@@ -158,17 +270,23 @@ public:
      * @return Virtual pointer to start of the array
      *
      * This function is similar to the C++ new [] operator. After allocating sufficient size for the
-     * array, the default constructor will be called for each object.
+     * array, the default constructor will be called for each object. The objects are constructed
+     * a locked *big* page at a time, or one at a time if only one *big* page is unlocked (the
+     * constructors may need it). The array is zero-filled instead if the default constructor
+     * of the data type is trivial (see \ref newClass).
      * @note This function should be used together with \ref deleteArray.
      * @sa deleteArray, newClass, alloc
      */
     template <typename T> VPtr<T, Derived> newArray(VPtrSize elements)
     {
+        AccessGuard guard(this);
         VPtrNum p = allocRaw(sizeof(T) * elements + sizeof(VPtrSize));
         write(p, &elements, sizeof(VPtrSize));
         p += sizeof(VPtrSize);
-        for (VPtrSize s=0; s<elements; ++s)
-            new (read(p + (s * sizeof(T)), sizeof(T))) T; // UNDONE: can this be ro?
+        if (private_utils::TrivialConstructor<T>::value)
+            zeroRaw(p, sizeof(T) * elements);
+        else
+            forEachArrayChunk<T>(p, elements, false, true, &constructArrayChunk<T>);
 
         virtmem::VPtr<T, Derived> ret;
         ret.setRawNum(p);
@@ -185,16 +303,36 @@ public:
      */
     template <typename T> void deleteArray(VPtr<T, Derived> &p)
     {
+        AccessGuard guard(this);
         const VPtrNum soffset = p.getRawNum() - sizeof(VPtrSize); // pointer to size offset
-        VPtrSize *size = static_cast<VPtrSize *>(read(soffset, sizeof(VPtrSize)));
-        for (VPtrSize s=0; s<*size; ++s)
+        if (!private_utils::TrivialDestructor<T>::value)
         {
-            T *ptr = static_cast<T *>(read(p.getRawNum() + (s * sizeof(T)), sizeof(T)));
-            ptr->~T();
+            const VPtrSize size = *static_cast<VPtrSize *>(read(soffset, sizeof(VPtrSize)));
+            // NOTE: the data is freed, so the locks are read-only
+            forEachArrayChunk<T>(p.getRawNum(), size, true, false, &destructArrayChunk<T>);
         }
         freeRaw(soffset); // soffset points at beginning of actual block
     }
 
+    /**
+     * @brief Sets the root pointer, which is stored in persistent mode.
+     * @param p Virtual pointer to store. This should not be a wrapped pointer.
+     * @sa getRoot, BaseVAlloc::setRootPointer, BaseVAlloc::setPersistent
+     */
+    template <typename T> void setRoot(const VPtr<T, Derived> &p) { setRootPointer(p.getRawNum()); }
+
+    /**
+     * @brief Returns the root pointer.
+     * @tparam T Type of the data pointed to by the root pointer.
+     * @sa setRoot, BaseVAlloc::getRootPointer
+     */
+    template <typename T> VPtr<T, Derived> getRoot(void) const
+    {
+        virtmem::VPtr<T, Derived> ret;
+        ret.setRawNum(getRootPointer());
+        return ret;
+    }
+
     /**
      * @struct TVPtr
      * @brief Generalized shortcut to virtual pointer type linked to this allocator.
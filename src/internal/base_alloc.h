@@ -13,13 +13,29 @@
 #endif
 
 #include "config/config.h"
+#include "access_trace.h"
+#include "mutex.h"
 
 #include <stdint.h>
 
 namespace virtmem {
 
-typedef uint32_t VPtrNum; //!< Numeric type used to store raw virtual pointer addresses
-typedef uint32_t VPtrSize; //!< Numeric type used to store the size of a virtual memory block
+class BasePagePolicy;
+template <typename, typename, uint16_t, uint16_t, typename> class TieredVAllocP;
+template <typename, uint32_t, uint16_t, uint16_t, typename> class CompressedVAllocP;
+
+#if VIRTMEM_VPTR_BITS == 16
+typedef uint16_t VPtrNum;
+typedef uint16_t VPtrSize;
+#elif VIRTMEM_VPTR_BITS == 64
+typedef uint64_t VPtrNum;
+typedef uint64_t VPtrSize;
+#elif VIRTMEM_VPTR_BITS == 32
+typedef uint32_t VPtrNum; //!< Numeric type used to store raw virtual pointer addresses (see \ref VIRTMEM_VPTR_BITS)
+typedef uint32_t VPtrSize; //!< Numeric type used to store the size of a virtual memory block (see \ref VIRTMEM_VPTR_BITS)
+#else
+#error "VIRTMEM_VPTR_BITS should be 16, 32 or 64"
+#endif
 typedef uint16_t VirtPageSize; //!< Numeric type used to store the size of a virtual memory page
 
 /**
@@ -44,9 +60,14 @@ private:
         PAGE_MAX_CLEAN_SKIPS = 5, // if page is dirty: max tries for finding another clean page when swapping
         START_OFFSET = sizeof(TAlign), // don't start at zero so we can have NULL pointers
         BASE_INDEX = 1, // Special pointer to baseFreeList, not actually stored in file
-        MIN_ALLOC_SIZE = 16
+        MIN_ALLOC_SIZE = 16,
+        MAX_IO_BLOCKS = 8, // maximum amount of blocks per doReadV()/doWriteV() call
+        ZERO_FILL_SIZE = 32, // size of the stack buffer used by fillUnwritten()
+        PERSISTENT_MAGIC = 0x564D5301 // "VMS" + version
     };
 
+    // NOTE: the header is padded to TAlign, so that allocated data is suitably aligned. Hence,
+    // narrow addresses (see VIRTMEM_VPTR_BITS) only shrink it where TAlign is small (e.g. AVR).
     union UMemHeader
     {
         struct
@@ -75,9 +96,46 @@ protected:
 
         LockPage(void) : start(0), size(0), pool(0), locks(0), cleanSkips(0), dirty(false), next(-1) { }
     };
+
+    // Block of virtual memory that is divided in equally sized slots, used for small allocations.
+    // Used slots are administered in a bitmap kept in RAM.
+    struct Slab
+    {
+        VPtrNum start; // zero if unused
+        uint8_t slotShift; // log2 of slot size
+        uint16_t freeSlots;
+
+        Slab(void) : start(0), slotShift(0), freeSlots(0) { }
+    };
+
+    enum { SLAB_MIN_SLOT_SIZE = sizeof(UMemHeader) };
     // \endcond
 
+    /**
+     * @brief Describes a block of data that is transferred by doReadV() or doWriteV().
+     */
+    struct IOBlock
+    {
+        uint8_t *data; //!< Buffer that receives the data (reading) or contains the data (writing).
+        VPtrNum offset; //!< Start offset in the memory pool.
+        VPtrSize size; //!< Amount of bytes.
+    };
+
 private:
+    // Allocator state that is stored at the start of the memory pool in persistent mode (see
+    // setPersistent()). The state of all slabs and their bitmaps directly follows this header.
+    struct PersistentHeader
+    {
+        uint32_t magic;
+        VPtrSize poolSize, dataSize; // dataSize: size of header + slab data
+        VirtPageSize slabSize;
+        uint8_t slabCount;
+        VPtrNum freePointer, poolFreePos, writtenEnd, root;
+        VPtrNum baseFreeListNext;
+        VPtrSize baseFreeListSize;
+        uint32_t checksum;
+    };
+
     struct PageInfo
     {
         LockPage *pages;
@@ -86,14 +144,62 @@ private:
         int8_t freeIndex, lockedIndex;
     };
 
+    // Address indexed table of all valid (unlocked) big pages. Pages are hashed by their starting
+    // address divided by the (power of two rounded down) big page size.
+    struct BigPageTable
+    {
+        int8_t *buckets, *chain;
+        uint8_t mask, shift;
+    };
+
     // Stuff configured from VAlloc
     VPtrSize poolSize;
     PageInfo smallPages, mediumPages, bigPages;
+    BigPageTable bigPageTable;
+    bool alignBigPages;
+    BasePagePolicy *pagePolicy; // zero for the default built-in policy
+    BaseMutex *mutex; // zero if not thread safe
+    uint8_t *directData; // memory pool of directly addressable allocators (see doGetDirectData()), zero otherwise
+
+    // Optional bitmaps (one for each big page) that mark which parts of a page were modified
+    uint8_t *bigPageDirtyMap;
+    VirtPageSize dirtyGranularity, dirtyMapSize;
+
+    // Optional slabs for small allocations
+    Slab *slabs;
+    uint8_t *slabMaps;
+    uint8_t slabCount;
+    VirtPageSize slabSize, slabMapSize;
 
     UMemHeader baseFreeList;
     VPtrNum freePointer;
     VPtrNum poolFreePos;
+    VPtrNum writtenEnd; // end of the pool region that was written since start() (gaps are zero filled), data beyond is zero
+
+    // Persistent mode
+    bool persistent, restoredState;
+    VPtrNum rootPointer;
     int8_t nextPageToSwap;
+    int8_t mruBigPage; // unlocked big page that was accessed last (or -1)
+
+    // Address range that contains all locked pages, used to quickly skip lock lookups
+    VPtrNum lockedRangeStart, lockedRangeEnd;
+    bool lockedRangeValid;
+
+    // Prefetching
+    uint8_t readAhead; // amount of pages
+    int8_t pendingPage, lastBigPage;
+    VPtrNum lastLoadEnd, readAheadStart;
+
+    // Asynchronous write-back
+    uint8_t *writeBackBuffer; // spare page buffer, swapped with the pool of a page that is written back
+    VPtrNum pendingWriteStart;
+    VPtrSize pendingWriteSize; // 0 if no write is outstanding
+
+#ifdef VIRTMEM_TRACE_ACCESS
+    BaseAccessTracer *accessTracer;
+    void traceAccess(AccessTraceEvent event, VPtrNum p, VPtrSize size);
+#endif
 
 #ifdef VIRTMEM_TRACE_STATS
     VPtrSize memUsed, maxMemUsed;
@@ -102,30 +208,93 @@ private:
 
     void initPages(PageInfo *info, LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize);
     VPtrNum getMem(VPtrSize size);
+    VPtrNum allocBlock(VPtrSize size);
+    void freeBlock(VPtrNum ptr);
+    uint8_t *getSlabMap(const Slab *slab) const { return slabMaps + ((slab - slabs) * slabMapSize); }
+    VPtrNum allocSlot(VPtrSize size);
+    bool freeSlot(VPtrNum ptr);
+    uint8_t *getDirtyMap(const LockPage *page) const { return bigPageDirtyMap + ((page - bigPages.pages) * dirtyMapSize); }
+    void markBigPageDirty(LockPage *page, VPtrSize offset, VPtrSize size);
+    void setBigPageDirty(LockPage *page, bool dirty);
+    void completeRead(void);
+    void completeWrite(void);
+    void completeTransfers(void) { completeRead(); completeWrite(); }
+    void waitForPage(int8_t index) { if (index == pendingPage) completeRead(); }
+    void waitForWrite(VPtrNum offset, VPtrSize size);
+    VPtrSize zeroUnwritten(void *data, VPtrNum offset, VPtrSize size) const;
+    void fillUnwritten(VPtrNum offset);
+    void readBackend(void *data, VPtrNum offset, VPtrSize size);
+    void writeBackend(const void *data, VPtrNum offset, VPtrSize size);
+    void writeBigPage(LockPage *page, VPtrSize offset, VPtrSize size);
     void syncBigPage(LockPage *page);
     void copyRawData(void *dest, VPtrNum p, VPtrSize size);
     void saveRawData(void *src, VPtrNum p, VPtrSize size);
-    void *pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forcestart);
+    void *pullRawData(VPtrNum p, VPtrSize size, bool readonly, bool forcestart, bool nofetch=false);
+    void getBigPageRange(VPtrNum p, VPtrSize size, bool forcestart, VPtrNum &start, VirtPageSize &psize) const;
+    void loadBigPage(int8_t index, VPtrNum start, VirtPageSize size, bool async, bool fetch=true);
+    void fetchBigPage(int8_t index, bool async);
+    void fetchBigPages(const int8_t *indices, uint8_t count);
+    void writeBackendV(IOBlock *blocks, uint8_t count);
+    void readAheadPages(int8_t index);
+    bool canPrefetchInPage(int8_t index, VPtrNum keepstart, VPtrNum keepend) const;
+    int8_t findPrefetchPage(VPtrNum keepstart, VPtrNum keepend);
     void pushRawData(VPtrNum p, const void *d, VPtrSize size);
+    bool getPageOverlap(const LockPage *page, VPtrNum p, VPtrSize size, VPtrNum &ostart, VPtrSize &osize) const;
     const UMemHeader *getHeaderConst(VPtrNum p);
     void updateHeader(VPtrNum p, UMemHeader *h);
-    int8_t findFreePage(PageInfo *pinfo, VPtrNum p, VPtrSize size, bool atstart);
+    void resetBigPageTable(void);
+    void addBigPageToTable(int8_t index);
+    void removeBigPageFromTable(int8_t index);
+    void invalidateBigPage(int8_t index);
+    bool isAlignedBigPage(const LockPage *page) const;
+    int8_t findBigPage(VPtrNum p) const;
+    bool overlapsBigPages(VPtrNum p, VPtrSize size, int8_t skip) const;
+    int8_t findFreePage(VPtrNum p, VPtrSize size, bool atstart);
     int8_t findUnusedLockedPage(PageInfo *pinfo);
     void syncLockedPage(LockPage *page);
-    int8_t lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size);
+    int8_t lockPage(PageInfo *pinfo, VPtrNum ptr, VirtPageSize size, bool nofetch=false);
     int8_t freeLockedPage(PageInfo *pinfo, int8_t index);
     int8_t findLockedPage(PageInfo *pinfo, VPtrNum p);
     LockPage *findLockedPage(VPtrNum p);
+    void invalidateLockedRange(void) { lockedRangeValid = false; }
+    bool inLockedRange(VPtrNum p, VPtrSize size);
+    VPtrSize getPersistentDataSize(void) const;
+    VPtrNum getHeapStart(void) const;
+    uint32_t getStateChecksum(const PersistentHeader &header) const;
+    void saveState(void);
+    bool loadState(void);
     uint8_t getFreePages(const PageInfo *pinfo) const;
     uint8_t getUnlockedPages(const PageInfo *pinfo) const;
 
 protected:
-    BaseVAlloc(void) : poolSize(0) { }
+    BaseVAlloc(void) : poolSize(0), alignBigPages(false), pagePolicy(0), mutex(0), directData(0), bigPageDirtyMap(0), dirtyGranularity(0),
+                       dirtyMapSize(0), slabs(0), slabMaps(0), slabCount(0), slabSize(0), slabMapSize(0),
+                       persistent(false), restoredState(false), rootPointer(0), readAhead(0), pendingPage(-1),
+                       writeBackBuffer(0), pendingWriteStart(0), pendingWriteSize(0)
+    {
+#ifdef VIRTMEM_TRACE_ACCESS
+        accessTracer = 0;
+#endif
+#ifdef VIRTMEM_TRACE_COUNTERS
+        setPageEventCallback(0);
+        resetCounters();
+#endif
+    }
 
     // \cond HIDDEN_SYMBOLS
     void initSmallPages(LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize) { initPages(&smallPages, pages, pool, pcount, psize); }
     void initMediumPages(LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize) { initPages(&mediumPages, pages, pool, pcount, psize); }
     void initBigPages(LockPage *pages, uint8_t *pool, uint8_t pcount, VirtPageSize psize) { initPages(&bigPages, pages, pool, pcount, psize); }
+    void initBigPageTable(int8_t *buckets, int8_t *chain, uint8_t bcount);
+    void setBigPageAlignment(bool a) { alignBigPages = a; }
+    void setPagePolicy(BasePagePolicy *p) { pagePolicy = p; }
+    void setMutex(BaseMutex *m) { mutex = m; }
+    void setReadAhead(uint8_t pages) { readAhead = pages; }
+    void initBigPageDirtyMap(uint8_t *map, VirtPageSize granularity, VirtPageSize mapsize)
+    { bigPageDirtyMap = map; dirtyGranularity = granularity; dirtyMapSize = mapsize; }
+    void initSlabs(Slab *s, uint8_t *maps, uint8_t count, VirtPageSize size, VirtPageSize mapsize)
+    { slabs = s; slabMaps = maps; slabCount = count; slabSize = size; slabMapSize = mapsize; }
+    void initWriteBackBuffer(uint8_t *buf) { writeBackBuffer = buf; }
     // \endcond
 
     void writeZeros(VPtrNum start, VPtrSize n); // NOTE: only call this in doStart()
@@ -141,7 +310,83 @@ protected:
     virtual void doWrite(const void *data, VPtrSize offset, VPtrSize size) = 0;
     //! @}
 
+    /**
+     * @name Optional virtual functions
+     * The following functions may be defined by derived allocator classes. doReadAsync() and
+     * doPollRead() support asynchronous reading of prefetched data (see \ref prefetch()). Only one asynchronous read is outstanding
+     * at a time: no other functions of the allocator (e.g. doRead() or doWrite()) are called until
+     * doPollRead() reported that the read has finished. Asynchronous writes (doWriteAsync() and
+     * doPollWrite()) are different: while a write is outstanding, other data may be read or written
+     * (synchronously or asynchronously) so that the next page can be loaded meanwhile. This data never
+     * overlaps the data that is being written. Allocators that cannot perform multiple transfers at
+     * once (e.g. because they share a bus) should finish the write first.
+     * @{
+     */
+    //! Starts reading data asynchronously. Returns `false` if this is unsupported, the data is then read with doRead().
+    virtual bool doReadAsync(void *, VPtrSize, VPtrSize) { return false; }
+    //! Returns `true` if the last asynchronous read (started by doReadAsync()) has finished.
+    virtual bool doPollRead(void) { return true; }
+    /**
+     * Starts writing data asynchronously, which is used to write back modified pages that are
+     * replaced (see `asyncWriteBack` in DefaultAllocProperties). The data remains valid until
+     * doPollWrite() reported that the write has finished. Returns `false` if this is unsupported,
+     * the data is then written with doWrite(). Only one asynchronous write is outstanding at a
+     * time.
+     */
+    virtual bool doWriteAsync(const void *, VPtrSize, VPtrSize) { return false; }
+    //! Returns `true` if the last asynchronous write (started by doWriteAsync()) has finished.
+    virtual bool doPollWrite(void) { return true; }
+    //! Called by flush() after all pages were synchronized, e.g. to commit written data to the storage medium.
+    virtual void doFlush(void) { }
+    /**
+     * Returns a pointer to the memory pool if it is directly addressable (e.g. regular or memory
+     * mapped RAM), or `0` otherwise. This function is called by \ref start() after doStart(). If
+     * a pointer is returned, all data is accessed directly (no memory pages are used) and
+     * doRead()/doWrite() are not called anymore. The memory pool should be aligned like the
+     * memory pages (i.e. to `sizeof(TAlign)`).
+     */
+    virtual void *doGetDirectData(void) { return 0; }
+    /**
+     * Reads multiple blocks with a single request, which is used for prefetching multiple pages
+     * (see \ref prefetch()). Returns `false` if this is unsupported (nothing should be read in that
+     * case): the blocks are then read by doReadAsync() or doRead().
+     */
+    virtual bool doReadV(const IOBlock *, uint8_t) { return false; }
+    /**
+     * Writes multiple blocks with a single request, which is used to write all modified parts of
+     * a page at once. Returns `false` if this is unsupported (nothing should be written in that
+     * case): the blocks are then written by doWrite().
+     */
+    virtual bool doWriteV(const IOBlock *, uint8_t) { return false; }
+    /**
+     * Called when an unmodified page is replaced by other data. The data of the page is still valid
+     * during this call, which allows caching it elsewhere (see TieredVAllocP).
+     */
+    virtual void doDiscard(const void *, VPtrSize, VPtrSize) { }
+    //! @}
+
+    // allocators that are used by other allocators are accessed through their backend functions
+    template <typename, typename, uint16_t, uint16_t, typename> friend class TieredVAllocP;
+    template <typename, uint32_t, uint16_t, uint16_t, typename> friend class CompressedVAllocP;
+
 public:
+    // \cond HIDDEN_SYMBOLS
+    // Holds the mutex of an allocator (if any) during its lifetime, see BaseMutex. This guards all
+    // allocator state (page lists, lock counts, replacement policy and backend I/O) at once.
+    class AccessGuard
+    {
+        BaseMutex *mutex;
+
+        AccessGuard(const AccessGuard &);
+        AccessGuard &operator=(const AccessGuard &);
+
+    public:
+        AccessGuard(const BaseVAlloc *a) : mutex(a ? a->mutex : 0) { if (mutex) mutex->lock(); }
+        ~AccessGuard(void) { if (mutex) mutex->unlock(); }
+    };
+    friend class AccessGuard;
+    // \endcond
+
     void start(void);
     void stop(void);
 
@@ -154,11 +399,46 @@ public:
      */
     void setPoolSize(VPtrSize ps) { poolSize = ps; }
 
+    /**
+     * @brief Enables or disables persistent mode.
+     *
+     * In persistent mode the state of the allocator (i.e. all information about allocated memory
+     * and the root pointer, see setRootPointer()) is stored at the start of the memory pool by
+     * \ref flush() and \ref stop(). When the allocator is started again, this state is restored,
+     * so that all data allocated during a previous session remains accessible. This is only
+     * useful for allocators with a non-volatile memory pool, such as SDVAllocP or MmapVAllocP.
+     * @param p `true` to enable persistent mode.
+     * @note This function should always called before \ref start().
+     * @note The state can only be restored if the pool size and the slab settings (see
+     * DefaultAllocProperties) are unchanged. Furthermore, any locked data should be unlocked before
+     * calling \ref flush() or \ref stop().
+     * @sa hasRestoredState
+     */
+    void setPersistent(bool p) { persistent = p; }
+    //! Returns `true` if \ref start() restored the allocator state from a previous session (see setPersistent()).
+    bool hasRestoredState(void) const { return restoredState; }
+    /**
+     * @brief Sets the root pointer.
+     *
+     * The root pointer is stored with the allocator state in persistent mode (see setPersistent()),
+     * and is typically used to point to the data structure that gives access to all other data.
+     * @param p The root (raw) virtual pointer.
+     * @sa getRootPointer, VAlloc::setRoot
+     */
+    void setRootPointer(VPtrNum p) { rootPointer = p; }
+    //! Returns the root pointer (see setRootPointer()). This is `0` if no state was restored by \ref start().
+    VPtrNum getRootPointer(void) const { return rootPointer; }
+
     VPtrNum allocRaw(VPtrSize size);
     void freeRaw(VPtrNum ptr);
 
     void *read(VPtrNum p, VPtrSize size);
     void write(VPtrNum p, const void *d, VPtrSize size);
+    void *acquireWritable(VPtrNum p, VPtrSize size);
+    void readBulk(void *d, VPtrNum p, VPtrSize size);
+    void writeBulk(const void *d, VPtrNum p, VPtrSize size);
+    void zeroRaw(VPtrNum p, VPtrSize size);
+    void prefetch(VPtrNum p, VPtrSize size);
     void flush(void);
     void clearPages(void);
     uint8_t getFreeBigPages(void) const;
@@ -167,9 +447,20 @@ public:
     uint8_t getUnlockedBigPages(void) const { return getUnlockedPages(&bigPages); } //!< Returns amount of *big* pages which are not locked.
 
     // \cond HIDDEN_SYMBOLS
+    // Consecutive part of a lock made by makeMultiLock()
+    struct LockSegment
+    {
+        uint8_t *data;
+        VPtrNum ptr;
+        VPtrSize size;
+    };
+
     void *makeDataLock(VPtrNum ptr, VirtPageSize size, bool ro=false);
-    void *makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro=false);
+    void *makeFittingLock(VPtrNum ptr, VirtPageSize &size, bool ro=false, bool nofetch=false);
+    uint8_t makeMultiLock(VPtrNum ptr, VPtrSize &size, LockSegment *segments, uint8_t maxsegs, bool ro=false, bool nofetch=false);
     void releaseLock(VPtrNum ptr);
+    void releaseMultiLock(const LockSegment *segments, uint8_t count);
+    VPtrSize getMaxMultiLockSize(uint8_t maxsegs, uint8_t locks=1) const;
     // \endcond
 
     uint8_t getSmallPageCount(void) const { return smallPages.count; } //!< Returns total amount of *small* pages.
@@ -186,6 +477,15 @@ public:
      */
     VPtrSize getPoolSize(void) const { return poolSize; }
 
+#ifdef VIRTMEM_TRACE_ACCESS
+    /**
+     * @brief Sets the tracer that records all virtual memory accesses of this allocator.
+     * @param t The tracer (see BaseAccessTracer), or `0` to disable tracing.
+     * @note This function is only available when \ref VIRTMEM_TRACE_ACCESS is defined (in config.h).
+     */
+    void setAccessTracer(BaseAccessTracer *t) { accessTracer = t; }
+#endif
+
     // \cond HIDDEN_SYMBOLS
     void printStats(void);
     // \endcond
@@ -206,6 +506,92 @@ public:
     void resetStats(void) { memUsed = maxMemUsed = 0; bigPageReads = bigPageWrites = bytesRead = bytesWritten = 0; } //!< Reset all statistics. Called by \ref start()
     //@}
 #endif
+
+#ifdef VIRTMEM_TRACE_COUNTERS
+    /**
+     * @anchor counterf
+     * @name Performance counters.
+     * The following types and functions are only available when VIRTMEM_TRACE_COUNTERS is defined
+     * (in config.h).
+     */
+    //@{
+    //! Page classes, used to index the page counters of Counters.
+    enum PageClass { PAGE_SMALL = 0, PAGE_MEDIUM, PAGE_BIG, PAGE_CLASS_COUNT };
+
+    //! Events reported to the page event callback (see setPageEventCallback()).
+    enum PageEvent
+    {
+        PAGE_LOAD, //!< A *big* page was (re)loaded to contain new data.
+        PAGE_WRITE, //!< Modified data of a *big* page was written to the storage medium.
+        PAGE_EVICT, //!< A *big* page was emptied, for instance to be replaced by other data.
+        PAGE_LOCK, //!< A page was assigned to a new memory lock.
+        PAGE_UNLOCK //!< The last lock of a page was released.
+    };
+
+    /**
+     * @brief Type of the page event callback (see setPageEventCallback()).
+     * @param event The event that occurred.
+     * @param start Virtual address of the page.
+     * @param size Size of the page.
+     * @param data The user data that was passed to setPageEventCallback().
+     */
+    typedef void (*PageEventCallback)(PageEvent event, VPtrNum start, VirtPageSize size, void *data);
+
+    //! Duration histogram of backend transfers, see Counters.
+    struct IOTimes
+    {
+        /**
+         * Amount of transfers per duration: the first bucket counts transfers shorter than 16 us,
+         * every next bucket covers a four times larger range (i.e. 16-64 us, 64-256 us, etc.) and
+         * the last bucket counts transfers of 65 ms or longer.
+         */
+        uint32_t histogram[8];
+        uint32_t totalMicros; //!< Total duration of all transfers, in microseconds.
+    };
+
+    //! Performance counters of an allocator, see getCounters().
+    struct Counters
+    {
+        /**
+         * Accesses (data reads, writes and locks) served by a page that was already loaded or
+         * locked, indexed by PageClass.
+         */
+        uint32_t pageHits[PAGE_CLASS_COUNT];
+        //! Pages that had to be filled with new data (big page loads and new small or medium locks), indexed by PageClass.
+        uint32_t pageMisses[PAGE_CLASS_COUNT];
+        uint32_t lockAcquires; //!< Successful calls to lock data (e.g. by VPtrLock or VSpan).
+        uint32_t lockFailures; //!< Lock attempts that failed since no page was available.
+        uint32_t partialMirrors; //!< Locked pages mirrored to a *big* page, since read data only partially overlapped with them.
+        uint32_t partialEvictions; //!< *Big* pages emptied since they partially overlapped with newly loaded data.
+        uint32_t allocations; //!< Blocks allocated from the free list (i.e. not from slabs).
+        uint32_t freeListSteps; //!< Total amount of free list entries visited during allocations.
+        uint32_t maxFreeListSteps; //!< Maximum amount of free list entries visited during one allocation.
+        IOTimes reads; //!< Durations of synchronous backend reads.
+        IOTimes writes; //!< Durations of synchronous backend writes.
+    };
+
+    //! Returns the performance counters, which are reset by \ref start() and resetCounters().
+    const Counters &getCounters(void) const { return counters; }
+    void resetCounters(void); //!< Resets all performance counters.
+    /**
+     * @brief Sets a function that is called for every page event (e.g. to detect thrashing pages).
+     * @param cb The callback function, or `0` to disable it.
+     * @param data User data that is passed to the callback.
+     * @note The callback should not access virtual memory.
+     */
+    void setPageEventCallback(PageEventCallback cb, void *data=0) { pageEventCallback = cb; pageEventData = data; }
+    //@}
+
+private:
+    Counters counters;
+    PageEventCallback pageEventCallback;
+    void *pageEventData;
+
+    uint8_t getPageClass(const PageInfo *pinfo) const
+    { return (pinfo == &smallPages) ? PAGE_SMALL : ((pinfo == &mediumPages) ? PAGE_MEDIUM : PAGE_BIG); }
+    void notifyPageEvent(PageEvent event, const LockPage *page)
+    { if (pageEventCallback) pageEventCallback(event, page->start, page->size, pageEventData); }
+#endif
 };
 
 }
@@ -0,0 +1,31 @@
+#ifndef VIRTMEM_LZF_H
+#define VIRTMEM_LZF_H
+
+/**
+  * @file
+  * @brief This file contains an LZF compatible data compressor, used by CompressedVAllocP
+  */
+
+#include <stdint.h>
+
+namespace virtmem {
+
+// \cond HIDDEN_SYMBOLS
+namespace private_utils {
+
+/* Compresses data in the LZF format. The hash table should contain (1 << hashbits) entries and is
+ * used as scratch memory. Returns the compressed size, or zero if the result does not fit in
+ * outsize bytes. The input size should not exceed 65535 bytes. */
+uint32_t lzfCompress(const uint8_t *in, uint32_t insize, uint8_t *out, uint32_t outsize,
+                     uint16_t *htab, uint8_t hashbits);
+
+/* Decompresses LZF data. Returns false if the data is invalid or does not decompress to exactly
+ * outsize bytes. Any input that follows the first outsize bytes of output (e.g. padding) is ignored. */
+bool lzfDecompress(const uint8_t *in, uint32_t insize, uint8_t *out, uint32_t outsize);
+
+}
+// \endcond
+
+}
+
+#endif // VIRTMEM_LZF_H
@@ -0,0 +1,143 @@
+#ifndef VIRTMEM_MUTEX_H
+#define VIRTMEM_MUTEX_H
+
+/**
+  * @file
+  * @brief This file contains the mutexes used to make allocators thread safe.
+  */
+
+#include <stdint.h>
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#define VIRTMEM_FREERTOS_MUTEX
+#elif defined(INC_FREERTOS_H)
+#include <semphr.h>
+#define VIRTMEM_FREERTOS_MUTEX
+#endif
+
+#if __cplusplus > 199711L && (defined(__unix__) || defined(__APPLE__) || defined(_WIN32))
+#include <mutex>
+#define VIRTMEM_STD_MUTEX
+#endif
+
+namespace virtmem {
+
+/**
+ * @brief Interface for mutexes that serialize access to an allocator.
+ *
+ * By default, allocators are not thread safe. A mutex can be selected by defining a `Mutex` type
+ * in the allocator properties (see DefaultAllocProperties). The mutex is then held during every
+ * operation of the allocator, such as memory (de)allocation, page loading and swapping, and
+ * access to data (see @ref aAccess). Every allocator has its own mutex, hence, tasks that use
+ * different allocators run in parallel.
+ *
+ * This is a coarse locking scheme: a single recursive mutex per allocator serializes all of its
+ * operations, including accesses to pages that are already loaded and the creation of memory locks.
+ * There are no separate locks for eviction or backend I/O, page lock counts are not atomic, and
+ * all tasks share the same memory pages. Hence, tasks that use the same allocator do not access
+ * virtual memory in parallel, and a task may wait for a page transfer of another task. Tasks that
+ * need to run in parallel should use separate allocators (with separate memory pools). Per-page
+ * pin counts that would keep page hits free of the mutex are not implemented.
+ *
+ * The following accesses are safe while other tasks use the allocator:
+ * - Dereferencing a virtual pointer (e.g. `*p` and `p[i]`, see @ref aAccess): the data is copied
+ * while the mutex is held.
+ * - Member access (`p->member`): the data is locked (see below) until the end of the expression.
+ * - Memory locks (see VPtrLock, VPtrMultiLock and VSpan) are locked and released while the mutex is
+ * held. Since a locked page is never swapped out, its data may be accessed while other tasks use
+ * the allocator. Therefore, locks are the fastest way to access data from multiple tasks.
+ * - The overloads of C library functions (e.g. memcpy(), see @ref Coverloads), which use locks.
+ *
+ * Containers (e.g. VVector) use the mutex for every operation, but a container object should still
+ * not be modified by multiple tasks at the same time.
+ *
+ * Raw pointers to data that is not locked are **not** safe: another task may swap out the page
+ * as soon as the mutex is released. This applies to pointers returned by BaseVAlloc::read() and
+ * BaseVAlloc::acquireWritable(), to pointers obtained from a member access that are used after the
+ * expression (e.g. `int *i = &p->member;`), and to data of a lock after it was released.
+ *
+ * The mutex must be _recursive_, as it may be taken multiple times by the same task. The type
+ * defined in the properties should derive from this class and define a `get` function:
+ * @code{.cpp}
+class MyMutex : public virtmem::BaseMutex
+{
+    // ...
+
+public:
+    void lock(void) { ... }
+    void unlock(void) { ... }
+    virtmem::BaseMutex *get(void) { return this; }
+};
+ * @endcode
+ *
+ * @note Allocators may not be used from interrupt handlers, since page transfers block.
+ * @sa FreeRTOSMutex, StdMutex, NoMutex
+ */
+class BaseMutex
+{
+public:
+    virtual void lock(void) = 0; //!< Takes the mutex, waits until it is available.
+    virtual void unlock(void) = 0; //!< Releases the mutex.
+};
+
+/**
+ * @brief Default mutex, which does not provide any synchronization.
+ *
+ * Allocators with this mutex should only be used by one task, or protected by the application.
+ * It has no overhead.
+ */
+struct NoMutex
+{
+    // \cond HIDDEN_SYMBOLS
+    BaseMutex *get(void) { return 0; }
+    // \endcond
+};
+
+#if defined(VIRTMEM_FREERTOS_MUTEX) || defined(DOXYGEN)
+/**
+ * @brief Recursive FreeRTOS mutex (e.g. for the ESP32).
+ *
+ * This mutex is only available when FreeRTOS is used (ESP32 platforms, or when `FreeRTOS.h` is
+ * included before virtmem). Tasks waiting for the mutex inherit priority.
+ */
+class FreeRTOSMutex : public BaseMutex
+{
+    SemaphoreHandle_t handle;
+
+public:
+    // \cond HIDDEN_SYMBOLS
+    FreeRTOSMutex(void) : handle(xSemaphoreCreateRecursiveMutex()) { }
+    ~FreeRTOSMutex(void) { vSemaphoreDelete(handle); }
+
+    void lock(void) { xSemaphoreTakeRecursive(handle, portMAX_DELAY); }
+    void unlock(void) { xSemaphoreGiveRecursive(handle); }
+    BaseMutex *get(void) { return this; }
+    // \endcond
+};
+#endif
+
+#if defined(VIRTMEM_STD_MUTEX) || defined(DOXYGEN)
+/**
+ * @brief Mutex that uses `std::recursive_mutex`.
+ *
+ * This mutex is only available for C++11 on PC like platforms, and is mainly useful for
+ * simulation (e.g. with MmapVAllocP or StdioVAllocP).
+ */
+class StdMutex : public BaseMutex
+{
+    std::recursive_mutex mutex;
+
+public:
+    // \cond HIDDEN_SYMBOLS
+    void lock(void) { mutex.lock(); }
+    void unlock(void) { mutex.unlock(); }
+    BaseMutex *get(void) { return this; }
+    // \endcond
+};
+#endif
+
+}
+
+#endif // VIRTMEM_MUTEX_H
@@ -0,0 +1,265 @@
+#ifndef VIRTMEM_PAGE_POLICY_H
+#define VIRTMEM_PAGE_POLICY_H
+
+/**
+  * @file
+  * @brief This file contains the replacement policies for *big* memory pages.
+  */
+
+#include <stdint.h>
+
+namespace virtmem {
+
+/**
+ * @brief Interface for replacement policies of *big* memory pages.
+ *
+ * A replacement policy decides which big page is swapped out when data has to be loaded while
+ * no empty pages are available. The allocator informs the policy when pages are loaded, removed
+ * (i.e. invalidated or locked) and accessed. Only pages that are loaded and unlocked are
+ * considered for replacement.
+ *
+ * Policies are selected by defining a `PagePolicy` type in the allocator properties (see
+ * DefaultAllocProperties). This type should be a structure with a template class `Impl`, which
+ * is instantiated with the amount of *big* pages and derives from this class. For instance:
+ * @code{.cpp}
+struct MyPagePolicy
+{
+    template <uint8_t pageCount> class Impl : public virtmem::BasePagePolicy
+    {
+        // ...
+
+    public:
+        virtmem::BasePagePolicy *get(void) { return this; }
+    };
+};
+ * @endcode
+ * @sa LRUPagePolicy, ClockPagePolicy, TwoQueuePagePolicy, DefaultPagePolicy
+ */
+class BasePagePolicy
+{
+public:
+    virtual void reset(void) = 0; //!< Called when the allocator is started: no pages are loaded.
+    virtual void pageAdded(int8_t index) = 0; //!< Called when page `index` was loaded or unlocked.
+    virtual void pageRemoved(int8_t index) = 0; //!< Called when page `index` was invalidated or locked.
+    virtual void pageAccessed(int8_t index) = 0; //!< Called when data is accessed from page `index`.
+    //! Returns the index of the (previously added) page that should be replaced.
+    virtual int8_t selectVictim(void) = 0;
+};
+
+// \cond HIDDEN_SYMBOLS
+namespace private_utils {
+
+// Doubly linked list of page indices, used to keep track of page order
+template <uint8_t N> class PageList
+{
+    int8_t prev[N], next[N];
+    int8_t head, tail;
+    uint8_t count;
+
+public:
+    PageList(void) { clear(); }
+
+    void clear(void) { head = tail = -1; count = 0; }
+    void pushFront(int8_t index)
+    {
+        prev[index] = -1;
+        next[index] = head;
+        if (head != -1)
+            prev[head] = index;
+        else
+            tail = index;
+        head = index;
+        ++count;
+    }
+    void remove(int8_t index)
+    {
+        if (prev[index] != -1)
+            next[prev[index]] = next[index];
+        else
+            head = next[index];
+        if (next[index] != -1)
+            prev[next[index]] = prev[index];
+        else
+            tail = prev[index];
+        --count;
+    }
+    int8_t front(void) const { return head; }
+    int8_t back(void) const { return tail; }
+    uint8_t size(void) const { return count; }
+};
+
+}
+// \endcond
+
+/**
+ * @brief Default replacement policy.
+ *
+ * Pages are replaced by a built-in heuristic: empty pages are preferred, followed by pages that
+ * are unmodified. Modified pages are skipped a few times before they are replaced in a FIFO
+ * manner. This policy adds no code or RAM overhead and is used if no policy is specified in the
+ * allocator properties.
+ */
+struct DefaultPagePolicy
+{
+    // \cond HIDDEN_SYMBOLS
+    template <uint8_t> struct Impl { BasePagePolicy *get(void) { return 0; } };
+    // \endcond
+};
+
+/**
+ * @brief Least Recently Used (LRU) replacement policy.
+ *
+ * The page which was not accessed for the longest time is replaced. This policy generally
+ * performs well with random access patterns that have locality, such as hash tables.
+ */
+struct LRUPagePolicy
+{
+    // \cond HIDDEN_SYMBOLS
+    template <uint8_t N> class Impl : public BasePagePolicy
+    {
+        private_utils::PageList<N> list; // most recently used first
+        bool loaded[N];
+
+    public:
+        Impl(void) { reset(); }
+
+        void reset(void)
+        {
+            list.clear();
+            for (uint8_t i=0; i<N; ++i)
+                loaded[i] = false;
+        }
+        void pageAdded(int8_t index) { list.pushFront(index); loaded[index] = true; }
+        void pageRemoved(int8_t index) { list.remove(index); loaded[index] = false; }
+        void pageAccessed(int8_t index)
+        {
+            if (loaded[index] && list.front() != index)
+            {
+                list.remove(index);
+                list.pushFront(index);
+            }
+        }
+        int8_t selectVictim(void) { return list.back(); }
+        BasePagePolicy *get(void) { return this; }
+    };
+    // \endcond
+};
+
+/**
+ * @brief CLOCK (second chance) replacement policy.
+ *
+ * An approximation of LRU with a lower overhead per access: every access merely sets a
+ * reference flag. Pages are replaced in circular order, skipping (and clearing) pages that
+ * were referenced since the last pass.
+ */
+struct ClockPagePolicy
+{
+    // \cond HIDDEN_SYMBOLS
+    template <uint8_t N> class Impl : public BasePagePolicy
+    {
+        bool loaded[N], referenced[N];
+        uint8_t hand;
+
+    public:
+        Impl(void) { reset(); }
+
+        void reset(void)
+        {
+            hand = 0;
+            for (uint8_t i=0; i<N; ++i)
+                loaded[i] = referenced[i] = false;
+        }
+        void pageAdded(int8_t index) { loaded[index] = referenced[index] = true; }
+        void pageRemoved(int8_t index) { loaded[index] = referenced[index] = false; }
+        void pageAccessed(int8_t index) { referenced[index] = loaded[index]; }
+        int8_t selectVictim(void)
+        {
+            // NOTE: at most two passes are needed as all references are cleared during the first
+            for (uint8_t i=0; i<(N * 2); ++i)
+            {
+                const uint8_t cur = hand;
+                hand = (hand + 1) % N;
+
+                if (loaded[cur])
+                {
+                    if (!referenced[cur])
+                        return cur;
+                    referenced[cur] = false;
+                }
+            }
+
+            return -1;
+        }
+        BasePagePolicy *get(void) { return this; }
+    };
+    // \endcond
+};
+
+/**
+ * @brief Scan resistant replacement policy, based on a simplified 2Q algorithm.
+ *
+ * Newly loaded pages are kept in a FIFO queue. Only pages that are accessed again while in this
+ * queue are promoted to a (protected) LRU queue. Successive accesses to the same page (e.g. while
+ * iterating through it) are counted as a single access. Replacement candidates are taken from the
+ * FIFO queue first while it contains more than a quarter of the pages, so that a single sequential
+ * scan through memory does not evict frequently used pages.
+ */
+struct TwoQueuePagePolicy
+{
+    // \cond HIDDEN_SYMBOLS
+    template <uint8_t N> class Impl : public BasePagePolicy
+    {
+        enum { QUEUE_NONE, QUEUE_IN, QUEUE_MAIN };
+        enum { MIN_IN_SIZE = (N / 4) ? (N / 4) : 1 };
+
+        private_utils::PageList<N> inQueue, mainQueue; // newest/most recently used first
+        uint8_t queue[N];
+        int8_t lastPage;
+
+    public:
+        Impl(void) { reset(); }
+
+        void reset(void)
+        {
+            inQueue.clear();
+            mainQueue.clear();
+            for (uint8_t i=0; i<N; ++i)
+                queue[i] = QUEUE_NONE;
+            lastPage = -1;
+        }
+        void pageAdded(int8_t index) { inQueue.pushFront(index); queue[index] = QUEUE_IN; lastPage = index; }
+        void pageRemoved(int8_t index)
+        {
+            if (queue[index] == QUEUE_IN)
+                inQueue.remove(index);
+            else if (queue[index] == QUEUE_MAIN)
+                mainQueue.remove(index);
+            queue[index] = QUEUE_NONE;
+        }
+        void pageAccessed(int8_t index)
+        {
+            if (queue[index] == QUEUE_NONE || index == lastPage)
+                return;
+
+            lastPage = index;
+            if (queue[index] == QUEUE_IN)
+                inQueue.remove(index);
+            else
+                mainQueue.remove(index);
+            mainQueue.pushFront(index);
+            queue[index] = QUEUE_MAIN;
+        }
+        int8_t selectVictim(void)
+        {
+            if (inQueue.size() > MIN_IN_SIZE || mainQueue.size() == 0)
+                return inQueue.back();
+            return mainQueue.back();
+        }
+        BasePagePolicy *get(void) { return this; }
+    };
+    // \endcond
+};
+
+}
+
+#endif // VIRTMEM_PAGE_POLICY_H
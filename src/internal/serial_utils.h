@@ -21,7 +21,17 @@ enum
     CMD_INPUTAVAILABLE,
     CMD_INPUTREQUEST,
     CMD_INPUTPEEK,
-    CMD_PING
+    CMD_PING,
+    CMD_READV, // multiple reads, data is returned at once
+    CMD_WRITEV, // multiple writes
+    CMD_COMPRESSION // negotiates payload compression, see init()
+};
+
+// Payload encodings. When compression is enabled, each payload starts with one of these.
+enum
+{
+    ENCODING_RAW = 0,
+    ENCODING_PACKBITS // run-length encoding, see writePackBits()
 };
 //! @endcond
 
@@ -1,6 +1,9 @@
 #include <Arduino.h>
 
 #include "serial_utils.h"
+#include "utils.h"
+
+#include <string.h>
 
 //! @cond HIDDEN_SYMBOLS
 
@@ -70,6 +73,105 @@ template <typename IOStream> void readBlock(IOStream *stream, char *data, uint32
         size -= stream->readBytes(data, size);
 }
 
+// PackBits run-length encoding: a header byte h is followed by h+1 literal bytes (h < 128) or by
+// a single byte that is repeated 257-h times (h > 128). Returns the encoded size. If stream is 0
+// nothing is written and counting stops once the encoded size reaches the input size.
+template <typename IOStream> uint32_t writePackBits(IOStream *stream, const uint8_t *data, uint32_t size)
+{
+    uint32_t ret = 0, i = 0;
+    while (i < size && (stream || ret < size))
+    {
+        uint32_t run = 1;
+        while ((i + run) < size && run < 128 && data[i + run] == data[i])
+            ++run;
+
+        if (run >= 3)
+        {
+            if (stream)
+            {
+                stream->write((uint8_t)(257 - run));
+                stream->write(data[i]);
+            }
+            ret += 2; i += run;
+        }
+        else
+        {
+            const uint32_t start = i;
+            while (i < size && (i - start) < 128 &&
+                   !((i + 2) < size && data[i] == data[i + 1] && data[i] == data[i + 2]))
+                ++i;
+            if (stream)
+            {
+                stream->write((uint8_t)(i - start - 1));
+                stream->write(&data[start], i - start);
+            }
+            ret += 1 + (i - start);
+        }
+    }
+    return ret;
+}
+
+template <typename IOStream> void readPackBits(IOStream *stream, uint8_t *data, uint32_t size)
+{
+    while (size)
+    {
+        const uint8_t h = readUInt8(stream);
+        if (h == 128)
+            continue; // no-op
+        if (h < 128)
+        {
+            const uint32_t n = private_utils::minimal((uint32_t)h + 1, size);
+            readBlock(stream, (char *)data, n);
+            data += n; size -= n;
+        }
+        else
+        {
+            const uint32_t n = private_utils::minimal((uint32_t)(257 - h), size);
+            ::memset(data, readUInt8(stream), n);
+            data += n; size -= n;
+        }
+    }
+}
+
+// Writes page data, which is run-length encoded if compression is enabled and this reduces its size
+template <typename IOStream> void writePayload(IOStream *stream, const uint8_t *data, uint32_t size, bool compress)
+{
+    if (compress)
+    {
+        if (writePackBits((IOStream *)0, data, size) < size)
+        {
+            stream->write(ENCODING_PACKBITS);
+            writePackBits(stream, data, size);
+            return;
+        }
+        stream->write(ENCODING_RAW);
+    }
+    writeBlock(stream, data, size);
+}
+
+template <typename IOStream> void readPayload(IOStream *stream, uint8_t *data, uint32_t size, bool compress)
+{
+    if (compress && readUInt8(stream) == ENCODING_PACKBITS)
+        readPackBits(stream, data, size);
+    else
+        readBlock(stream, (char *)data, size);
+}
+
+// Sends the offset and size of each block of a CMD_READV or CMD_WRITEV command. Data is
+// written directly after each block header if writedata is set.
+template <typename IOStream, typename TBlock>
+void writeBlockList(IOStream *stream, const TBlock *blocks, uint8_t count, bool writedata, bool compress)
+{
+    writeUInt32(stream, count);
+    for (uint8_t i=0; i<count; ++i)
+    {
+        writeUInt32(stream, blocks[i].offset);
+        writeUInt32(stream, blocks[i].size);
+        if (writedata)
+            writePayload(stream, blocks[i].data, blocks[i].size, compress);
+    }
+}
+
 template <typename IOStream> void sendWriteCommand(IOStream *stream, uint8_t cmd)
 {
     stream->write(CMD_START);
@@ -91,7 +193,7 @@ template <typename IOStream> bool waitForCommand(IOStream *stream, uint8_t cmd,
     bool gotinit = false;
     while (millis() < endtime)
     {
-        while (Serial.available())
+        while (stream->available())
         {
             const uint8_t b = stream->read();
 
@@ -105,7 +207,8 @@ template <typename IOStream> bool waitForCommand(IOStream *stream, uint8_t cmd,
     return false;
 }
 
-template <typename IOStream> void init(IOStream *stream, uint32_t baud, uint32_t poolsize)
+// Returns whether compression was requested and accepted by the RAM host
+template <typename IOStream> bool init(IOStream *stream, uint32_t baud, uint32_t poolsize, bool compress)
 {
     stream->begin(baud);
 
@@ -131,6 +234,16 @@ template <typename IOStream> void init(IOStream *stream, uint32_t baud, uint32_t
     sendWriteCommand(stream, CMD_INITPOOL);
     writeUInt32(stream, poolsize);
     stream->flush();
+
+    if (!compress)
+        return false;
+
+    // older RAM hosts ignore this command and never reply: stick to raw payloads in that case
+    sendReadCommand(stream, CMD_COMPRESSION);
+    stream->write(ENCODING_PACKBITS);
+    if (!waitForCommand(stream, CMD_COMPRESSION, 100))
+        return false;
+    return readUInt8(stream) == ENCODING_PACKBITS;
 }
 
 
@@ -1,8 +1,12 @@
 #ifndef VIRTMEM_UTILS_H
 #define VIRTMEM_UTILS_H
 
+#include <stdint.h>
+
 #ifndef ARDUINO
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #define ASSERT assert
 #else
 #include <Arduino.h>
@@ -54,9 +58,75 @@ namespace private_utils {
 template <typename T> T minimal(const T &v1, const T &v2) { return (v1 < v2) ? v1 : v2; }
 template <typename T> T maximal(const T &v1, const T &v2) { return (v1 > v2) ? v1 : v2; }
 
+// Smallest power of two which is equal or larger than N
+template <uint32_t N, uint32_t P=1, bool Done=(P >= N)> struct NextPow2 { static const uint32_t value = NextPow2<N, P * 2>::value; };
+template <uint32_t N, uint32_t P> struct NextPow2<N, P, true> { static const uint32_t value = P; };
+
+// Fixed size array which may be empty
+template <typename T, uint32_t N> struct StaticArray
+{
+    T data[N];
+    T *get(void) { return data; }
+};
+template <typename T> struct StaticArray<T, 0> { T *get(void) { return 0; } };
+
+// Declares a trait class (NAMEProperty) that obtains an optional static member from an allocator
+// properties structure, or a default value if the structure does not define it.
+#define VIRTMEM_OPTIONAL_PROPERTY(NAME, TYPE, DEFAULT) \
+template <typename P> class NAME##Property \
+{ \
+    typedef char TYes[1]; typedef char TNo[2]; \
+    template <typename U> static TYes &check(char (*)[sizeof(U::NAME) > 0]); \
+    template <typename> static TNo &check(...); \
+    template <typename U, bool> struct Get { static const TYPE value = DEFAULT; }; \
+    template <typename U> struct Get<U, true> { static const TYPE value = U::NAME; }; \
+public: \
+    static const TYPE value = Get<P, sizeof(check<P>(0)) == sizeof(TYes)>::value; \
+};
+
+// Similar to VIRTMEM_OPTIONAL_PROPERTY, but for an optional type (NAMEProperty::type)
+#define VIRTMEM_OPTIONAL_TYPE_PROPERTY(NAME, DEFAULT) \
+template <typename P> class NAME##Property \
+{ \
+    typedef char TYes[1]; typedef char TNo[2]; \
+    template <typename U> static TYes &check(typename U::NAME *); \
+    template <typename> static TNo &check(...); \
+    template <typename U, bool> struct Get { typedef DEFAULT type; }; \
+    template <typename U> struct Get<U, true> { typedef typename U::NAME type; }; \
+public: \
+    typedef typename Get<P, sizeof(check<P>(0)) == sizeof(TYes)>::type type; \
+};
+
+// Reports an unrecoverable error and halts. Unlike ASSERT, this is never compiled out.
+inline void fatalError(const char *msg)
+{
+#ifdef ARDUINO
+    Serial.println(msg);
+    while (true)
+        ;
+#else
+    fprintf(stderr, "virtmem: %s\n", msg);
+    abort();
+#endif
+}
+
 template <typename T> struct AntiConst { typedef T type; };
 template <typename T> struct AntiConst<const T> { typedef T type; };
 
+// Whether the default constructor (TrivialConstructor) or destructor (TrivialDestructor) of a type
+// does nothing, so that calling it can be skipped. This relies on compiler intrinsics: on other
+// compilers constructors and destructors are always called.
+#if defined(__clang__)
+template <typename T> struct TrivialConstructor { static const bool value = __is_trivially_constructible(T); };
+template <typename T> struct TrivialDestructor { static const bool value = __is_trivially_destructible(T); };
+#elif defined(__GNUC__)
+template <typename T> struct TrivialConstructor { static const bool value = __has_trivial_constructor(T); };
+template <typename T> struct TrivialDestructor { static const bool value = __has_trivial_destructor(T); };
+#else
+template <typename T> struct TrivialConstructor { static const bool value = false; };
+template <typename T> struct TrivialDestructor { static const bool value = false; };
+#endif
+
 }
 
 }
@@ -39,7 +39,7 @@ template <typename T> T *pointerTo(const T &val) { return (T *)&(char &)val; }
  * @tparam T The type of the data this pointer points to (e.g. char, int, a struct etc...)
  * @tparam TA The allocator type that contains the virtual memory pool where the pointed data resides.
  *
- * @sa BaseVPtr, TSPIRAMVirtPtr, TSDVirtPtr, TSerRAMVirtPtr, TStaticVPtr and TStdioVirtPtr
+ * @sa BaseVPtr, TSPIRAMVirtPtr, TSDVirtPtr, TSerRAMVirtPtr, TStaticVPtr, TStdioVirtPtr and MmapVAllocP
  */
 
 template <typename T, typename TA> class VPtr : public BaseVPtr
@@ -74,6 +74,16 @@ private:
     }
     void write(const T *d) { write(ptr, d); }
 
+    // Returns a pointer to data that may be modified directly, or zero if data should be written with write()
+    static T *acquireWritable(PtrNum p)
+    {
+#ifdef VIRTMEM_WRAP_CPOINTERS
+        if (isWrapped(p))
+            return static_cast<T *>(BaseVPtr::unwrap(p));
+#endif
+        return static_cast<T *>(getAlloc()->acquireWritable(p, sizeof(T)));
+    }
+
     ThisVPtr copy(void) const { ThisVPtr ret; ret.ptr = ptr; return ret; }
     template <typename> friend class VPtrLock;
 
@@ -96,7 +106,7 @@ public:
          * @name Proxy operators
          * @{
          */
-        inline operator T(void) const { return *read(ptr); }
+        inline operator T(void) const { BaseVAlloc::AccessGuard guard(getAlloc()); return *read(ptr); }
         template <typename T2> VIRTMEM_EXPLICIT inline operator T2(void) const { return static_cast<T2>(operator T()); }
 
 //        ValueWrapper &operator=(const ValueWrapper &v)
@@ -107,6 +117,7 @@ public:
             ASSERT(ptr != 0);
             if (ptr != v.ptr)
             {
+                BaseVAlloc::AccessGuard guard(getAlloc());
                 const T val = *read(v.ptr);
                 write(ptr, &val);
             }
@@ -118,6 +129,7 @@ public:
             ASSERT(ptr != 0);
             if (ptr != v.ptr)
             {
+                BaseVAlloc::AccessGuard guard(getAlloc());
                 const T val = *read(v.ptr);
                 write(ptr, &val);
             }
@@ -142,12 +154,74 @@ public:
         template <typename T2> inline bool operator==(const T2 &v) const { return operator T() == v; }
         template <typename T2> inline bool operator!=(const T2 &v) const { return operator T() != v; }
 
-        ValueWrapper &operator+=(int n) { T newv = operator T() + n; write(ptr, private_utils::pointerTo(newv)); return *this; }
+        // NOTE: compound operators modify data directly in virtual memory when possible, which
+        // saves a lookup compared to a separate read and write
+        ValueWrapper &operator+=(int n)
+        {
+            BaseVAlloc::AccessGuard guard(getAlloc());
+            T *v = acquireWritable(ptr);
+            if (v)
+                *v = *v + n;
+            else
+            {
+                T newv = operator T() + n;
+                write(ptr, private_utils::pointerTo(newv));
+            }
+            return *this;
+        }
         ValueWrapper &operator-=(int n) { return operator+=(-n); }
-        ValueWrapper &operator*=(int n) { T newv = operator T() * n; write(ptr, private_utils::pointerTo(newv)); return *this; }
-        ValueWrapper &operator/=(int n) { T newv = operator T() / n; write(ptr, private_utils::pointerTo(newv)); return *this; }
+        ValueWrapper &operator*=(int n)
+        {
+            BaseVAlloc::AccessGuard guard(getAlloc());
+            T *v = acquireWritable(ptr);
+            if (v)
+                *v = *v * n;
+            else
+            {
+                T newv = operator T() * n;
+                write(ptr, private_utils::pointerTo(newv));
+            }
+            return *this;
+        }
+        ValueWrapper &operator/=(int n)
+        {
+            BaseVAlloc::AccessGuard guard(getAlloc());
+            T *v = acquireWritable(ptr);
+            if (v)
+                *v = *v / n;
+            else
+            {
+                T newv = operator T() / n;
+                write(ptr, private_utils::pointerTo(newv));
+            }
+            return *this;
+        }
         ValueWrapper &operator++(void) { return operator +=(1); }
-        T operator++(int) { T ret = operator T(); operator++(); return ret; }
+        T operator++(int)
+        {
+            BaseVAlloc::AccessGuard guard(getAlloc());
+            T *v = acquireWritable(ptr);
+            if (v)
+            {
+                const T ret = *v;
+                *v = ret + 1;
+                return ret;
+            }
+            T ret = operator T(); operator++(); return ret;
+        }
+        ValueWrapper &operator--(void) { return operator -=(1); }
+        T operator--(int)
+        {
+            BaseVAlloc::AccessGuard guard(getAlloc());
+            T *v = acquireWritable(ptr);
+            if (v)
+            {
+                const T ret = *v;
+                *v = ret - 1;
+                return ret;
+            }
+            T ret = operator T(); operator--(); return ret;
+        }
         //! @}
     };
 
@@ -80,7 +80,7 @@ template <typename TV> class VPtrLock
     TV virtPtr;
     Ptr data;
     VirtPageSize lockSize;
-    bool readOnly;
+    bool readOnly, noFetch;
 
 public:
     /**
@@ -90,26 +90,30 @@ public:
      * @param ro Whether locking should read-only (`true`) or not (`false`). If `ro` is
      * `false` (default), the locked data will always be synchronized after unlocking (even if unchanged).
      * Therefore, if no changes in data are expected, it is more efficient to set `ro` to `true`.
+     * @param nf If `true` the locked data is not read from virtual memory if it was not loaded yet,
+     * i.e. the contents of the lock are undefined. This is useful if all locked data (see
+     * getLockSize()) will be overwritten, as it may save a costly read from the storage medium. This
+     * flag should not be used with read-only locks.
      * @sa getLockSize
      */
-    VPtrLock(const TV &v, VirtPageSize s, bool ro=false) :
-        virtPtr(v), lockSize(s), readOnly(ro) { lock(); }
+    VPtrLock(const TV &v, VirtPageSize s, bool ro=false, bool nf=false) :
+        virtPtr(v), lockSize(s), readOnly(ro), noFetch(nf) { lock(); }
     /**
      * @brief Default constructor. No locks are created.
      *
-     * The \ref lock(const TV &v, VirtPageSize s, bool ro) function should be used
+     * The \ref lock(const TV &v, VirtPageSize s, bool ro, bool nf) function should be used
      * to create a lock if this constructor is used.
      */
-    VPtrLock(void) : data(0), lockSize(0), readOnly(false) { }
+    VPtrLock(void) : virtPtr(), data(0), lockSize(0), readOnly(false), noFetch(false) { }
     ~VPtrLock(void) { unlock(); } //!< Unlocks data if locked.
     VPtrLock(const VPtrLock &other) :
         virtPtr(other.virtPtr), lockSize(other.lockSize),
-        readOnly(other.readOnly) { lock(); } //!< Copy constructor, adds extra lock to data
+        readOnly(other.readOnly), noFetch(other.noFetch) { lock(); } //!< Copy constructor, adds extra lock to data
 
     /**
      * @brief Recreates a virtual data lock after \ref unlock was called.
-     * @note This function will re-use the parameters for locking set by \ref VPtrLock(const TV &v, VirtPageSize s, bool ro)
-     * or \ref lock(const TV &v, VirtPageSize s, bool ro).
+     * @note This function will re-use the parameters for locking set by \ref VPtrLock(const TV &v, VirtPageSize s, bool ro, bool nf)
+     * or \ref lock(const TV &v, VirtPageSize s, bool ro, bool nf).
      */
     void lock(void)
     {
@@ -118,15 +122,15 @@ public:
             data = virtPtr.unwrap();
         else
 #endif
-            data = static_cast<Ptr>(TV::getAlloc()->makeFittingLock(virtPtr.ptr, lockSize, readOnly));
+            data = static_cast<Ptr>(TV::getAlloc()->makeFittingLock(virtPtr.ptr, lockSize, readOnly, noFetch));
     }
 
     /**
-     * @brief Locks data. Parameters are described \ref VPtrLock(const TV &v, VirtPageSize s, bool ro) "here".
+     * @brief Locks data. Parameters are described \ref VPtrLock(const TV &v, VirtPageSize s, bool ro, bool nf) "here".
      */
-    void lock(const TV &v, VirtPageSize s, bool ro=false)
+    void lock(const TV &v, VirtPageSize s, bool ro=false, bool nf=false)
     {
-        virtPtr = v; lockSize = s; readOnly = ro;
+        virtPtr = v; lockSize = s; readOnly = ro; noFetch = nf;
         lock();
     }
 
@@ -172,8 +176,244 @@ public:
  * function parameters are the same as VPtrLock::VPtrLock.
  * @sa VPtr and @ref aLocking
  */
-template <typename T> VPtrLock<T> makeVirtPtrLock(const T &w, VirtPageSize s, bool ro=false)
-{ return VPtrLock<T>(w, s, ro); }
+template <typename T> VPtrLock<T> makeVirtPtrLock(const T &w, VirtPageSize s, bool ro=false, bool nf=false)
+{ return VPtrLock<T>(w, s, ro, nf); }
+
+/**
+ * @brief Creates a lock to virtual data that may span multiple memory pages
+ * @tparam TV Type of virtual pointer that points to data
+ * @tparam N Maximum amount of segments (see below)
+ *
+ * This class is similar to VPtrLock, but the data that is locked may be larger than a *big*
+ * memory page: the data is locked in (at most `N`) consecutive _segments_, which are each locked
+ * in a separate memory page. This allows processing large structures or buffers (e.g. to hand
+ * them to a driver for DMA) with a single lock. Locking stops before the last unlocked *big* page
+ * is used, hence, the locked size may be smaller than requested (see getLockSize()).
+ *
+ * Each segment is contiguous in regular memory, however, the memory pages of consecutive segments
+ * are not chosen to be adjacent. The locked data is therefore only contiguous (see isContiguous())
+ * if it has a single segment, which is always the case for directly accessible allocators (e.g.
+ * StaticVAllocP or MmapVAllocP).
+ *
+ * Example:
+ * @code
+ * virtmem::VPtrMultiLock<virtmem::VPtr<char, SDVAlloc> > lock(buf, 4096, true);
+ * for (uint8_t i=0; i<lock.getSegmentCount(); ++i)
+ *     Serial.write(lock.getSegment(i), lock.getSegmentSize(i));
+ * @endcode
+ *
+ * @note Like VPtrLock, this class uses RAII: the data is unlocked when the class goes out of scope.
+ * Unlike VPtrLock, this class cannot be copied.
+ * @sa VPtrLock, @ref aLocking
+ */
+template <typename TV, uint8_t N=4> class VPtrMultiLock
+{
+    typedef typename TV::TPtr Ptr;
+
+    BaseVAlloc::LockSegment segments[N];
+    uint8_t segmentCount;
+    VPtrSize lockSize;
+    bool wrapped;
+
+    VPtrMultiLock(const VPtrMultiLock &); // not copyable
+    VPtrMultiLock &operator=(const VPtrMultiLock &);
+
+public:
+    enum { MAX_SEGMENTS = N }; //!< Maximum amount of segments (the `N` template parameter).
+
+    /**
+     * @brief Constructs a virtual data lock class and creates a lock to the given data.
+     * @param v A \ref VPtr "virtual pointer" to the data to be locked.
+     * @param s Amount of bytes to lock. **Note**: the actual locked size may be smaller.
+     * @param ro Whether locking should read-only (`true`) or not (`false`), see VPtrLock::VPtrLock.
+     * @param nf If `true` the locked data is not read from virtual memory if it was not loaded yet,
+     * see VPtrLock::VPtrLock.
+     */
+    VPtrMultiLock(const TV &v, VPtrSize s, bool ro=false, bool nf=false) : segmentCount(0), lockSize(0), wrapped(false)
+    { lock(v, s, ro, nf); }
+    //! Default constructor. No locks are created until lock() is called.
+    VPtrMultiLock(void) : segmentCount(0), lockSize(0), wrapped(false) { }
+    ~VPtrMultiLock(void) { unlock(); } //!< Unlocks data if locked.
+
+    /**
+     * @brief Locks data. Any previously locked data is unlocked first. Parameters are described
+     * \ref VPtrMultiLock(const TV &v, VPtrSize s, bool ro, bool nf) "here".
+     */
+    void lock(const TV &v, VPtrSize s, bool ro=false, bool nf=false)
+    {
+        unlock();
+        lockSize = s;
+#ifdef VIRTMEM_WRAP_CPOINTERS
+        wrapped = v.isWrapped();
+        if (wrapped)
+        {
+            segments[0].data = (uint8_t *)v.unwrap();
+            segments[0].size = s;
+            segmentCount = 1;
+            return;
+        }
+#endif
+        segmentCount = TV::getAlloc()->makeMultiLock(static_cast<VPtrNum>(v.getRawNum()), lockSize, segments, N, ro, nf);
+    }
+
+    //! Unlocks data (if locked). Automatically called during destruction.
+    void unlock(void)
+    {
+        if (segmentCount && !wrapped)
+            TV::getAlloc()->releaseMultiLock(segments, segmentCount);
+        segmentCount = 0;
+        lockSize = 0;
+    }
+
+    //! Provides access to the data of the first segment, or `0` if nothing was locked.
+    Ptr operator *(void) { return (segmentCount) ? reinterpret_cast<Ptr>(segments[0].data) : 0; }
+    //! Returns the actual (total) size that was locked, which may be smaller than requested.
+    VPtrSize getLockSize(void) const { return lockSize; }
+    uint8_t getSegmentCount(void) const { return segmentCount; } //!< Returns the amount of segments that are locked.
+    Ptr getSegment(uint8_t i) { return reinterpret_cast<Ptr>(segments[i].data); } //!< Returns the data of a segment.
+    VPtrSize getSegmentSize(uint8_t i) const { return segments[i].size; } //!< Returns the size (in bytes) of a segment.
+
+    /**
+     * @brief Returns a pointer to the locked data at a given offset.
+     * @param offset Offset (in bytes) from the start of the locked data. Should be smaller than getLockSize().
+     * @param size Receives the amount of bytes that can be accessed from the returned pointer, i.e.
+     * until the end of its segment.
+     */
+    Ptr getData(VPtrSize offset, VPtrSize &size)
+    {
+        uint8_t i = 0;
+        for (; offset >= segments[i].size; ++i)
+            offset -= segments[i].size;
+        ASSERT(i < segmentCount);
+        size = segments[i].size - offset;
+        return reinterpret_cast<Ptr>(segments[i].data + offset);
+    }
+
+    /**
+     * @brief Returns whether all locked data is contiguous in regular memory, i.e. can be accessed with operator *(void).
+     * @note Segments are not deliberately placed in adjacent memory pages, hence, only a lock with a
+     * single segment can be relied upon to be contiguous.
+     */
+    bool isContiguous(void) const
+    {
+        for (uint8_t i=1; i<segmentCount; ++i)
+        {
+            if (segments[i-1].data + segments[i-1].size != segments[i].data)
+                return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Sequentially writes data to a block of virtual memory.
+ * @tparam A Type of the virtual memory allocator
+ *
+ * This class is meant for producers that fill a block of virtual memory from start to end, for
+ * instance to store log data or to build an array. Data is written to locks (see VPtrLock) that
+ * are created without reading the previous contents from virtual memory. As this avoids reading
+ * any data that is overwritten anyway, writing data with this class is generally more efficient
+ * than writing it through virtual pointers.
+ *
+ * Example:
+ * @code
+ * virtmem::VPtr<char, SDVAlloc> buf = valloc.alloc<char>(1024);
+ * virtmem::VPtrWriteStream<SDVAlloc> stream(buf, 1024);
+ * for (int i=0; i<1024; ++i)
+ *     stream.put(i & 0xFF);
+ * stream.close();
+ * @endcode
+ *
+ * @note A lock is kept while the stream is open, hence, the stream should be closed (or
+ * destroyed) when writing has finished.
+ * @note Data in the block that is not written when the stream is closed is undefined.
+ * @sa VPtrLock
+ */
+template <typename A> class VPtrWriteStream
+{
+    typedef VPtr<char, A> TVPtr;
+
+    VPtrLock<TVPtr> vlock;
+    TVPtr next;
+    VPtrSize sizeLeft;
+    char *data;
+    VirtPageSize dataLeft;
+
+    VPtrWriteStream(const VPtrWriteStream &); // not copyable
+    VPtrWriteStream &operator=(const VPtrWriteStream &);
+
+    bool nextLock(void)
+    {
+        vlock.unlock();
+        if (!sizeLeft)
+            return false;
+
+        const VirtPageSize size = private_utils::minimal((VPtrSize)A::getInstance()->getBigPageSize(), sizeLeft);
+        vlock.lock(next, size, false, true);
+        data = *vlock;
+        if (!data) // no page available, e.g. because all pages are locked
+        {
+            dataLeft = 0;
+            return false;
+        }
+        dataLeft = vlock.getLockSize();
+        next += dataLeft; sizeLeft -= dataLeft;
+        return true;
+    }
+
+public:
+    /**
+     * @brief Constructs a write stream.
+     * @param p Virtual pointer to the start of the memory block that should be written.
+     * @param size The size of the memory block (in bytes). Data beyond this size is never written.
+     */
+    template <typename T> VPtrWriteStream(const VPtr<T, A> &p, VPtrSize size) :
+        next(static_cast<TVPtr>(p)), sizeLeft(size), data(0), dataLeft(0) { }
+    ~VPtrWriteStream(void) { close(); } //!< Closes the stream.
+
+    /**
+     * @brief Writes a single byte.
+     * @return `false` if the end of the memory block was reached or no memory page could be locked
+     * (no data is written), `true` otherwise.
+     */
+    bool put(char c)
+    {
+        if (!dataLeft && !nextLock())
+            return false;
+        *data = c;
+        ++data; --dataLeft;
+        return true;
+    }
+
+    /**
+     * @brief Writes a block of data.
+     * @param d Pointer to the data to be written.
+     * @param size Amount of bytes to write.
+     * @return The amount of bytes written. This is less than `size` if the end of the memory block
+     * was reached or no memory page could be locked.
+     */
+    VPtrSize write(const void *d, VPtrSize size)
+    {
+        VPtrSize ret = 0;
+        while (ret < size && (dataLeft || nextLock()))
+        {
+            const VirtPageSize cpsize = private_utils::minimal((VPtrSize)dataLeft, (VPtrSize)(size - ret));
+            ::memcpy(data, static_cast<const char *>(d) + ret, cpsize);
+            data += cpsize; dataLeft -= cpsize;
+            ret += cpsize;
+        }
+        return ret;
+    }
+
+    /**
+     * @brief Releases the lock used by the stream. No data can be written afterwards.
+     * @note This function is automatically called during destruction.
+     */
+    void close(void) { vlock.unlock(); sizeLeft = dataLeft = 0; }
+
+    //! Returns the amount of bytes that can still be written.
+    VPtrSize getSizeLeft(void) const { return sizeLeft + dataLeft; }
+};
 
 namespace private_utils {
 // Ugly hack from http://stackoverflow.com/a/12141673
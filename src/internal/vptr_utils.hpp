@@ -24,17 +24,22 @@ template <typename T> struct TVirtPtrTraits { };
 
 template <typename T, typename A> struct TVirtPtrTraits<VPtr<T, A> >
 {
-    typedef VPtrLock<VPtr<T, A> > Lock;
+    typedef VPtrMultiLock<VPtr<T, A> > Lock;
 
     static bool isWrapped(VPtr<T, A> p) { return p.isWrapped(); }
     static T *unwrap(VPtr<T, A> p) { return p.unwrap(); }
     static bool isVirtPtr(void) { return true; }
-    static Lock makeLock(VPtr<T, A> w, VirtPageSize s, bool ro=false)
-    { return makeVirtPtrLock(w, s, ro); }
-    static VirtPageSize getLockSize(Lock &l) { return l.getLockSize(); }
-    static VirtPageSize getPageSize(void)
-    { return A::getInstance()->getBigPageSize(); }
-
+    static BaseVAlloc *getAlloc(void) { return A::getInstance(); }
+    static void lock(Lock &l, VPtr<T, A> w, VPtrSize s, bool ro=false, bool nf=false) { l.lock(w, s, ro, nf); }
+    static VPtrSize getLockSize(Lock &l) { return l.getLockSize(); }
+    static T *getLockData(Lock &l, VPtrSize offset, VPtrSize &size) { return l.getData(offset, size); }
+    // locks share the pages of their allocator. If all big pages are locked data is locked a page at a
+    // time, so that existing locks can still be used.
+    static VPtrSize getMaxLockSize(bool multipage, uint8_t locks)
+    {
+        const VPtrSize size = (multipage) ? A::getInstance()->getMaxMultiLockSize(Lock::MAX_SEGMENTS, locks) : 0;
+        return (size) ? size : A::getInstance()->getBigPageSize();
+    }
 };
 
 template <typename T> struct TVirtPtrTraits<T *>
@@ -44,9 +49,12 @@ template <typename T> struct TVirtPtrTraits<T *>
     static bool isWrapped(T *) { return false; }
     static T *unwrap(T *p) { return p; }
     static bool isVirtPtr(void) { return false; }
-    static Lock makeLock(T *&p, VirtPageSize, __attribute__ ((unused)) bool ro=false) { return &p; }
-    static VirtPageSize getLockSize(Lock &) { return (VirtPageSize)-1; }
-    static VirtPageSize getPageSize(void) { return (VirtPageSize)-1; }
+    static BaseVAlloc *getAlloc(void) { return 0; }
+    static void lock(Lock &l, T *&p, VPtrSize, __attribute__ ((unused)) bool ro=false,
+                     __attribute__ ((unused)) bool nf=false) { l = &p; }
+    static VPtrSize getLockSize(Lock &) { return (VPtrSize)-1; }
+    static T *getLockData(Lock &l, VPtrSize offset, VPtrSize &size) { size = (VPtrSize)-1; return *l + offset; }
+    static VPtrSize getMaxLockSize(bool, uint8_t) { return (VPtrSize)-1; }
 };
 
 template <typename T1, typename T2, typename A> int ptrDiff(VPtr<T1, A> p1, VPtr<T2, A> p2) { return p2 - p1; }
@@ -56,24 +64,43 @@ template <typename T1, typename T2, typename A> bool ptrEqual(VPtr<T1, A> p1, VP
 template <typename T1, typename T2> bool ptrEqual(T1 *p1, T2 *p2) { return p1 == p2; }
 template <typename T1, typename T2> bool ptrEqual(T1, T2) { return false; } // mix of virt and regular pointers
 
-template <typename T1, typename T2> VirtPageSize getMaxLockSize(T1 p1, T2 p2)
+// Returns the maximum size of the locks used to process both pointers at once. If multipage is set
+// locks may span multiple big pages (see VPtrMultiLock), which is only useful if all data is processed.
+template <typename T1, typename T2> VPtrSize getMaxLockSize(T1 p1, T2 p2, bool multipage)
 {
-    VirtPageSize ret = minimal(TVirtPtrTraits<T1>::getPageSize(), TVirtPtrTraits<T2>::getPageSize());
+    const uint8_t locks = (TVirtPtrTraits<T1>::getAlloc() && TVirtPtrTraits<T1>::getAlloc() == TVirtPtrTraits<T2>::getAlloc()) ? 2 : 1;
+    VPtrSize ret = minimal(TVirtPtrTraits<T1>::getMaxLockSize(multipage, locks), TVirtPtrTraits<T2>::getMaxLockSize(multipage, locks));
 
     // check for overlap in case both p1 and p2 are virtual pointers from the same allocator
     if (TSameType<T1, T2>::flag && TVirtPtrTraits<T1>::isVirtPtr())
-        ret = minimal(ret, static_cast<VirtPageSize>(abs(ptrDiff(p1, p2))));
+        ret = minimal(ret, static_cast<VPtrSize>(abs(ptrDiff(p1, p2))));
 
     return ret;
 }
 
 
+// Returns whether a transfer between regular and virtual memory should bypass memory pages. This is
+// done for transfers of at least a big page: these would otherwise swap out pages anyway.
+#ifdef VIRTMEM_WRAP_CPOINTERS
+template <typename T, typename A> bool useBulkTransfer(VPtr<T, A> p, VPtrSize size)
+{
+    return !p.isWrapped() && size >= A::getInstance()->getBigPageSize();
+}
+#else
+template <typename T, typename A> bool useBulkTransfer(VPtr<T, A>, VPtrSize size)
+{
+    return size >= A::getInstance()->getBigPageSize();
+}
+#endif
+
 // copier function that works with raw pointers for rawCopy, returns false if copying should be aborted
 typedef bool (*RawCopier)(char *, const char *, VPtrSize);
 
-// Generalized copy for memcpy and strncpy
+// Generalized copy for memcpy and strncpy. If fullcopy is set the copier always copies all data,
+// hence, destination data does not have to be read first. If multipage is set, data is locked
+// multiple pages at a time (see getMaxLockSize()).
 template <typename T1, typename T2> T1 rawCopy(T1 dest, T2 src, VPtrSize size,
-                                               RawCopier copier)
+                                               RawCopier copier, bool fullcopy=false, bool multipage=false)
 {
     if (size == 0 || ptrEqual(dest, src))
         return dest;
@@ -92,30 +119,47 @@ template <typename T1, typename T2> T1 rawCopy(T1 dest, T2 src, VPtrSize size,
     }
     else if (TVirtPtrTraits<T1>::isWrapped(dest))
     {
-        rawCopy(TVirtPtrTraits<T1>::unwrap(dest), src, size, copier);
+        rawCopy(TVirtPtrTraits<T1>::unwrap(dest), src, size, copier, fullcopy, multipage);
         return dest;
     }
     else if (TVirtPtrTraits<T2>::isWrapped(src))
-        return rawCopy(dest, TVirtPtrTraits<T2>::unwrap(src), size, copier);
+        return rawCopy(dest, TVirtPtrTraits<T2>::unwrap(src), size, copier, fullcopy, multipage);
 #endif
 
     VPtrSize sizeleft = size;
-    const VirtPageSize maxlocksize = getMaxLockSize(dest, src);
+    const VPtrSize maxlocksize = getMaxLockSize(dest, src, multipage);
     T1 p1 = dest;
     T2 p2 = src;
 
     while (sizeleft)
     {
-        VirtPageSize cpsize = minimal(static_cast<VPtrSize>(maxlocksize), sizeleft);
+        VPtrSize cpsize = minimal(maxlocksize, sizeleft);
 
-        typename TVirtPtrTraits<T1>::Lock l1 = TVirtPtrTraits<T1>::makeLock(p1, cpsize);
-        cpsize = minimal(cpsize, TVirtPtrTraits<T1>::getLockSize(l1));
-        typename TVirtPtrTraits<T2>::Lock l2 = TVirtPtrTraits<T2>::makeLock(p2, cpsize, true);
+        // NOTE: lock source first, so that the destination lock is never larger than the data copied
+        typename TVirtPtrTraits<T2>::Lock l2;
+        TVirtPtrTraits<T2>::lock(l2, p2, cpsize, true);
         cpsize = minimal(cpsize, TVirtPtrTraits<T2>::getLockSize(l2));
+        typename TVirtPtrTraits<T1>::Lock l1;
+        TVirtPtrTraits<T1>::lock(l1, p1, cpsize, false, fullcopy);
+        cpsize = minimal(cpsize, TVirtPtrTraits<T1>::getLockSize(l1));
 
-        if (!copier(*l1, *l2, cpsize))
+        // no page could be locked, i.e. all pages are already locked by the caller
+        ASSERT(cpsize != 0);
+        if (cpsize == 0)
             return dest;
 
+        // copy the parts where the segments of both locks are contiguous
+        for (VPtrSize offset=0; offset<cpsize; )
+        {
+            VPtrSize size1, size2;
+            char *d = TVirtPtrTraits<T1>::getLockData(l1, offset, size1);
+            const char *s = TVirtPtrTraits<T2>::getLockData(l2, offset, size2);
+            const VPtrSize n = minimal(minimal(size1, size2), (VPtrSize)(cpsize - offset));
+            if (!copier(d, s, n))
+                return dest;
+            offset += n;
+        }
+
         p1 += cpsize; p2 += cpsize;
         sizeleft -= cpsize;
         ASSERT(sizeleft <= size);
@@ -127,8 +171,9 @@ template <typename T1, typename T2> T1 rawCopy(T1 dest, T2 src, VPtrSize size,
 // comparison function for rawCompare
 typedef int (*RawComparator)(const char *, const char *, VPtrSize, bool &);
 
-// Generalized compare for memcmp/strncmp
-template <typename T1, typename T2> int rawCompare(T1 p1, T2 p2, VPtrSize n, RawComparator comparator)
+// Generalized compare for memcmp/strncmp, see rawCopy() for multipage
+template <typename T1, typename T2> int rawCompare(T1 p1, T2 p2, VPtrSize n, RawComparator comparator,
+                                                   bool multipage=false)
 {
     if (n == 0 || ptrEqual(p1, p2))
         return 0;
@@ -144,25 +189,39 @@ template <typename T1, typename T2> int rawCompare(T1 p1, T2 p2, VPtrSize n, Raw
     else if (TVirtPtrTraits<T1>::isWrapped(p1) && TVirtPtrTraits<T2>::isWrapped(p2))
         return comparator(TVirtPtrTraits<T1>::unwrap(p1), TVirtPtrTraits<T2>::unwrap(p2), n, done);
     else if (TVirtPtrTraits<T1>::isWrapped(p1))
-        return rawCompare(TVirtPtrTraits<T1>::unwrap(p1), p2, n, comparator);
+        return rawCompare(TVirtPtrTraits<T1>::unwrap(p1), p2, n, comparator, multipage);
     else if (TVirtPtrTraits<T2>::isWrapped(p2))
-        return rawCompare(p1, TVirtPtrTraits<T2>::unwrap(p2), n, comparator);
+        return rawCompare(p1, TVirtPtrTraits<T2>::unwrap(p2), n, comparator, multipage);
 #endif
 
     VPtrSize sizeleft = n;
-    const VirtPageSize maxlocksize = getMaxLockSize(p1, p2);
+    const VPtrSize maxlocksize = getMaxLockSize(p1, p2, multipage);
 
     while (sizeleft)
     {
-        VirtPageSize cmpsize = minimal(static_cast<VPtrSize>(maxlocksize), sizeleft);
-        typename TVirtPtrTraits<T1>::Lock l1 = TVirtPtrTraits<T1>::makeLock(p1, cmpsize, true);
+        VPtrSize cmpsize = minimal(maxlocksize, sizeleft);
+        typename TVirtPtrTraits<T1>::Lock l1;
+        TVirtPtrTraits<T1>::lock(l1, p1, cmpsize, true);
         cmpsize = minimal(cmpsize, TVirtPtrTraits<T1>::getLockSize(l1));
-        typename TVirtPtrTraits<T2>::Lock l2 = TVirtPtrTraits<T2>::makeLock(p2, cmpsize, true);
+        typename TVirtPtrTraits<T2>::Lock l2;
+        TVirtPtrTraits<T2>::lock(l2, p2, cmpsize, true);
         cmpsize = minimal(cmpsize, TVirtPtrTraits<T2>::getLockSize(l2));
 
-        int cmp = comparator(*l1, *l2, cmpsize, done);
-        if (cmp != 0 || done)
-            return cmp;
+        ASSERT(cmpsize != 0); // see rawCopy()
+        if (cmpsize == 0)
+            return 0;
+
+        for (VPtrSize offset=0; offset<cmpsize; )
+        {
+            VPtrSize size1, size2;
+            const char *d1 = TVirtPtrTraits<T1>::getLockData(l1, offset, size1);
+            const char *d2 = TVirtPtrTraits<T2>::getLockData(l2, offset, size2);
+            const VPtrSize size = minimal(minimal(size1, size2), (VPtrSize)(cmpsize - offset));
+            const int cmp = comparator(d1, d2, size, done);
+            if (cmp != 0 || done)
+                return cmp;
+            offset += size;
+        }
 
         p1 += cmpsize; p2 += cmpsize;
         sizeleft -= cmpsize;
@@ -245,22 +304,34 @@ VPtr<T1, A1> memcpy(VPtr<T1, A1> dest, const VPtr<T2, A2> src, VPtrSize size)
     return static_cast<VPtr<T1, A1> >(
                 private_utils::rawCopy(static_cast<VPtr<char, A1> >(dest),
                                        static_cast<const VPtr<const char, A2> >(src), size,
-                                       private_utils::memCopier));
+                                       private_utils::memCopier, true, true));
 }
 
 template <typename T, typename A> VPtr<T, A> memcpy(VPtr<T, A> dest, const void *src, VPtrSize size)
 {
+    if (private_utils::useBulkTransfer(dest, size))
+    {
+        A::getInstance()->writeBulk(src, dest.getRawNum(), size);
+        return dest;
+    }
+
     return static_cast<VPtr<T, A> >(
                 private_utils::rawCopy(static_cast<VPtr<char, A> >(dest),
                                        static_cast<const char *>(src), size,
-                                       private_utils::memCopier));
+                                       private_utils::memCopier, true, true));
 }
 
 template <typename T, typename A> void *memcpy(void *dest, VPtr<T, A> src, VPtrSize size)
 {
+    if (private_utils::useBulkTransfer(src, size))
+    {
+        A::getInstance()->readBulk(dest, src.getRawNum(), size);
+        return dest;
+    }
+
     return private_utils::rawCopy(static_cast<char *>(dest),
                                   static_cast<const VPtr<const char, A> >(src), size,
-                                  private_utils::memCopier);
+                                  private_utils::memCopier, false, true);
 }
 
 template <typename A> VPtr<char, A> memset(VPtr<char, A> dest, int c, VPtrSize size)
@@ -276,16 +347,32 @@ template <typename A> VPtr<char, A> memset(VPtr<char, A> dest, int c, VPtrSize s
     }
 #endif
 
+    typedef VPtrMultiLock<VPtr<char, A> > Lock;
+
     VPtrSize sizeleft = size;
     VPtr<char, A> p = dest;
+    const VPtrSize maxlocksize = A::getInstance()->getMaxMultiLockSize(Lock::MAX_SEGMENTS);
 
     while (sizeleft)
     {
-        VirtPageSize setsize = private_utils::minimal((VPtrSize)A::getInstance()->getBigPageSize(), sizeleft);
-        VPtrLock<VPtr<char, A> > l = makeVirtPtrLock(p, setsize);
-        setsize = l.getLockSize();
-        ::memset(*l, c, setsize);
-        p += setsize; sizeleft -= setsize;
+        // no need to read data that will be overwritten completely
+        Lock l(p, private_utils::minimal(maxlocksize, sizeleft), false, true);
+        if (!l.getLockSize())
+        {
+            // no page could be locked (e.g. all are locked already): write directly to the storage medium
+            char buf[16];
+            ::memset(buf, c, sizeof(buf));
+            for (; sizeleft; )
+            {
+                const VPtrSize n = private_utils::minimal(sizeleft, (VPtrSize)sizeof(buf));
+                A::getInstance()->writeBulk(buf, p.getRawNum(), n);
+                p += n; sizeleft -= n;
+            }
+            break;
+        }
+        for (uint8_t i=0; i<l.getSegmentCount(); ++i)
+            ::memset(l.getSegment(i), c, l.getSegmentSize(i));
+        p += l.getLockSize(); sizeleft -= l.getLockSize();
     }
 
     return dest;
@@ -305,19 +392,19 @@ template <typename T1, typename A1, typename T2, typename A2> int memcmp(VPtr<T1
 #endif
 
     return private_utils::rawCompare(static_cast<VPtr<const char, A1> >(s1),
-                                     static_cast<VPtr<const char, A2> >(s2), n, private_utils::memComparator);
+                                     static_cast<VPtr<const char, A2> >(s2), n, private_utils::memComparator, true);
 }
 
 template <typename T, typename A> int memcmp(VPtr<T, A> s1, const void *s2, VPtrSize n)
 {
     return private_utils::rawCompare(static_cast<VPtr<const char, A> >(s1),
-                                     static_cast<const char *>(s2), n, private_utils::memComparator);
+                                     static_cast<const char *>(s2), n, private_utils::memComparator, true);
 }
 
 template <typename T, typename A> int memcmp(const void *s1, const VPtr<T, A> s2, VPtrSize n)
 {
     return private_utils::rawCompare(static_cast<const char *>(s1),
-                                     static_cast<VPtr<const char, A> >(s2), n, private_utils::memComparator);
+                                     static_cast<VPtr<const char, A> >(s2), n, private_utils::memComparator, true);
 }
 
 template <typename A1, typename A2> VPtr<char, A1> strncpy(VPtr<char, A1> dest, const VPtr<const char, A2> src,
@@ -0,0 +1,178 @@
+#ifndef VIRTMEM_VSPAN_H
+#define VIRTMEM_VSPAN_H
+
+/**
+  * @file
+  * @brief This file contains utilities to efficiently process arrays in virtual memory.
+  */
+
+#include "config/config.h"
+#include "utils.h"
+#include "vptr.h"
+#include "vptr_utils.h"
+
+namespace virtmem {
+
+/**
+ * @brief Provides access to an array in virtual memory in chunks of regular memory.
+ * @tparam T Type of the array elements
+ * @tparam A Type of the virtual memory allocator
+ *
+ * Accessing data through a virtual pointer (e.g. `vptr[i] = x`) involves a lookup of the
+ * memory page containing the data for every element. This class divides an array in chunks which
+ * are locked one at a time (see VPtrLock). Each chunk is accessed through a regular pointer,
+ * which allows processing the data at the speed of regular memory.
+ *
+ * Example:
+ * @code
+ * virtmem::VSpan<int, SDVAlloc> span(vptr, 1000);
+ * while (span.next())
+ * {
+ *     int *data = span.data();
+ *     for (VPtrSize i=0; i<span.size(); ++i)
+ *         data[i] = i;
+ * }
+ * @endcode
+ *
+ * The array can also be accessed element by element with an iterator (see begin()):
+ * @code
+ * int sum = 0;
+ * virtmem::VSpan<int, SDVAlloc> span(vptr, 1000, true);
+ * for (virtmem::VSpan<int, SDVAlloc>::Iterator it=span.begin(); it!=span.end(); ++it)
+ *     sum += *it;
+ * // or on C++11
+ * for (int &i : span)
+ *     sum += i;
+ * @endcode
+ *
+ * Chunks are at most the size of a *big* memory page. They may be smaller, for instance if
+ * (a part of) the array is already locked.
+ *
+ * @note A chunk remains locked until the next chunk is requested or the span is destroyed. Data
+ * from a chunk should therefore only be accessed through the span until then.
+ * @note The size of the array elements must not exceed the size of a *big* page. Furthermore,
+ * other locks should not partially overlap with an element.
+ * @sa forEachChunk, VPtrLock
+ */
+template <typename T, typename A> class VSpan
+{
+    typedef VPtr<T, A> TVPtr;
+
+    VPtrLock<TVPtr> vlock;
+    TVPtr startPtr, nextPtr;
+    VPtrSize count, countLeft, chunkSize;
+    bool readOnly;
+
+    VSpan(const VSpan &); // not copyable
+    VSpan &operator=(const VSpan &);
+
+public:
+    /**
+     * @brief Iterator used to access the elements of a VSpan.
+     *
+     * This iterator moves through the chunks of the span it belongs to, hence, all iterators of a
+     * span share the same position. Iterators are obtained by VSpan::begin() and VSpan::end().
+     */
+    class Iterator
+    {
+        VSpan *span;
+        T *cur, *chunkEnd;
+
+        void nextChunk(void)
+        {
+            if (span->next())
+            {
+                cur = span->data();
+                chunkEnd = cur + span->size();
+            }
+            else
+                cur = chunkEnd = 0;
+        }
+
+        Iterator(VSpan *s) : span(s), cur(0), chunkEnd(0) { if (span) nextChunk(); }
+
+        friend class VSpan;
+
+    public:
+        T &operator*(void) { return *cur; } //!< Returns the current element.
+        T *operator->(void) { return cur; } //!< Provides access to the current element.
+        //! Moves to the next element.
+        Iterator &operator++(void) { if (++cur == chunkEnd) nextChunk(); return *this; }
+        bool operator==(const Iterator &other) const { return cur == other.cur; } //!< Compares iterators.
+        bool operator!=(const Iterator &other) const { return cur != other.cur; } //!< Compares iterators.
+    };
+
+    /**
+     * @brief Constructs a span. No data is locked until next() is called.
+     * @param p Virtual pointer to the first element of the array.
+     * @param n The amount of elements.
+     * @param ro Whether the data is only read (`true`) or (also) modified (`false`). See VPtrLock::VPtrLock.
+     */
+    VSpan(const TVPtr &p, VPtrSize n, bool ro=false) :
+        startPtr(p), nextPtr(p), count(n), countLeft(n), chunkSize(0), readOnly(ro) { }
+
+    /**
+     * @brief Locks the next chunk of the span.
+     *
+     * The current chunk (if any) is unlocked. This function should be called before accessing the
+     * first chunk.
+     * @return `false` if the end of the span was reached, `true` otherwise.
+     */
+    bool next(void)
+    {
+        vlock.unlock();
+        if (!countLeft)
+        {
+            chunkSize = 0;
+            return false;
+        }
+
+        const VirtPageSize pagesize = A::getInstance()->getBigPageSize();
+        ASSERT(sizeof(T) <= pagesize);
+        const VPtrSize maxcount = private_utils::minimal(countLeft, (VPtrSize)(pagesize / sizeof(T)));
+        vlock.lock(nextPtr, (VirtPageSize)(maxcount * sizeof(T)), readOnly);
+        chunkSize = vlock.getLockSize() / sizeof(T);
+        ASSERT(chunkSize > 0);
+
+        nextPtr += chunkSize; countLeft -= chunkSize;
+        return true;
+    }
+
+    void rewind(void) { vlock.unlock(); nextPtr = startPtr; countLeft = count; chunkSize = 0; } //!< Restarts at the first chunk.
+
+    T *data(void) { return *vlock; } //!< Returns a pointer to the current chunk.
+    VPtrSize size(void) const { return chunkSize; } //!< Returns the amount of elements in the current chunk.
+    //! Returns the virtual pointer to the first element of the current chunk.
+    TVPtr getChunkPtr(void) const { return nextPtr - chunkSize; }
+
+    //! Restarts the span and returns an iterator to its first element.
+    Iterator begin(void) { rewind(); return Iterator(this); }
+    Iterator end(void) { return Iterator(0); } //!< Returns an iterator past the last element.
+};
+
+/**
+ * @brief Calls a function for each chunk of an array in virtual memory.
+ * @param p Virtual pointer to the first element of the array.
+ * @param n The amount of elements.
+ * @param fn A function (or function object) which is called with a pointer to each chunk (`T *`) and
+ * the amount of elements in the chunk (VPtrSize).
+ * @param ro Whether the data is only read (`true`) or (also) modified (`false`).
+ *
+ * Example:
+ * @code
+ * void fill(char *data, VPtrSize size) { memset(data, 'a', size); }
+ * ...
+ * virtmem::forEachChunk(vptr, 1000, fill);
+ * @endcode
+ * @sa VSpan
+ */
+template <typename T, typename A, typename F> void forEachChunk(const VPtr<T, A> &p, VPtrSize n, F fn, bool ro=false)
+{
+    VSpan<T, A> span(p, n, ro);
+    while (span.next())
+        fn(span.data(), span.size());
+}
+
+}
+
+#endif // VIRTMEM_VSPAN_H
@@ -0,0 +1,138 @@
+#include "internal/lzf.h"
+
+#include <string.h>
+
+namespace virtmem {
+
+namespace private_utils {
+
+namespace {
+
+enum
+{
+    MAX_LITERAL = 32, // literal runs are stored as <count - 1> <bytes>
+    MAX_OFFSET = 8192,
+    MAX_MATCH = 264, // 7 + 255 + 2
+    HASH_UNUSED = 0xFFFF
+};
+
+uint32_t hash3(const uint8_t *p, uint8_t hashbits)
+{
+    const uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (uint32_t)(v * 2654435761UL) >> (32 - hashbits);
+}
+
+// Writes pending literals, returns false if these do not fit
+bool flushLiterals(const uint8_t *start, uint32_t &count, uint8_t *out, uint32_t &outpos, uint32_t outsize)
+{
+    if (!count)
+        return true;
+    if ((outpos + 1 + count) > outsize)
+        return false;
+    out[outpos++] = count - 1;
+    memcpy(&out[outpos], start, count);
+    outpos += count;
+    count = 0;
+    return true;
+}
+
+}
+
+uint32_t lzfCompress(const uint8_t *in, uint32_t insize, uint8_t *out, uint32_t outsize,
+                     uint16_t *htab, uint8_t hashbits)
+{
+    memset(htab, 0xFF, sizeof(uint16_t) << hashbits);
+
+    uint32_t inpos = 0, outpos = 0, litcount = 0;
+    while (inpos < insize)
+    {
+        uint32_t matchlen = 0, offset = 0;
+        if ((inpos + 2) < insize)
+        {
+            const uint32_t h = hash3(&in[inpos], hashbits);
+            const uint32_t ref = htab[h];
+            htab[h] = inpos;
+
+            if (ref != HASH_UNUSED && (inpos - ref) <= MAX_OFFSET && in[ref] == in[inpos] &&
+                in[ref + 1] == in[inpos + 1] && in[ref + 2] == in[inpos + 2])
+            {
+                const uint32_t maxlen = ((insize - inpos) < (uint32_t)MAX_MATCH) ? (insize - inpos) : (uint32_t)MAX_MATCH;
+                matchlen = 3;
+                while (matchlen < maxlen && in[ref + matchlen] == in[inpos + matchlen])
+                    ++matchlen;
+                offset = inpos - ref - 1;
+            }
+        }
+
+        if (!matchlen)
+        {
+            ++inpos;
+            if (++litcount == MAX_LITERAL && !flushLiterals(&in[inpos - litcount], litcount, out, outpos, outsize))
+                return 0;
+            continue;
+        }
+
+        if (!flushLiterals(&in[inpos - litcount], litcount, out, outpos, outsize))
+            return 0;
+
+        const uint32_t len = matchlen - 2;
+        if ((outpos + ((len < 7) ? 2 : 3)) > outsize)
+            return 0;
+        if (len < 7)
+            out[outpos++] = (len << 5) | (offset >> 8);
+        else
+        {
+            out[outpos++] = (7 << 5) | (offset >> 8);
+            out[outpos++] = len - 7;
+        }
+        out[outpos++] = offset & 0xFF;
+        inpos += matchlen;
+    }
+
+    if (!flushLiterals(&in[inpos - litcount], litcount, out, outpos, outsize))
+        return 0;
+    return outpos;
+}
+
+bool lzfDecompress(const uint8_t *in, uint32_t insize, uint8_t *out, uint32_t outsize)
+{
+    uint32_t inpos = 0, outpos = 0;
+    while (inpos < insize && outpos < outsize)
+    {
+        const uint8_t ctrl = in[inpos++];
+        if (ctrl < MAX_LITERAL)
+        {
+            const uint32_t len = ctrl + 1;
+            if ((inpos + len) > insize || (outpos + len) > outsize)
+                return false;
+            memcpy(&out[outpos], &in[inpos], len);
+            inpos += len; outpos += len;
+        }
+        else
+        {
+            uint32_t len = ctrl >> 5;
+            if (len == 7)
+            {
+                if (inpos >= insize)
+                    return false;
+                len += in[inpos++];
+            }
+            if (inpos >= insize)
+                return false;
+            const uint32_t offset = (((uint32_t)(ctrl & 0x1F) << 8) | in[inpos++]) + 1;
+            len += 2;
+            if (offset > outpos || (outpos + len) > outsize)
+                return false;
+
+            // byte wise: source and destination may overlap
+            for (const uint8_t *ref = &out[outpos - offset]; len; --len)
+                out[outpos++] = *ref++;
+        }
+    }
+
+    return outpos == outsize;
+}
+
+}
+
+}
@@ -5,6 +5,7 @@
 #include "internal/utils.h"
 #include "internal/vptr.h"
 #include "internal/vptr_utils.h"
+#include "internal/vspan.h"
 
 /**
   @file